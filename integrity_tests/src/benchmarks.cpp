@@ -0,0 +1,581 @@
+// Performance comparisons, hidden from the default test run. Run them with: IntegrityTests "[benchmark]"
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "test_classes.h"
+#include "volume/min_max_grid.h"
+#include "volume/volume_cache.h"
+#include <algorithm>
+#include <array>
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <glm/geometric.hpp>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Anisotropic (thick slices along z) CT-like test volume: an ellipsoid of "tissue" with some internal structure.
+static std::vector<float> createAnisotropicVolume(const glm::ivec3& dim)
+{
+    std::vector<float> data(size_t(dim.x) * size_t(dim.y) * size_t(dim.z));
+    const glm::vec3 center = glm::vec3(dim) / 2.0f;
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++) {
+                const glm::vec3 p = (glm::vec3(float(x), float(y), float(z)) - center) / center;
+                const float r = glm::length(p);
+                const float structure = 400.0f * std::sin(float(x) * 0.2f) * std::cos(float(y) * 0.15f) * std::sin(float(z) * 0.5f);
+                data[size_t(x) + size_t(dim.x) * (size_t(y) + size_t(dim.y) * size_t(z))] = r < 0.9f ? 1000.0f + structure : 0.0f;
+            }
+        }
+    }
+    return data;
+}
+
+static render::RenderConfig createBenchmarkRenderConfig(render::RenderMode renderMode)
+{
+    render::RenderConfig config {};
+    config.renderMode = renderMode;
+    config.renderResolution = glm::ivec2(128);
+    config.stepSize = 0.5f;
+    config.isoValue = 1200.0f;
+    config.volumeShading = true;
+    config.tfColorMapIndexStart = 0.0f;
+    config.tfColorMapIndexRange = 2000.0f;
+    for (size_t i = 0; i < config.tfColorMap.size(); i++)
+        config.tfColorMap[i] = glm::vec4(float(i) / 255.0f, 0.5f, 0.5f, float(i) / 2550.0f);
+    return config;
+}
+
+// View directions along each of the axes and along the diagonal.
+static const std::vector<std::pair<std::string, glm::vec3>> benchmarkViews {
+    { "x", glm::vec3(1, 0, 0) }, { "y", glm::vec3(0, 1, 0) }, { "z", glm::vec3(0, 0, 1) }, { "diagonal", glm::vec3(1, 1, 1) }
+};
+
+TEST_CASE("Voxel layout render performance", "[.][benchmark]")
+{
+    const glm::ivec3 dim { 256, 256, 64 };
+    const auto data = createAnisotropicVolume(dim);
+
+    const std::vector<std::pair<std::string, volume::VoxelLayout>> layouts {
+        { "linear", volume::VoxelLayout::Linear }, { "bricked", volume::VoxelLayout::Bricked }, { "morton", volume::VoxelLayout::Morton }
+    };
+    for (const auto& [layoutName, layout] : layouts) {
+        volume::Volume volume { data, dim, volume::LoadConfig { layout } };
+        volume::GradientVolume gradientVolume { volume };
+        volume.interpolationMode = gradientVolume.interpolationMode = volume::InterpolationMode::Linear;
+
+        for (const auto& [viewName, viewDirection] : benchmarkViews) {
+            const TestCamera camera { glm::vec3(dim) / 2.0f, viewDirection, 400.0f };
+            for (const auto renderMode : { render::RenderMode::RenderMIP, render::RenderMode::RenderIso }) {
+                render::Renderer renderer { &volume, &gradientVolume, &camera, createBenchmarkRenderConfig(renderMode) };
+                const std::string modeName = renderMode == render::RenderMode::RenderMIP ? "MIP" : "Iso";
+                BENCHMARK(layoutName + " " + modeName + " view " + viewName)
+                {
+                    renderer.render();
+                    return renderer.frameBuffer()[0];
+                };
+            }
+        }
+    }
+}
+
+TEST_CASE("Compressed volume render performance", "[.][benchmark]")
+{
+    const glm::ivec3 dim { 256, 256, 64 };
+    const auto data = createAnisotropicVolume(dim);
+
+    for (const bool compressed : { false, true }) {
+        volume::LoadConfig config { volume::VoxelLayout::Bricked };
+        config.compressed = compressed;
+        volume::Volume volume { data, dim, config };
+        volume::GradientVolume gradientVolume { volume };
+        volume.interpolationMode = gradientVolume.interpolationMode = volume::InterpolationMode::Linear;
+        if (const auto* pCompressedBricks = volume.compressedBricks())
+            WARN("Compression ratio: " << double(pCompressedBricks->uncompressedBytes()) / double(pCompressedBricks->compressedBytes()));
+
+        const std::string name = compressed ? "compressed" : "uncompressed";
+        for (const auto& [viewName, viewDirection] : benchmarkViews) {
+            const TestCamera camera { glm::vec3(dim) / 2.0f, viewDirection, 400.0f };
+            for (const auto renderMode : { render::RenderMode::RenderMIP, render::RenderMode::RenderIso }) {
+                render::Renderer renderer { &volume, &gradientVolume, &camera, createBenchmarkRenderConfig(renderMode) };
+                const std::string modeName = renderMode == render::RenderMode::RenderMIP ? "MIP" : "Iso";
+                BENCHMARK(name + " " + modeName + " view " + viewName)
+                {
+                    renderer.render();
+                    return renderer.frameBuffer()[0];
+                };
+            }
+        }
+        if (const auto* pCompressedBricks = volume.compressedBricks())
+            WARN("Decoded bricks of all render threads: " << double(pCompressedBricks->decodedBytes()) / double(1 << 20) << " MB");
+    }
+}
+
+TEST_CASE("Level of detail render performance", "[.][benchmark]")
+{
+    const glm::ivec3 dim { 256, 256, 64 };
+    volume::Volume volume { createAnisotropicVolume(dim), dim };
+    volume::GradientVolume gradientVolume { volume };
+    volume.interpolationMode = gradientVolume.interpolationMode = volume::InterpolationMode::Linear;
+
+    for (const auto& [viewName, viewDirection] : benchmarkViews) {
+        const TestCamera camera { glm::vec3(dim) / 2.0f, viewDirection, 400.0f };
+        for (const auto renderMode : { render::RenderMode::RenderMIP, render::RenderMode::RenderIso }) {
+            render::Renderer renderer { &volume, &gradientVolume, &camera, createBenchmarkRenderConfig(renderMode) };
+            const std::string modeName = renderMode == render::RenderMode::RenderMIP ? "MIP" : "Iso";
+            for (int lod = 0; lod <= 2; lod++) {
+                BENCHMARK("lod " + std::to_string(lod) + " " + modeName + " view " + viewName)
+                {
+                    renderer.setLevelOfDetail(lod);
+                    renderer.render();
+                    return renderer.frameBuffer()[0];
+                };
+            }
+        }
+    }
+}
+
+TEST_CASE("Gradient volume construction performance", "[.][benchmark]")
+{
+    const glm::ivec3 dim { 256, 256, 128 };
+    volume::LoadConfig config {};
+    config.mipPyramid = volume::MipPyramid::Never;
+    const volume::Volume linear { createAnisotropicVolume(dim), dim, config };
+    config.layout = volume::VoxelLayout::Bricked;
+    const volume::Volume bricked { createAnisotropicVolume(dim), dim, config };
+
+    BENCHMARK("Linear")
+    {
+        return volume::GradientVolume(linear).maxMagnitude();
+    };
+    BENCHMARK("Bricked")
+    {
+        return volume::GradientVolume(bricked).maxMagnitude();
+    };
+}
+
+TEST_CASE("Cache file load performance", "[.][benchmark]")
+{
+    // A .dat file (uint16 voxels) of the anisotropic volume.
+    const glm::ivec3 dim { 256, 256, 128 };
+    const std::filesystem::path file = std::filesystem::temp_directory_path() / "volvis_cache_benchmark.dat";
+    {
+        std::ofstream ofs(file, std::ios::binary);
+        const uint16_t header[3] { uint16_t(dim.x), uint16_t(dim.y), uint16_t(dim.z) };
+        ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+        for (const float value : createAnisotropicVolume(dim)) {
+            const auto voxel = uint16_t(value);
+            ofs.write(reinterpret_cast<const char*>(&voxel), sizeof(voxel));
+        }
+    }
+    volume::LoadConfig config {};
+    config.mipPyramid = volume::MipPyramid::Never;
+    {
+        const volume::Volume volume { file, config };
+        volume::VolumeCache::write(file, volume, volume::GradientVolume { volume });
+    }
+
+    // Loading the volume and its gradients, from the source file (computing the statistics and gradients) and from the
+    // cache file.
+    for (const bool useCacheFile : { false, true }) {
+        config.useCacheFile = useCacheFile;
+        BENCHMARK(useCacheFile ? "cache file" : "source file")
+        {
+            const volume::Volume volume { file, config };
+            return volume::GradientVolume(volume).maxMagnitude();
+        };
+    }
+    std::filesystem::remove(volume::VolumeCache::cacheFile(file));
+    std::filesystem::remove(file);
+}
+
+TEST_CASE("Compact gradient render performance", "[.][benchmark]")
+{
+    const glm::ivec3 dim { 256, 256, 64 };
+    volume::Volume volume { createAnisotropicVolume(dim), dim };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+
+    const std::vector<std::pair<std::string, volume::GradientFormat>> formats {
+        { "full", volume::GradientFormat::Full },
+        { "octahedral 8", volume::GradientFormat::Octahedral8 },
+        { "octahedral 16", volume::GradientFormat::Octahedral16 }
+    };
+    for (const auto& [formatName, format] : formats) {
+        volume::GradientVolume gradientVolume { volume, format };
+        gradientVolume.interpolationMode = volume::InterpolationMode::Linear;
+        for (const auto renderMode : { render::RenderMode::RenderIso, render::RenderMode::RenderComposite }) {
+            const TestCamera camera { glm::vec3(dim) / 2.0f, benchmarkViews[0].second, 400.0f };
+            render::Renderer renderer { &volume, &gradientVolume, &camera, createBenchmarkRenderConfig(renderMode) };
+            const std::string modeName = renderMode == render::RenderMode::RenderIso ? "Iso" : "Composite";
+            BENCHMARK(formatName + " " + modeName)
+            {
+                renderer.render();
+                return renderer.frameBuffer()[0];
+            };
+        }
+    }
+}
+
+TEST_CASE("On-the-fly gradient render performance", "[.][benchmark]")
+{
+    const glm::ivec3 dim { 256, 256, 64 };
+    volume::Volume volume { createAnisotropicVolume(dim), dim };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    volume::GradientVolume gradientVolume { volume };
+    gradientVolume.interpolationMode = volume::InterpolationMode::Linear;
+
+    for (const bool precompute : { true, false }) {
+        for (const auto renderMode : { render::RenderMode::RenderIso, render::RenderMode::RenderComposite }) {
+            const TestCamera camera { glm::vec3(dim) / 2.0f, benchmarkViews[0].second, 400.0f };
+            render::Renderer renderer { &volume, precompute ? &gradientVolume : nullptr, &camera, createBenchmarkRenderConfig(renderMode) };
+            const std::string modeName = renderMode == render::RenderMode::RenderIso ? "Iso" : "Composite";
+            BENCHMARK((precompute ? "precomputed " : "on the fly ") + modeName)
+            {
+                renderer.render();
+                return renderer.frameBuffer()[0];
+            };
+        }
+    }
+}
+
+TEST_CASE("Lazy gradient first render performance", "[.][benchmark]")
+{
+    const glm::ivec3 dim { 256, 256, 64 };
+    volume::Volume volume { createAnisotropicVolume(dim), dim };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+
+    // Construction of the gradient volume plus the first (Iso) render, which is when the lazy bricks are computed.
+    for (const auto& [formatName, format] : { std::pair { "full", volume::GradientFormat::Full }, std::pair { "lazy", volume::GradientFormat::Lazy } }) {
+        const TestCamera camera { glm::vec3(dim) / 2.0f, benchmarkViews[0].second, 400.0f };
+        BENCHMARK(std::string(formatName) + " construction + first render")
+        {
+            volume::GradientVolume gradientVolume { volume, format };
+            gradientVolume.interpolationMode = volume::InterpolationMode::Linear;
+            render::Renderer renderer { &volume, &gradientVolume, &camera, createBenchmarkRenderConfig(render::RenderMode::RenderIso) };
+            renderer.render();
+            return gradientVolume.byteSize();
+        };
+    }
+}
+
+TEST_CASE("Gradient interpolation performance", "[.][benchmark]")
+{
+    // Random positions in a gradient volume, which measures the fetching of the cell corners and the interpolation
+    // (interpolateCell) together.
+    const glm::ivec3 dim { 128, 128, 128 };
+    const volume::Volume volume { createAnisotropicVolume(dim), dim };
+    std::vector<glm::vec3> positions(size_t(1) << 12);
+    uint32_t seed = 12345;
+    auto random = [&]() {
+        seed = seed * 1664525u + 1013904223u;
+        return float(seed >> 8) / float(1 << 24);
+    };
+    for (auto& position : positions)
+        position = glm::vec3(random(), random(), random()) * glm::vec3(dim - 1);
+    const std::vector<std::pair<std::string, volume::GradientFormat>> formats {
+        { "full", volume::GradientFormat::Full },
+        { "octahedral 8", volume::GradientFormat::Octahedral8 },
+        { "octahedral 16", volume::GradientFormat::Octahedral16 }
+    };
+    for (const auto& [formatName, format] : formats) {
+        volume::GradientVolume gradientVolume { volume, format };
+        gradientVolume.interpolationMode = volume::InterpolationMode::Linear;
+        BENCHMARK("getGradientInterpolate " + formatName)
+        {
+            float sum = 0.0f;
+            for (const glm::vec3& position : positions)
+                sum += gradientVolume.getGradientInterpolate(position).magnitude;
+            return sum;
+        };
+    }
+}
+
+TEST_CASE("Batched sampling performance", "[.][benchmark]")
+{
+    const glm::ivec3 dim { 256, 256, 64 };
+    volume::Volume volume { createAnisotropicVolume(dim), dim };
+    volume::GradientVolume gradientVolume { volume };
+
+    // Samples along a bundle of rays through the volume, as a ray marcher would take them.
+    std::vector<glm::vec3> positions;
+    for (int ray = 0; ray < 256; ray++) {
+        const glm::vec3 origin { 10.0f + float(ray % 16) * 14.3f, 10.0f + float(ray / 16) * 14.1f, 0.25f };
+        for (int step = 0; step < 250; step++)
+            positions.push_back(origin + float(step) * glm::vec3(0.1f, 0.05f, 0.25f));
+    }
+    std::vector<float> samples(positions.size());
+    std::vector<volume::GradientVoxel> gradients(positions.size());
+
+    const std::vector<std::pair<std::string, volume::SimdLevel>> simdLevels {
+        { "scalar", volume::SimdLevel::Scalar }, { "AVX2", volume::SimdLevel::AVX2 }, { "AVX-512", volume::SimdLevel::AVX512 }
+    };
+    for (const auto mode : { volume::InterpolationMode::NearestNeighbour, volume::InterpolationMode::Linear }) {
+        volume.interpolationMode = gradientVolume.interpolationMode = mode;
+        const std::string modeName = mode == volume::InterpolationMode::Linear ? "linear" : "nearest";
+        for (const auto& [simdName, simdLevel] : simdLevels) {
+            BENCHMARK(modeName + " " + simdName)
+            {
+                volume.sampleBatch(positions, samples, simdLevel);
+                return samples[0];
+            };
+            BENCHMARK(modeName + " gradients " + simdName)
+            {
+                gradientVolume.sampleBatch(positions, gradients, simdLevel);
+                return gradients[0].magnitude;
+            };
+        }
+    }
+}
+
+TEST_CASE("Tricubic interpolation performance", "[.][benchmark]")
+{
+    const glm::ivec3 dim { 256, 256, 64 };
+    const TestVolume volume { createAnisotropicVolume(dim), dim };
+
+    // Samples along a bundle of rays through the volume, as a ray marcher would take them.
+    std::vector<glm::vec3> positions;
+    for (int ray = 0; ray < 256; ray++) {
+        const glm::vec3 origin { 10.0f + float(ray % 16) * 14.3f, 10.0f + float(ray / 16) * 14.1f, 0.25f };
+        for (int step = 0; step < 250; step++)
+            positions.push_back(origin + float(step) * glm::vec3(0.1f, 0.05f, 0.25f));
+    }
+
+    BENCHMARK("trilinear")
+    {
+        float sum = 0.0f;
+        for (const glm::vec3& pos : positions)
+            sum += volume.test_getSampleTriLinearInterpolation(pos);
+        return sum;
+    };
+    BENCHMARK("tricubic")
+    {
+        float sum = 0.0f;
+        for (const glm::vec3& pos : positions)
+            sum += volume.test_getSampleTriCubicInterpolation(pos);
+        return sum;
+    };
+    // The straightforward version: 4 bicubic interpolations of 16 voxels each.
+    BENCHMARK("tricubic (64 voxels)")
+    {
+        float sum = 0.0f;
+        for (const glm::vec3& pos : positions) {
+            const int z0 = int(pos.z);
+            const glm::vec2 xy { pos.x, pos.y };
+            sum += TestVolume::test_cubicInterpolate(
+                volume.test_biCubicInterpolate(xy, z0 - 1), volume.test_biCubicInterpolate(xy, z0), volume.test_biCubicInterpolate(xy, z0 + 1), volume.test_biCubicInterpolate(xy, z0 + 2), pos.z - float(z0));
+        }
+        return sum;
+    };
+}
+
+TEST_CASE("Batched MIP performance", "[.][benchmark]")
+{
+    const glm::ivec3 dim { 256, 256, 64 };
+    volume::Volume volume { createAnisotropicVolume(dim), dim };
+    const TestCamera camera { glm::vec3(dim) / 2.0f, benchmarkViews[3].second, 400.0f };
+    TestRenderer renderer { &volume, nullptr, &camera, createBenchmarkRenderConfig(render::RenderMode::RenderMIP) };
+
+    // Slightly tilted rays through the volume along z, from every second voxel of the xy-plane.
+    const glm::vec3 direction = glm::normalize(glm::vec3(0.3f, 0.2f, 1.0f));
+    std::vector<render::Ray> rays;
+    for (int y = 0; y < dim.y; y += 2) {
+        for (int x = 0; x < dim.x; x += 2)
+            rays.push_back({ glm::vec3(float(x), float(y), 0.0f), direction, 0.0f, float(dim.z - 1) / direction.z });
+    }
+    for (const auto& [interpolationName, interpolationMode] : { std::pair { "nearest", volume::InterpolationMode::NearestNeighbour }, std::pair { "linear", volume::InterpolationMode::Linear } }) {
+        volume.interpolationMode = interpolationMode;
+        BENCHMARK(std::string(interpolationName) + " per sample")
+        {
+            float sum = 0.0f;
+            for (const render::Ray& ray : rays)
+                sum += renderer.test_traceRayMIPSampled(ray, 0.5f, interpolationMode).r;
+            return sum;
+        };
+        BENCHMARK(std::string(interpolationName) + " batched")
+        {
+            float sum = 0.0f;
+            for (const render::Ray& ray : rays)
+                sum += renderer.test_traceRayMIPBatched(ray, 0.5f).r;
+            return sum;
+        };
+    }
+}
+
+TEST_CASE("Fixed-point interpolation performance", "[.][benchmark]")
+{
+    // The anisotropic volume with uint8 and uint16 voxels.
+    const glm::ivec3 dim { 256, 256, 64 };
+    std::vector<std::byte> bytes, words;
+    for (const float value : createAnisotropicVolume(dim)) {
+        const auto voxel = uint16_t(value);
+        bytes.push_back(std::byte { uint8_t(voxel / 8) });
+        words.insert(std::end(words), reinterpret_cast<const std::byte*>(&voxel), reinterpret_cast<const std::byte*>(&voxel + 1));
+    }
+
+    // The positions of the batched sampling benchmark.
+    std::vector<glm::vec3> positions;
+    for (int ray = 0; ray < 256; ray++) {
+        const glm::vec3 origin { 10.0f + float(ray % 16) * 14.3f, 10.0f + float(ray / 16) * 14.1f, 0.25f };
+        for (int step = 0; step < 250; step++)
+            positions.push_back(origin + float(step) * glm::vec3(0.1f, 0.05f, 0.25f));
+    }
+    std::vector<float> samples(positions.size());
+
+    const std::vector<std::pair<std::string, volume::SimdLevel>> simdLevels { { "AVX2", volume::SimdLevel::AVX2 }, { "AVX-512", volume::SimdLevel::AVX512 } };
+    for (const auto& [typeName, voxelType, pVoxels] : { std::tuple { "uint8", volume::VoxelType::UInt8, &bytes }, std::tuple { "uint16", volume::VoxelType::UInt16, &words } }) {
+        volume::Volume volume { dim, voxelType, *pVoxels };
+        volume.interpolationMode = volume::InterpolationMode::Linear;
+        for (const auto& [simdName, simdLevel] : simdLevels) {
+            BENCHMARK(std::string(typeName) + " float " + simdName)
+            {
+                volume.sampleBatch(positions, samples, simdLevel);
+                return samples[0];
+            };
+            BENCHMARK(std::string(typeName) + " fixed point " + simdName)
+            {
+                volume.sampleBatchFixedPoint(positions, samples, simdLevel);
+                return samples[0];
+            };
+        }
+
+        // The whole MIP renderer, which samples with the batched ray marcher.
+        const TestCamera camera { glm::vec3(dim) / 2.0f, benchmarkViews[3].second, 400.0f };
+        for (const bool fixedPoint : { false, true }) {
+            render::RenderConfig config = createBenchmarkRenderConfig(render::RenderMode::RenderMIP);
+            config.fixedPointInterpolation = fixedPoint;
+            render::Renderer renderer { &volume, nullptr, &camera, config };
+            BENCHMARK(std::string(typeName) + (fixedPoint ? " MIP fixed point" : " MIP float"))
+            {
+                renderer.render();
+                return renderer.frameBuffer()[0].r;
+            };
+        }
+    }
+}
+
+TEST_CASE("Ray marcher specialization performance", "[.][benchmark]")
+{
+    const glm::ivec3 dim { 256, 256, 64 };
+    volume::Volume volume { createAnisotropicVolume(dim), dim };
+    volume::GradientVolume gradientVolume { volume };
+    const TestCamera camera { glm::vec3(dim) / 2.0f, benchmarkViews[3].second, 400.0f };
+
+    const std::vector<std::pair<std::string, render::RenderMode>> renderModes {
+        { "MIP", render::RenderMode::RenderMIP }, { "Iso", render::RenderMode::RenderIso }, { "Composite", render::RenderMode::RenderComposite }
+    };
+    const std::vector<std::pair<std::string, volume::InterpolationMode>> interpolationModes {
+        { "nearest", volume::InterpolationMode::NearestNeighbour }, { "linear", volume::InterpolationMode::Linear }, { "cubic", volume::InterpolationMode::Cubic }
+    };
+    for (const auto& [modeName, renderMode] : renderModes) {
+        for (const auto& [interpolationName, interpolationMode] : interpolationModes) {
+            volume.interpolationMode = gradientVolume.interpolationMode = interpolationMode;
+            for (const bool shading : { false, true }) {
+                // Shading only applies to iso rendering.
+                if (shading && renderMode != render::RenderMode::RenderIso)
+                    continue;
+                for (const bool specialize : { false, true }) {
+                    render::RenderConfig config = createBenchmarkRenderConfig(renderMode);
+                    config.volumeShading = shading;
+                    TestRenderer renderer { &volume, &gradientVolume, &camera, config };
+                    renderer.test_setDynamicSampling(!specialize);
+                    BENCHMARK(modeName + " " + interpolationName + (shading ? " shaded " : " ") + (specialize ? "specialized" : "dynamic"))
+                    {
+                        renderer.render();
+                        return renderer.frameBuffer()[0];
+                    };
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Ray sampler performance", "[.][benchmark]")
+{
+    const glm::ivec3 dim { 256, 256, 64 };
+    volume::Volume volume { createAnisotropicVolume(dim), dim };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+
+    // A bundle of rays through the volume, marched with steps of a quarter, half and a whole voxel.
+    for (const float stepSize : { 0.25f, 0.5f, 1.0f }) {
+        std::vector<std::vector<glm::vec3>> rays;
+        for (int ray = 0; ray < 256; ray++) {
+            const glm::vec3 origin { 10.0f + float(ray % 16) * 14.3f, 10.0f + float(ray / 16) * 14.1f, 0.25f };
+            const glm::vec3 direction = glm::normalize(glm::vec3(0.1f, 0.05f, 0.25f));
+            std::vector<glm::vec3> positions;
+            for (float t = 0.0f; t < 60.0f; t += stepSize)
+                positions.push_back(origin + t * direction);
+            rays.push_back(std::move(positions));
+        }
+
+        const std::string step = "step " + std::to_string(stepSize).substr(0, 4);
+        BENCHMARK("getSampleInterpolate, " + step)
+        {
+            float sum = 0.0f;
+            for (const auto& positions : rays) {
+                for (const glm::vec3& pos : positions)
+                    sum += volume.getSampleInterpolate(pos);
+            }
+            return sum;
+        };
+        BENCHMARK("RaySampler, " + step)
+        {
+            float sum = 0.0f;
+            for (const auto& positions : rays) {
+                volume::RaySampler sampler { volume, 0 };
+                for (const glm::vec3& pos : positions)
+                    sum += sampler.sample<volume::InterpolationMode::Linear>(pos);
+            }
+            return sum;
+        };
+    }
+}
+
+TEST_CASE("Empty space skipping performance", "[.][benchmark]")
+{
+    // A sparse volume (a few small blobs in empty space) and the anisotropic volume, whose structure only exceeds the
+    // iso value in part of the bricks.
+    const glm::ivec3 dim { 256, 256, 128 };
+    std::vector<float> sparse(size_t(dim.x) * size_t(dim.y) * size_t(dim.z), 0.0f);
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++) {
+                const glm::vec3 p { float(x), float(y), float(z) };
+                float value = 0.0f;
+                for (const glm::vec3 center : { glm::vec3(60, 70, 40), glm::vec3(190, 120, 90), glm::vec3(100, 200, 64) })
+                    value = std::max(value, 2000.0f - 100.0f * glm::length(p - center));
+                sparse[size_t(x) + size_t(dim.x) * (size_t(y) + size_t(dim.y) * size_t(z))] = value;
+            }
+        }
+    }
+    const std::vector<std::pair<std::string, std::vector<float>>> volumes {
+        { "Sparse", std::move(sparse) }, { "Anisotropic", createAnisotropicVolume(dim) }
+    };
+    for (const auto& [volumeName, data] : volumes) {
+        volume::Volume volume { data, dim };
+        volume.interpolationMode = volume::InterpolationMode::Linear;
+        volume::GradientVolume gradientVolume { volume };
+        gradientVolume.interpolationMode = volume::InterpolationMode::Linear;
+        const TestCamera camera { glm::vec3(dim) / 2.0f, benchmarkViews[3].second, 400.0f };
+
+        BENCHMARK(volumeName + " min-max grid construction")
+        {
+            return volume::MinMaxGrid(volume).dims();
+        };
+        for (const int lod : { 0, 1 }) {
+            for (const bool skipping : { false, true }) {
+                render::RenderConfig config = createBenchmarkRenderConfig(render::RenderMode::RenderIso);
+                config.emptySpaceSkipping = skipping;
+                render::Renderer renderer { &volume, &gradientVolume, &camera, config };
+                renderer.setLevelOfDetail(lod);
+                renderer.render();
+                BENCHMARK(volumeName + " Iso lod " + std::to_string(lod) + (skipping ? " skipping" : " marching"))
+                {
+                    renderer.render();
+                    return renderer.frameBuffer()[0];
+                };
+            }
+        }
+    }
+}
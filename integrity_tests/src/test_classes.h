@@ -1,7 +1,10 @@
 #include <render/ray.h>
+#include <render/ray_trace_camera.h>
 #include <render/renderer.h>
 #include <volume/gradient_volume.h>
 #include <volume/volume.h>
+#include <cmath>
+#include <glm/geometric.hpp>
 #include <utility>
 
 #define provide_member_function_access(func_name)      \
@@ -52,10 +55,58 @@ public:
 
     provide_member_function_access(traceRaySlice)
     provide_member_function_access(traceRayMIP)
+    provide_member_function_access(traceRayMIPBatched)
     provide_member_function_access(traceRayISO)
     provide_member_function_access(traceRayComposite)
     provide_member_function_access(traceRayTF2D)
 
     provide_member_function_access(bisectionAccuracy)
     provide_member_function_access(computePhongShading)
-};
\ No newline at end of file
+    provide_const_member_function_access(getGradient)
+    provide_const_member_function_access(minMaxGrid)
+
+    // Render with the ray marchers that select the interpolation for every sample (Sampling::Dynamic) instead of the
+    // ones that are specialized for the interpolation mode of the volume.
+    void test_setDynamicSampling(bool dynamicSampling) { m_dynamicSampling = dynamicSampling; }
+
+    // The MIP ray marcher that samples one position at a time with the given interpolation, to compare the batched one
+    // against.
+    glm::vec4 test_traceRayMIPSampled(const render::Ray& ray, float stepSize, volume::InterpolationMode mode) const
+    {
+        return mode == volume::InterpolationMode::NearestNeighbour ? traceRayMIP<Sampling::NearestNeighbour, volume::VolumeSampler>(ray, stepSize) : traceRayMIP<Sampling::Linear, volume::VolumeSampler>(ray, stepSize);
+    }
+
+protected:
+    Sampling selectSampling() const override
+    {
+        return m_dynamicSampling ? Sampling::Dynamic : render::Renderer::selectSampling();
+    }
+
+private:
+    bool m_dynamicSampling { false };
+};
+
+// Camera looking at the center of the volume from a given direction.
+class TestCamera : public render::RayTraceCamera {
+public:
+    TestCamera(const glm::vec3& lookAt, const glm::vec3& forward, float distance)
+        : m_position(lookAt - distance * glm::normalize(forward))
+        , m_forward(glm::normalize(forward))
+    {
+        const glm::vec3 up = std::abs(m_forward.y) > 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+        m_right = glm::normalize(glm::cross(m_forward, up));
+        m_up = glm::cross(m_right, m_forward);
+    }
+
+    glm::vec3 position() const override { return m_position; }
+    glm::vec3 forward() const override { return m_forward; }
+    render::Ray generateRay(const glm::vec2& pixel) const override
+    {
+        // 60 degree field of view.
+        const glm::vec3 direction = glm::normalize(m_forward + 0.577f * (pixel.x * m_right + pixel.y * m_up));
+        return render::Ray { m_position, direction, 0.0f, 0.0f };
+    }
+
+private:
+    glm::vec3 m_position, m_forward, m_right, m_up;
+};
@@ -1,9 +1,27 @@
 // Can access the header files from the viewer...
 #include "test_classes.h"
 #include "ui/window.h"
+#include "volume/mapped_file.h"
+#include "volume/min_max_grid.h"
+#include "volume/ray_sampler.h"
+#include "volume/volume_cache.h"
+#include "volume/volume_loader.h"
+#include "volume/volume_sequence.h"
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <catch2/catch.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
 #include <glm/gtc/type_ptr.hpp>
+#include <thread>
+#include <tuple>
 
 /*
 GradientVolume:
@@ -25,6 +43,20 @@ Renderer:
     - getTF2DOpacity : m_pVolume, m_pGradientVolume, m_config.TF2DRadius, m_config.TF2DIntensity 
 */
 
+// Write a .dat file (three uint16 dimensions followed by the uint16 voxels) in which voxel i has the value i % 1000.
+static std::filesystem::path writeDatFile(const std::string& name, const glm::ivec3& dim)
+{
+    const std::filesystem::path file = std::filesystem::temp_directory_path() / name;
+    std::ofstream ofs(file, std::ios::binary);
+    const uint16_t header[3] { uint16_t(dim.x), uint16_t(dim.y), uint16_t(dim.z) };
+    ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+    for (int i = 0; i < dim.x * dim.y * dim.z; i++) {
+        const auto voxel = uint16_t(i % 1000);
+        ofs.write(reinterpret_cast<const char*>(&voxel), sizeof(voxel));
+    }
+    return file;
+}
+
 TEST_CASE("Volume Tests")
 {
     REQUIRE_NOTHROW(TestVolume::test_weight(0.f));
@@ -35,6 +67,803 @@ TEST_CASE("Volume Tests")
     REQUIRE_NOTHROW(volume.test_getSampleTriLinearInterpolation(glm::vec3(2.5f)));
     REQUIRE_NOTHROW(volume.test_biCubicInterpolate(glm::vec3(2.5f), 2));
     REQUIRE_NOTHROW(volume.test_getSampleTriCubicInterpolation(glm::vec3(2.5f)));
+
+    // A volume constructed from floats samples them in the vector that it was given, without a copy.
+    std::vector<float> data(125, 0.5f);
+    const std::byte* pData = reinterpret_cast<const std::byte*>(data.data());
+    const volume::Volume moved { std::move(data), glm::ivec3(5) };
+    REQUIRE(moved.voxels().data() == pData);
+    REQUIRE(moved.voxels().size() == 125 * sizeof(float));
+    REQUIRE(moved.getVoxel(1, 2, 3) == 0.5f);
+}
+
+TEST_CASE("Mapped File Tests")
+{
+    const std::filesystem::path file = std::filesystem::temp_directory_path() / "volvis_mapped_file_test.bin";
+    std::vector<char> contents(10000);
+    for (size_t i = 0; i < contents.size(); i++)
+        contents[i] = char(i * 31 % 256);
+    {
+        std::ofstream ofs(file, std::ios::binary);
+        ofs.write(contents.data(), std::streamsize(contents.size()));
+    }
+
+    volume::MappedFile mappedFile { file };
+    REQUIRE(mappedFile.isOpen());
+    REQUIRE(mappedFile.bytes().size() == contents.size());
+    REQUIRE(std::memcmp(mappedFile.bytes().data(), contents.data(), contents.size()) == 0);
+
+    // Moving keeps the mapping at the same address.
+    const std::byte* pData = mappedFile.bytes().data();
+    volume::MappedFile moved { std::move(mappedFile) };
+    REQUIRE(!mappedFile.isOpen());
+    REQUIRE(mappedFile.bytes().empty());
+    REQUIRE(moved.bytes().data() == pData);
+    REQUIRE(moved.bytes().size() == contents.size());
+
+    // Missing (and empty) files are not mapped.
+    const volume::MappedFile missing { std::filesystem::temp_directory_path() / "volvis_mapped_file_missing.bin" };
+    REQUIRE(!missing.isOpen());
+    REQUIRE(missing.bytes().empty());
+    const std::filesystem::path emptyFile = std::filesystem::temp_directory_path() / "volvis_mapped_file_empty.bin";
+    std::ofstream(emptyFile, std::ios::binary).close();
+    REQUIRE(!volume::MappedFile(emptyFile).isOpen());
+
+    // A volume loaded from a file samples the voxels in the mapped data section.
+    const glm::ivec3 dim { 13, 9, 7 };
+    const std::filesystem::path datFile = writeDatFile("volvis_mapped_volume_test.dat", dim);
+    volume::LoadConfig config {};
+    config.useCacheFile = false;
+    const volume::Volume volume { datFile, config };
+    REQUIRE(volume.voxels().size() == size_t(dim.x * dim.y * dim.z) * sizeof(uint16_t));
+    for (int z = 0; z < dim.z; z++)
+        for (int y = 0; y < dim.y; y++)
+            for (int x = 0; x < dim.x; x++)
+                REQUIRE(volume.getVoxel(x, y, z) == float((x + dim.x * (y + dim.y * z)) % 1000));
+
+    std::filesystem::remove(file);
+    std::filesystem::remove(emptyFile);
+    std::filesystem::remove(datFile);
+}
+
+TEST_CASE("Native Voxel Type Tests")
+{
+    // .fld files with byte and short voxels, sampled like float volumes with the same values. The header has an odd
+    // length, so the uint16 voxels are not aligned in the mapped file.
+    const glm::ivec3 dim { 19, 14, 11 };
+    std::vector<float> data(size_t(dim.x) * size_t(dim.y) * size_t(dim.z));
+    for (const auto voxelType : { volume::VoxelType::UInt8, volume::VoxelType::UInt16 }) {
+        const bool isByte = voxelType == volume::VoxelType::UInt8;
+        const std::filesystem::path file = std::filesystem::temp_directory_path() / (isByte ? "volvis_uint8_test.fld" : "volvis_uint16_test.fld");
+        {
+            std::ofstream ofs(file, std::ios::binary);
+            ofs << "# AVS\nndim=3\ndim1=" << dim.x << "\ndim2=" << dim.y << "\ndim3=" << dim.z << "\nnspace=3\nveclen=1\n"
+                << "data=" << (isByte ? "byte" : "short") << "\nfield=uniform\n\f\f";
+            for (size_t i = 0; i < data.size(); i++) {
+                const auto value = uint16_t(isByte ? (i * 37) % 256 : (i * 7919) % 65536);
+                data[i] = float(value);
+                if (isByte)
+                    ofs.put(char(value));
+                else
+                    ofs.write(reinterpret_cast<const char*>(&value), sizeof(value));
+            }
+        }
+
+        volume::LoadConfig config {};
+        config.useCacheFile = false;
+        volume::Volume native { file, config };
+        volume::Volume reference { data, dim };
+        REQUIRE(native.voxelType() == voxelType);
+        REQUIRE(native.voxels().size() == data.size() * (isByte ? 1 : 2));
+        REQUIRE(native.minimum() == reference.minimum());
+        REQUIRE(native.maximum() == reference.maximum());
+
+        for (int z = 0; z < dim.z; z++)
+            for (int y = 0; y < dim.y; y++)
+                for (int x = 0; x < dim.x; x++)
+                    REQUIRE(native.getVoxel(x, y, z) == reference.getVoxel(x, y, z));
+        for (const auto mode : { volume::InterpolationMode::NearestNeighbour, volume::InterpolationMode::Linear, volume::InterpolationMode::Cubic }) {
+            native.interpolationMode = reference.interpolationMode = mode;
+            for (float z = -1.0f; z < float(dim.z + 1); z += 0.7f) {
+                for (float y = -1.0f; y < float(dim.y + 1); y += 0.9f) {
+                    for (float x = -1.0f; x < float(dim.x + 1); x += 1.1f) {
+                        const glm::vec3 coord { x, y, z };
+                        REQUIRE(native.getSampleInterpolate(coord) == Approx(reference.getSampleInterpolate(coord)).epsilon(1e-6));
+                    }
+                }
+            }
+        }
+        std::filesystem::remove(file);
+    }
+}
+
+TEST_CASE("Volume Statistics Tests")
+{
+    // Enough voxels to be split over multiple blocks/threads.
+    std::vector<float> data(300000);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = float(i % 10);
+    const volume::Volume volume { data, glm::ivec3(100, 100, 30) };
+
+    REQUIRE(volume.minimum() == 0.0f);
+    REQUIRE(volume.maximum() == 9.0f);
+    REQUIRE(volume.mean() == Approx(4.5f));
+    REQUIRE(volume.variance() == Approx(8.25f));
+    const std::vector<int> histogram = volume.histogram();
+    REQUIRE(histogram.size() == 10);
+    REQUIRE(std::all_of(std::begin(histogram), std::end(histogram), [](int count) { return count == 30000; }));
+
+    // uint8 and uint16 voxels (which are summed with integers per block) against statistics computed one by one.
+    const glm::ivec3 dim { 97, 61, 53 };
+    const size_t voxelCount = size_t(dim.x) * size_t(dim.y) * size_t(dim.z);
+    for (const auto voxelType : { volume::VoxelType::UInt8, volume::VoxelType::UInt16 }) {
+        const size_t elementSize = voxelType == volume::VoxelType::UInt8 ? 1 : 2;
+        std::vector<std::byte> voxels(voxelCount * elementSize);
+        std::vector<uint32_t> values(voxelCount);
+        for (size_t i = 0; i < voxelCount; i++) {
+            // Skewed towards low values, with the maximum only reached by a few voxels.
+            const uint32_t range = voxelType == volume::VoxelType::UInt8 ? 251 : 60013;
+            values[i] = uint32_t((i * 7919 + i / 13) % range) * uint32_t(i % 3) / 2 + 3;
+            if (elementSize == 1) {
+                voxels[i] = std::byte { uint8_t(values[i]) };
+            } else {
+                const auto value = uint16_t(values[i]);
+                std::memcpy(&voxels[i * 2], &value, sizeof(value));
+            }
+        }
+        const volume::Volume integerVolume { dim, voxelType, std::move(voxels) };
+
+        const uint32_t expectedMinimum = *std::min_element(std::begin(values), std::end(values));
+        const uint32_t expectedMaximum = *std::max_element(std::begin(values), std::end(values));
+        double sum = 0.0, sumSquares = 0.0;
+        std::vector<int> expectedHistogram(expectedMaximum + 1, 0);
+        for (const uint32_t value : values) {
+            sum += double(value);
+            sumSquares += double(value) * double(value);
+            expectedHistogram[value]++;
+        }
+        const double expectedMean = sum / double(voxelCount);
+        REQUIRE(integerVolume.minimum() == float(expectedMinimum));
+        REQUIRE(integerVolume.maximum() == float(expectedMaximum));
+        REQUIRE(integerVolume.mean() == Approx(expectedMean));
+        REQUIRE(integerVolume.variance() == Approx(sumSquares / double(voxelCount) - expectedMean * expectedMean));
+        REQUIRE(integerVolume.histogram() == expectedHistogram);
+    }
+}
+
+TEST_CASE("Voxel Layout Tests")
+{
+    // Volume with a non-trivial pattern whose dimensions are not a multiple of the brick size.
+    const glm::ivec3 dim { 37, 21, 19 };
+    std::vector<float> data(size_t(dim.x * dim.y * dim.z));
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = float((i * 7919) % 251);
+
+    volume::Volume linear { data, dim };
+    volume::GradientVolume linearGradient { linear };
+    for (const auto layout : { volume::VoxelLayout::Bricked, volume::VoxelLayout::Morton }) {
+        volume::Volume other { data, dim, volume::LoadConfig { layout } };
+        volume::GradientVolume otherGradient { other };
+        REQUIRE(other.layout() == layout);
+        REQUIRE(otherGradient.layout() == layout);
+        REQUIRE(other.minimum() == linear.minimum());
+        REQUIRE(other.maximum() == linear.maximum());
+
+        for (const auto mode : { volume::InterpolationMode::NearestNeighbour, volume::InterpolationMode::Linear }) {
+            linear.interpolationMode = other.interpolationMode = mode;
+            linearGradient.interpolationMode = otherGradient.interpolationMode = mode;
+            for (float z = -1.0f; z < float(dim.z + 1); z += 0.7f) {
+                for (float y = -1.0f; y < float(dim.y + 1); y += 0.9f) {
+                    for (float x = -1.0f; x < float(dim.x + 1); x += 1.1f) {
+                        const glm::vec3 coord { x, y, z };
+                        REQUIRE(other.getSampleInterpolate(coord) == linear.getSampleInterpolate(coord));
+                        REQUIRE(otherGradient.getGradientInterpolate(coord).magnitude == linearGradient.getGradientInterpolate(coord).magnitude);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Volume Loader Tests")
+{
+    const glm::ivec3 dim { 23, 17, 11 };
+    const std::filesystem::path file = writeDatFile("volvis_loader_test.dat", dim);
+
+    volume::VolumeLoader loader;
+    REQUIRE(!loader.progress());
+
+    SECTION("Load")
+    {
+        loader.load(file, volume::LoadConfig { volume::VoxelLayout::Bricked });
+        while (loader.isLoading())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        REQUIRE(loader.progress()->stage == volume::VolumeLoader::Stage::Done);
+
+        auto optResult = loader.takeResult();
+        REQUIRE(optResult);
+        REQUIRE(!loader.takeResult());
+        const volume::Volume& volume = *optResult->pVolume;
+        REQUIRE(volume.dims() == dim);
+        REQUIRE(volume.layout() == volume::VoxelLayout::Bricked);
+        REQUIRE(volume.getVoxel(5, 7, 3) == float((5 + dim.x * (7 + dim.y * 3)) % 1000));
+        REQUIRE(optResult->pGradientVolume->dims() == dim);
+
+        // The loader writes a cache file for the next load.
+        REQUIRE(std::filesystem::exists(volume::VolumeCache::cacheFile(file)));
+        std::filesystem::remove(volume::VolumeCache::cacheFile(file));
+    }
+
+    SECTION("Load twice")
+    {
+        // The second load comes from the cache file that the first one wrote, which also has the mip pyramid.
+        std::filesystem::remove(volume::VolumeCache::cacheFile(file));
+        for (const bool fromCache : { false, true }) {
+            loader.load(file, volume::LoadConfig {});
+            while (loader.isLoading())
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            auto optResult = loader.takeResult();
+            REQUIRE(optResult);
+            const volume::Volume& volume = *optResult->pVolume;
+            REQUIRE(bool(volume.cache()) == fromCache);
+            REQUIRE(volume.mipLevelCount() > 0);
+            REQUIRE(optResult->pGradientVolume->mipLevelCount() == volume.mipLevelCount());
+            REQUIRE(volume.getSampleInterpolate(glm::vec3(6.5f, 4.5f, 2.5f), 1) == volume.mipLevel(1).getVoxel(3, 2, 1));
+        }
+        std::filesystem::remove(volume::VolumeCache::cacheFile(file));
+    }
+
+    SECTION("Cancel")
+    {
+        loader.load(file, volume::LoadConfig {});
+        loader.cancel();
+        REQUIRE(!loader.isLoading());
+        REQUIRE(loader.progress()->stage == volume::VolumeLoader::Stage::Cancelled);
+        REQUIRE(!loader.takeResult());
+    }
+
+    SECTION("Failed")
+    {
+        // A missing file and a file with an unsupported extension.
+        const std::filesystem::path unsupported = std::filesystem::temp_directory_path() / "volvis_loader_test.raw";
+        std::filesystem::copy_file(file, unsupported, std::filesystem::copy_options::overwrite_existing);
+        for (const auto& failingFile : { std::filesystem::temp_directory_path() / "volvis_loader_missing.dat", unsupported }) {
+            REQUIRE_THROWS_AS(volume::Volume(failingFile), std::runtime_error);
+            loader.load(failingFile, volume::LoadConfig {});
+            while (loader.isLoading())
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            REQUIRE(loader.progress()->stage == volume::VolumeLoader::Stage::Failed);
+            REQUIRE(!loader.takeResult());
+        }
+        std::filesystem::remove(unsupported);
+    }
+}
+
+TEST_CASE("Brick Cache Tests")
+{
+    // Multiple bricks in every direction, with partially filled bricks at the end.
+    const glm::ivec3 dim { 70, 40, 35 };
+    const std::filesystem::path file = writeDatFile("volvis_brick_cache_test.dat", dim);
+
+    volume::LoadConfig config {};
+    config.outOfCore = true;
+    // Room for only a few bricks so that bricks get evicted and read again.
+    config.brickCacheBudget = 4 * 33 * 33 * 33 * sizeof(uint16_t);
+    volume::Volume outOfCore { file, config };
+    volume::Volume inCore { file };
+    REQUIRE(outOfCore.brickCache());
+    REQUIRE(!inCore.brickCache());
+
+    REQUIRE(outOfCore.minimum() == inCore.minimum());
+    REQUIRE(outOfCore.maximum() == inCore.maximum());
+    REQUIRE(outOfCore.mean() == Approx(inCore.mean()));
+    REQUIRE(outOfCore.variance() == Approx(inCore.variance()));
+    REQUIRE(outOfCore.histogram() == inCore.histogram());
+
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++) {
+                REQUIRE(outOfCore.getVoxel(x, y, z) == inCore.getVoxel(x, y, z));
+            }
+        }
+    }
+
+    outOfCore.interpolationMode = inCore.interpolationMode = volume::InterpolationMode::Linear;
+    for (int i = 0; i < 1000; i++) {
+        // Deterministic sample positions that cover the whole volume (including the brick borders).
+        const glm::vec3 coord = glm::vec3(float(i % 97), float(i % 43), float(i % 37)) * 0.7123f;
+        REQUIRE(outOfCore.getSampleInterpolate(coord) == inCore.getSampleInterpolate(coord));
+    }
+
+    const volume::BrickCache& brickCache = *outOfCore.brickCache();
+    REQUIRE(brickCache.hits() > 0);
+    REQUIRE(brickCache.misses() > 0);
+    REQUIRE(brickCache.residentBytes() <= brickCache.budget());
+
+    // Threads that sample the volume at the same time (each keeping its own last brick) while bricks are evicted.
+    std::vector<std::thread> threads;
+    std::atomic<int> mismatches { 0 };
+    for (int thread = 0; thread < 4; thread++) {
+        threads.emplace_back([&, thread]() {
+            for (int i = 0; i < 20000; i++) {
+                const int x = (i * 7 + thread * 13) % dim.x, y = (i / 3 + thread * 5) % dim.y, z = (i / 11 + thread) % dim.z;
+                if (outOfCore.getVoxel(x, y, z) != inCore.getVoxel(x, y, z))
+                    mismatches++;
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    REQUIRE(mismatches == 0);
+    REQUIRE(brickCache.residentBytes() <= brickCache.budget());
+
+    // A brick that a thread keeps sampling (which it finds as its last brick, without a lookup) stays resident while
+    // this thread reads all other bricks. The threads take turns, one brick of this thread per sample of the other.
+    {
+        volume::Volume streamed { file, config };
+        const volume::BrickCache& streamedCache = *streamed.brickCache();
+        const glm::ivec3 brickCount = (dim + volume::BrickCache::brickSize - 1) / volume::BrickCache::brickSize;
+        const int steps = brickCount.x * brickCount.y * brickCount.z;
+        std::atomic<int> requested { 0 }, sampled { 0 };
+        std::thread holder([&]() {
+            for (int i = 0; i < steps; i++) {
+                while (requested.load() <= i)
+                    std::this_thread::yield();
+                streamed.getVoxel(1, 1, 1);
+                sampled.store(i + 1);
+            }
+        });
+        for (int i = 0; i < steps; i++) {
+            if (i > 0) {
+                const glm::ivec3 brick { i % brickCount.x, i / brickCount.x % brickCount.y, i / (brickCount.x * brickCount.y) };
+                const glm::ivec3 voxel = brick * volume::BrickCache::brickSize;
+                REQUIRE(streamed.getVoxel(voxel.x, voxel.y, voxel.z) == inCore.getVoxel(voxel.x, voxel.y, voxel.z));
+            }
+            requested.store(i + 1);
+            while (sampled.load() <= i)
+                std::this_thread::yield();
+        }
+        holder.join();
+        const uint64_t misses = streamedCache.misses();
+        REQUIRE(streamed.getVoxel(1, 1, 1) == inCore.getVoxel(1, 1, 1));
+        REQUIRE(streamedCache.misses() == misses);
+        REQUIRE(streamedCache.residentBytes() <= streamedCache.budget());
+    }
+
+    // The loader does not compute an (in memory) gradient volume for out-of-core volumes.
+    volume::VolumeLoader loader;
+    loader.load(file, config);
+    while (loader.isLoading())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    auto optResult = loader.takeResult();
+    REQUIRE(optResult);
+    REQUIRE(optResult->pVolume->brickCache());
+    REQUIRE(!optResult->pGradientVolume);
+}
+
+TEST_CASE("Compressed Volume Tests")
+{
+    volume::LoadConfig config {};
+    config.compressed = true;
+
+    SECTION("UInt16")
+    {
+        const glm::ivec3 dim { 45, 20, 33 };
+        const std::filesystem::path file = writeDatFile("volvis_compressed_test.dat", dim);
+        const volume::Volume compressed { file, config };
+        const volume::Volume uncompressed { file };
+        REQUIRE(compressed.compressedBricks());
+        REQUIRE(compressed.voxels().empty());
+        REQUIRE(compressed.histogram() == uncompressed.histogram());
+        for (int z = 0; z < dim.z; z++) {
+            for (int y = 0; y < dim.y; y++) {
+                for (int x = 0; x < dim.x; x++) {
+                    REQUIRE(compressed.getVoxel(x, y, z) == uncompressed.getVoxel(x, y, z));
+                }
+            }
+        }
+    }
+
+    SECTION("Float")
+    {
+        // Mostly empty volume with a block of "tissue", like a CT scan surrounded by air.
+        const glm::ivec3 dim { 50, 41, 27 };
+        std::vector<float> data(size_t(dim.x * dim.y * dim.z), 0.0f);
+        for (int z = 8; z < 20; z++) {
+            for (int y = 10; y < 30; y++) {
+                for (int x = 12; x < 40; x++)
+                    data[size_t(x + dim.x * (y + dim.y * z))] = 1000.0f + float((x * y + z) % 17) * 0.25f;
+            }
+        }
+        volume::Volume compressed { data, dim, config };
+        volume::Volume uncompressed { data, dim };
+        REQUIRE(compressed.compressedBricks());
+        REQUIRE(compressed.compressedBricks()->uncompressedBytes() == data.size() * sizeof(float));
+        REQUIRE(compressed.compressedBricks()->compressedBytes() < compressed.compressedBricks()->uncompressedBytes() / 4);
+
+        for (const auto mode : { volume::InterpolationMode::NearestNeighbour, volume::InterpolationMode::Linear }) {
+            compressed.interpolationMode = uncompressed.interpolationMode = mode;
+            for (float z = -1.0f; z < float(dim.z + 1); z += 0.7f) {
+                for (float y = -1.0f; y < float(dim.y + 1); y += 0.9f) {
+                    for (float x = -1.0f; x < float(dim.x + 1); x += 1.1f) {
+                        const glm::vec3 coord { x, y, z };
+                        REQUIRE(compressed.getSampleInterpolate(coord) == uncompressed.getSampleInterpolate(coord));
+                    }
+                }
+            }
+        }
+
+        // The decoded bricks of this thread fit in its budget, and are released when it samples another volume.
+        const volume::CompressedBricks& compressedBricks = *compressed.compressedBricks();
+        REQUIRE(compressedBricks.decodedBytes() > 0);
+        REQUIRE(compressedBricks.decodedBytes() <= volume::CompressedBricks::decodedBrickCacheBudget);
+        const volume::Volume other { data, dim, config };
+        REQUIRE(other.getVoxel(20, 20, 10) == uncompressed.getVoxel(20, 20, 10));
+        REQUIRE(compressedBricks.decodedBytes() == 0);
+        REQUIRE(other.compressedBricks()->decodedBytes() == 17 * 17 * 17 * sizeof(float)); // One stored (16 + 1)^3 brick.
+    }
+}
+
+TEST_CASE("Mip Pyramid Tests")
+{
+    // A linear function is reproduced exactly by averaging (away from the border) and by trilinear interpolation, so
+    // every level should return the function value at the sample position.
+    const glm::ivec3 dim { 64, 32, 24 };
+    auto f = [](const glm::vec3& p) { return p.x + 2.0f * p.y + 3.0f * p.z; };
+    std::vector<float> data(size_t(dim.x * dim.y * dim.z));
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++)
+                data[size_t(x + dim.x * (y + dim.y * z))] = f(glm::vec3(float(x), float(y), float(z)));
+        }
+    }
+    volume::Volume volume { data, dim };
+    volume::GradientVolume gradientVolume { volume };
+    // 32x16x12, 16x8x6, 8x4x3, 4x2x2 (the next level would be 1 voxel thick).
+    REQUIRE(volume.mipLevelCount() == 4);
+    REQUIRE(gradientVolume.mipLevelCount() == 4);
+    volume::LoadConfig noPyramid {};
+    noPyramid.mipPyramid = volume::MipPyramid::Never;
+    REQUIRE(volume::Volume(data, dim, noPyramid).mipLevelCount() == 0);
+
+    // By default only volumes whose voxels are in memory get a pyramid (also those that are loaded from the cache file),
+    // not those that are loaded out-of-core or compressed.
+    {
+        const std::filesystem::path file = writeDatFile("volvis_mip_pyramid_test.dat", dim);
+        std::filesystem::remove(volume::VolumeCache::cacheFile(file));
+        const volume::Volume loaded { file };
+        REQUIRE(loaded.mipLevelCount() == 4);
+        REQUIRE(volume::VolumeCache::write(file, loaded, volume::GradientVolume { loaded }));
+        const volume::Volume cached { file };
+        REQUIRE(cached.cache());
+        REQUIRE(cached.mipLevelCount() == 4);
+        REQUIRE(cached.getSampleInterpolate(glm::vec3(20.5f, 10.5f, 7.5f), 2) == loaded.getSampleInterpolate(glm::vec3(20.5f, 10.5f, 7.5f), 2));
+        volume::LoadConfig outOfCore {};
+        outOfCore.outOfCore = true;
+        volume::LoadConfig compressed {};
+        compressed.compressed = true;
+        for (volume::LoadConfig config : { outOfCore, compressed }) {
+            const volume::Volume skipped { file, config };
+            REQUIRE(skipped.mipLevelCount() == 0);
+            config.mipPyramid = volume::MipPyramid::Always;
+            const volume::Volume withPyramid { file, config };
+            REQUIRE(withPyramid.mipLevelCount() == 4);
+            REQUIRE(withPyramid.getSampleInterpolate(glm::vec3(20.5f, 10.5f, 7.5f), 2) == loaded.getSampleInterpolate(glm::vec3(20.5f, 10.5f, 7.5f), 2));
+        }
+        REQUIRE(volume::Volume(file).cache());
+        std::filesystem::remove(volume::VolumeCache::cacheFile(file));
+    }
+
+    volume.interpolationMode = gradientVolume.interpolationMode = volume::InterpolationMode::Linear;
+    for (int lod = 0; lod <= 2; lod++) {
+        // Positions that lie inside the cells of this level.
+        const float scale = float(1 << lod);
+        for (int i = 0; i < 200; i++) {
+            const glm::vec3 levelCoord = glm::vec3(float(i % 13), float(i % 7), float(i % 5)) * 0.37f + 0.1f;
+            const glm::vec3 coord = (levelCoord + 0.5f) * scale - 0.5f;
+            REQUIRE(volume.getSampleInterpolate(coord, lod) == Approx(f(coord)));
+        }
+    }
+    const glm::vec3 center = glm::vec3(dim) / 2.0f;
+    REQUIRE(volume.getSampleInterpolate(center, 0) == volume.getSampleInterpolate(center));
+    // Levels beyond the coarsest one are clamped.
+    REQUIRE(volume.getSampleInterpolate(center, 10) == volume.getSampleInterpolate(center, volume.mipLevelCount()));
+
+    // The gradient of f is (1, 2, 3) everywhere except on the border, where it is zero.
+    for (int lod = 0; lod <= 2; lod++) {
+        const volume::GradientVoxel gradient = gradientVolume.getGradientInterpolate(center, lod);
+        REQUIRE(gradient.dir.x == Approx(1.0f));
+        REQUIRE(gradient.dir.y == Approx(2.0f));
+        REQUIRE(gradient.dir.z == Approx(3.0f));
+    }
+}
+
+TEST_CASE("Large Volume Tests")
+{
+    // Just over 2^31 voxels. The file is sparse (all zero except for a few voxels) so it does not use 2GB of disk space.
+    const glm::ivec3 dim { 2048, 1024, 1026 };
+    const size_t voxelCount = size_t(dim.x) * size_t(dim.y) * size_t(dim.z);
+    REQUIRE(voxelCount > (size_t(1) << 31));
+    const glm::ivec3 beyondLimit { 5, 3, 1024 };
+    const glm::ivec3 last = dim - 1;
+    auto linearIndex = [&](const glm::ivec3& p) { return size_t(p.x) + size_t(dim.x) * (size_t(p.y) + size_t(dim.y) * size_t(p.z)); };
+    REQUIRE(linearIndex(beyondLimit) > size_t(std::numeric_limits<int>::max()));
+
+    const std::filesystem::path file = std::filesystem::temp_directory_path() / "volvis_large_test.fld";
+    {
+        std::ofstream ofs(file, std::ios::binary);
+        ofs << "ndim=3\ndim1=" << dim.x << "\ndim2=" << dim.y << "\ndim3=" << dim.z << "\nnspace=3\nveclen=1\ndata=byte\nfield=uniform\n\f\f";
+        const std::streamoff dataOffset = ofs.tellp();
+        ofs.seekp(dataOffset + std::streamoff(linearIndex(beyondLimit)));
+        ofs.put(char(100));
+        ofs.seekp(dataOffset + std::streamoff(linearIndex(last)));
+        ofs.put(char(200));
+    }
+
+    for (const auto layout : { volume::VoxelLayout::Linear, volume::VoxelLayout::Bricked, volume::VoxelLayout::Morton }) {
+        const volume::VoxelIndexer indexer { layout, dim };
+        REQUIRE(indexer.size() >= voxelCount);
+        for (const glm::ivec3& p : { beyondLimit, last })
+            REQUIRE(indexer.position(indexer.index(p.x, p.y, p.z)) == p);
+    }
+
+    volume::LoadConfig config;
+    config.mipPyramid = volume::MipPyramid::Never;
+    config.useCacheFile = false;
+    SECTION("In core")
+    {
+        volume::Volume volume { file, config };
+        volume.interpolationMode = volume::InterpolationMode::Linear;
+        REQUIRE(volume.dims() == dim);
+        REQUIRE(volume.voxels().size() == voxelCount);
+        REQUIRE(volume.getVoxel(beyondLimit.x, beyondLimit.y, beyondLimit.z) == 100.0f);
+        REQUIRE(volume.getVoxel(last.x, last.y, last.z) == 200.0f);
+        REQUIRE(volume.getVoxel(beyondLimit.x + 1, beyondLimit.y, beyondLimit.z) == 0.0f);
+        REQUIRE(volume.getSampleInterpolate(glm::vec3(beyondLimit) + glm::vec3(0.5f, 0.0f, 0.0f)) == Approx(50.0f));
+        REQUIRE(volume.maximum() == 200.0f);
+        REQUIRE(volume.mean() == Approx(300.0 / double(voxelCount)));
+
+        // The count of the background overflows an int and saturates.
+        const std::vector<int> histogram = volume.histogram();
+        REQUIRE(histogram.size() == 201);
+        REQUIRE(histogram[0] == std::numeric_limits<int>::max());
+        REQUIRE(histogram[100] == 1);
+        REQUIRE(histogram[200] == 1);
+    }
+    SECTION("Out of core")
+    {
+        config.outOfCore = true;
+        const volume::Volume volume { file, config };
+        REQUIRE(volume.brickCache());
+        REQUIRE(volume.getVoxel(beyondLimit.x, beyondLimit.y, beyondLimit.z) == 100.0f);
+        REQUIRE(volume.getVoxel(last.x, last.y, last.z) == 200.0f);
+        REQUIRE(volume.maximum() == 200.0f);
+        REQUIRE(volume.histogram()[0] == std::numeric_limits<int>::max());
+    }
+    std::filesystem::remove(file);
+}
+
+TEST_CASE("Volume Sequence Tests")
+{
+    // A series of timesteps in which only the voxels in one corner change over time.
+    const glm::ivec3 dim { 21, 18, 17 };
+    const size_t timestepCount = volume::VolumeSequence::keyframeInterval + 2;
+    auto expectedVoxel = [](int x, int y, int z, size_t timestep) {
+        return uint16_t(x + y + z + (x < 8 && y < 8 && z < 8 ? 10 * int(timestep) : 0));
+    };
+    std::vector<std::filesystem::path> files;
+    for (size_t timestep = 0; timestep < timestepCount; timestep++) {
+        const std::string number = std::to_string(100 + timestep).substr(1);
+        const std::filesystem::path file = std::filesystem::temp_directory_path() / ("volvis_sequence_" + number + ".dat");
+        std::ofstream ofs(file, std::ios::binary);
+        const uint16_t header[3] { uint16_t(dim.x), uint16_t(dim.y), uint16_t(dim.z) };
+        ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+        for (int z = 0; z < dim.z; z++) {
+            for (int y = 0; y < dim.y; y++) {
+                for (int x = 0; x < dim.x; x++) {
+                    const uint16_t voxel = expectedVoxel(x, y, z, timestep);
+                    ofs.write(reinterpret_cast<const char*>(&voxel), sizeof(voxel));
+                }
+            }
+        }
+        files.push_back(file);
+    }
+    writeDatFile("volvis_sequence_other.dat", dim);
+
+    REQUIRE(volume::VolumeSequence::findSeries(files[3]) == files);
+
+    for (const bool deltaBricks : { false, true }) {
+        volume::SequenceConfig config;
+        config.deltaBricks = deltaBricks;
+        volume::VolumeSequence sequence { files, config };
+        REQUIRE(sequence.timestepCount() == timestepCount);
+        REQUIRE(sequence.currentTimestep() == 0);
+        REQUIRE((sequence.deltaBytes() > 0) == deltaBricks);
+        if (deltaBricks) {
+            // Two keyframes and one changed brick (and its index) for every other timestep.
+            const size_t keyframeBytes = size_t(dim.x * dim.y * dim.z) * sizeof(uint16_t);
+            const size_t brickBytes = size_t(volume::VoxelIndexer::brickSize * volume::VoxelIndexer::brickSize * volume::VoxelIndexer::brickSize) * sizeof(uint16_t);
+            REQUIRE(sequence.deltaBytes() == 2 * keyframeBytes + (timestepCount - 2) * (brickBytes + sizeof(uint32_t)));
+        }
+
+        // Nothing happens while paused.
+        REQUIRE(!sequence.update(std::chrono::seconds(1)));
+
+        sequence.setFramesPerSecond(1000.0f);
+        sequence.play();
+        for (size_t frame = 1; frame <= timestepCount + 2; frame++) {
+            // Wait for the decode threads if playback stalls.
+            if (!sequence.update(std::chrono::milliseconds(1))) {
+                while (!sequence.update(std::chrono::seconds(0)))
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            const size_t timestep = frame % timestepCount;
+            REQUIRE(sequence.currentTimestep() == timestep);
+            const volume::Volume& volume = sequence.volume();
+            for (int z = 0; z < dim.z; z += 3) {
+                for (int y = 0; y < dim.y; y += 2) {
+                    for (int x = 0; x < dim.x; x++)
+                        REQUIRE(volume.getVoxel(x, y, z) == float(expectedVoxel(x, y, z, timestep)));
+                }
+            }
+            // The gradients follow the timestep: the x gradient at the edge of the changing corner is (16 - (14 + 10t)) / 2.
+            REQUIRE(sequence.gradientVolume().getGradient(7, 4, 4).dir.x == Approx(1.0f - 5.0f * float(timestep)));
+        }
+    }
+
+    for (const auto& file : files)
+        std::filesystem::remove(file);
+    std::filesystem::remove(std::filesystem::temp_directory_path() / "volvis_sequence_other.dat");
+}
+
+TEST_CASE("Sub-Volume Loading Tests")
+{
+    const glm::ivec3 dim { 29, 18, 13 };
+    const std::filesystem::path file = writeDatFile("volvis_sub_volume_test.dat", dim);
+    volume::LoadConfig fullConfig;
+    fullConfig.mipPyramid = volume::MipPyramid::Never;
+    fullConfig.useCacheFile = false;
+    const volume::Volume full { file, fullConfig };
+
+    const glm::ivec3 cropMin { 3, 2, 1 };
+    const glm::ivec3 cropMax { 20, 15, 12 };
+    for (const int factor : { 1, 2, 3 }) {
+        for (const auto filter : { volume::DownsampleFilter::Stride, volume::DownsampleFilter::BoxFilter }) {
+            volume::LoadConfig config = fullConfig;
+            config.cropMin = cropMin;
+            config.cropMax = cropMax;
+            config.downsampleFactor = factor;
+            config.downsampleFilter = filter;
+            REQUIRE(config.loadsSubVolume());
+            const volume::Volume subVolume { file, config };
+            const glm::ivec3 subDim = (cropMax - cropMin + factor - 1) / factor;
+            REQUIRE(subVolume.dims() == subDim);
+
+            for (int z = 0; z < subDim.z; z++) {
+                for (int y = 0; y < subDim.y; y++) {
+                    for (int x = 0; x < subDim.x; x++) {
+                        const glm::ivec3 blockBegin = cropMin + factor * glm::ivec3(x, y, z);
+                        float expected = full.getVoxel(blockBegin.x, blockBegin.y, blockBegin.z);
+                        if (filter == volume::DownsampleFilter::BoxFilter) {
+                            // Partial blocks on the far sides average the voxels inside the crop box.
+                            const glm::ivec3 blockEnd = glm::min(blockBegin + factor, cropMax);
+                            float sum = 0.0f;
+                            for (int fz = blockBegin.z; fz < blockEnd.z; fz++) {
+                                for (int fy = blockBegin.y; fy < blockEnd.y; fy++) {
+                                    for (int fx = blockBegin.x; fx < blockEnd.x; fx++)
+                                        sum += full.getVoxel(fx, fy, fz);
+                                }
+                            }
+                            const glm::ivec3 count = blockEnd - blockBegin;
+                            expected = std::floor(sum / float(count.x * count.y * count.z) + 0.5f);
+                        }
+                        REQUIRE(subVolume.getVoxel(x, y, z) == expected);
+                    }
+                }
+            }
+        }
+    }
+
+    // The crop box is clamped to the volume.
+    volume::LoadConfig clampedConfig = fullConfig;
+    clampedConfig.cropMin = glm::ivec3(-5, 10, 0);
+    clampedConfig.cropMax = glm::ivec3(100, 100, 1);
+    const volume::Volume clamped { file, clampedConfig };
+    REQUIRE(clamped.dims() == glm::ivec3(dim.x, dim.y - 10, 1));
+    REQUIRE(clamped.getVoxel(4, 0, 0) == full.getVoxel(4, 10, 0));
+
+    // Sub-volumes do not use the cache file of the complete volume.
+    const volume::GradientVolume fullGradientVolume { full };
+    REQUIRE(volume::VolumeCache::write(file, full, fullGradientVolume));
+    volume::LoadConfig cachedConfig;
+    cachedConfig.downsampleFactor = 2;
+    const volume::Volume downsampled { file, cachedConfig };
+    REQUIRE(!downsampled.cache());
+    REQUIRE(downsampled.dims() == (dim + 1) / 2);
+    std::filesystem::remove(volume::VolumeCache::cacheFile(file));
+}
+
+TEST_CASE("Volume Cache Tests")
+{
+    const glm::ivec3 dim { 29, 18, 13 };
+    const std::filesystem::path file = writeDatFile("volvis_cache_test.dat", dim);
+    std::filesystem::remove(volume::VolumeCache::cacheFile(file));
+
+    const volume::LoadConfig config { volume::VoxelLayout::Bricked };
+    const volume::Volume sourceVolume { file, config };
+    const volume::GradientVolume sourceGradientVolume { sourceVolume };
+    REQUIRE(!sourceVolume.cache());
+    REQUIRE(volume::VolumeCache::write(file, sourceVolume, sourceGradientVolume));
+
+    // A different layout does not match the cache file.
+    REQUIRE(!volume::Volume(file, volume::LoadConfig {}).cache());
+
+    const volume::Volume cachedVolume { file, config };
+    const volume::GradientVolume cachedGradientVolume { cachedVolume };
+    REQUIRE(cachedVolume.cache());
+    REQUIRE(cachedVolume.dims() == sourceVolume.dims());
+    REQUIRE(cachedVolume.layout() == sourceVolume.layout());
+    REQUIRE(cachedVolume.voxelType() == sourceVolume.voxelType());
+    REQUIRE(cachedVolume.minimum() == sourceVolume.minimum());
+    REQUIRE(cachedVolume.maximum() == sourceVolume.maximum());
+    REQUIRE(cachedVolume.mean() == sourceVolume.mean());
+    REQUIRE(cachedVolume.variance() == sourceVolume.variance());
+    REQUIRE(cachedVolume.histogram() == sourceVolume.histogram());
+    REQUIRE(cachedGradientVolume.minMagnitude() == sourceGradientVolume.minMagnitude());
+    REQUIRE(cachedGradientVolume.maxMagnitude() == sourceGradientVolume.maxMagnitude());
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++) {
+                REQUIRE(cachedVolume.getVoxel(x, y, z) == sourceVolume.getVoxel(x, y, z));
+                REQUIRE(cachedGradientVolume.getGradient(x, y, z).dir == sourceGradientVolume.getGradient(x, y, z).dir);
+            }
+        }
+    }
+
+    // The levels of the mip pyramid are used in place from the cache file, unless the pyramid is not wanted.
+    volume::LoadConfig pyramidConfig = config;
+    pyramidConfig.mipPyramid = volume::MipPyramid::Always;
+    const volume::Volume pyramidVolume { file, pyramidConfig };
+    const volume::GradientVolume pyramidGradientVolume { pyramidVolume };
+    REQUIRE(pyramidVolume.mipLevelCount() == sourceVolume.mipLevelCount());
+    REQUIRE(pyramidGradientVolume.mipLevelCount() == sourceGradientVolume.mipLevelCount());
+    for (int lod = 1; lod <= sourceVolume.mipLevelCount(); lod++) {
+        const volume::Volume& cachedLevel = pyramidVolume.mipLevel(lod);
+        const volume::Volume& sourceLevel = sourceVolume.mipLevel(lod);
+        REQUIRE(cachedLevel.voxels().data() == pyramidVolume.cache()->mipLevelVoxels(lod).data());
+        REQUIRE(cachedLevel.dims() == sourceLevel.dims());
+        REQUIRE(cachedLevel.mean() == sourceLevel.mean());
+        REQUIRE(std::equal(std::begin(cachedLevel.voxels()), std::end(cachedLevel.voxels()), std::begin(sourceLevel.voxels()), std::end(sourceLevel.voxels())));
+        const auto cachedGradients = pyramidGradientVolume.mipLevel(lod).data();
+        const auto sourceGradients = sourceGradientVolume.mipLevel(lod).data();
+        REQUIRE(cachedGradients.data() == pyramidVolume.cache()->mipLevelGradients(lod).data());
+        REQUIRE(std::memcmp(cachedGradients.data(), sourceGradients.data(), sourceGradients.size_bytes()) == 0);
+    }
+    pyramidConfig.mipPyramid = volume::MipPyramid::Never;
+    const volume::Volume noPyramidVolume { file, pyramidConfig };
+    REQUIRE(noPyramidVolume.cache());
+    REQUIRE(noPyramidVolume.mipLevelCount() == 0);
+    REQUIRE(volume::GradientVolume { noPyramidVolume }.mipLevelCount() == 0);
+
+    // The cache file is ignored once the source file changes.
+    writeDatFile("volvis_cache_test.dat", dim + glm::ivec3(1, 0, 0));
+    REQUIRE(!volume::Volume(file, config).cache());
+    std::filesystem::remove(volume::VolumeCache::cacheFile(file));
+
+    // If the cache file cannot be written next to the source file (here because a directory is in the way of its
+    // temporary file), it is written to the cache directory of the user instead.
+    auto blockedFile = volume::VolumeCache::cacheFile(file);
+    blockedFile += ".tmp";
+    std::filesystem::create_directory(blockedFile);
+    const volume::Volume fallbackVolume { file, config };
+    REQUIRE(volume::VolumeCache::write(file, fallbackVolume, volume::GradientVolume { fallbackVolume }));
+    REQUIRE(!std::filesystem::exists(volume::VolumeCache::cacheFile(file)));
+    REQUIRE(std::filesystem::exists(volume::VolumeCache::userCacheFile(file)));
+    const volume::Volume userCachedVolume { file, config };
+    REQUIRE(userCachedVolume.cache());
+    REQUIRE(userCachedVolume.getVoxel(dim.x, dim.y - 1, dim.z - 1) == fallbackVolume.getVoxel(dim.x, dim.y - 1, dim.z - 1));
+    std::filesystem::remove(blockedFile);
+    std::filesystem::remove(volume::VolumeCache::userCacheFile(file));
 }
 
 TEST_CASE("Gradient Volume Tests")
@@ -46,3 +875,637 @@ TEST_CASE("Gradient Volume Tests")
     const TestGradientVolume gradient { volume };
     REQUIRE_NOTHROW(gradient.test_getGradientLinearInterpolate(glm::vec3(100.f)));
 }
+
+TEST_CASE("Gradient Construction Tests")
+{
+    const glm::ivec3 dim { 37, 21, 19 };
+    const std::filesystem::path file = writeDatFile("volvis_gradient_test.dat", dim);
+    volume::LoadConfig config;
+    config.mipPyramid = volume::MipPyramid::Never;
+    config.useCacheFile = false;
+    const volume::Volume reference { file, config };
+
+    // Central differences computed through getVoxel, with zero gradients on the border.
+    auto expectedGradient = [&](int x, int y, int z) {
+        if (x < 1 || x >= dim.x - 1 || y < 1 || y >= dim.y - 1 || z < 1 || z >= dim.z - 1)
+            return glm::vec3(0.0f);
+        return glm::vec3(
+            (reference.getVoxel(x + 1, y, z) - reference.getVoxel(x - 1, y, z)) / 2.0f,
+            (reference.getVoxel(x, y + 1, z) - reference.getVoxel(x, y - 1, z)) / 2.0f,
+            (reference.getVoxel(x, y, z + 1) - reference.getVoxel(x, y, z - 1)) / 2.0f);
+    };
+    float maxMagnitude = 0.0f;
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++)
+                maxMagnitude = std::max(maxMagnitude, glm::length(expectedGradient(x, y, z)));
+        }
+    }
+
+    for (const auto layout : { volume::VoxelLayout::Linear, volume::VoxelLayout::Bricked, volume::VoxelLayout::Morton }) {
+        for (const bool outOfCore : { false, true }) {
+            config.layout = layout;
+            config.outOfCore = outOfCore;
+            const volume::Volume volume { file, config };
+            const volume::GradientVolume gradientVolume { volume };
+            REQUIRE(gradientVolume.minMagnitude() == 0.0f);
+            REQUIRE(gradientVolume.maxMagnitude() == Approx(maxMagnitude));
+            for (int z = 0; z < dim.z; z++) {
+                for (int y = 0; y < dim.y; y++) {
+                    for (int x = 0; x < dim.x; x++) {
+                        const volume::GradientVoxel gradient = gradientVolume.getGradient(x, y, z);
+                        REQUIRE(gradient.dir == expectedGradient(x, y, z));
+                        REQUIRE(gradient.magnitude == Approx(glm::length(gradient.dir)));
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Compact Gradient Tests")
+{
+    // Large enough for the compact gradients to be computed in several chunks.
+    const glm::ivec3 dim { 130, 100, 90 };
+    std::vector<float> data(size_t(dim.x) * size_t(dim.y) * size_t(dim.z));
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = float((i * 7919) % 251) + 3.0f * float(i % size_t(dim.x));
+
+    for (const auto layout : { volume::VoxelLayout::Linear, volume::VoxelLayout::Bricked }) {
+        const volume::Volume volume { data, dim, volume::LoadConfig { layout } };
+        const volume::GradientVolume full { volume };
+        // Worst case angular error of the octahedral encoding (about 1.2 degrees with 8 bits per coordinate).
+        for (const auto& [format, minCosine] : { std::pair { volume::GradientFormat::Octahedral8, 0.999f }, std::pair { volume::GradientFormat::Octahedral16, 0.999999f } }) {
+            volume::GradientVolume compact { volume, format };
+            REQUIRE(compact.format() == format);
+            REQUIRE(compact.data().empty());
+            REQUIRE(compact.minMagnitude() == full.minMagnitude());
+            REQUIRE(compact.maxMagnitude() == full.maxMagnitude());
+            const size_t compactSize = format == volume::GradientFormat::Octahedral8 ? 4 : 6;
+            REQUIRE(compact.byteSize() * 16 == full.byteSize() * compactSize);
+
+            // The magnitudes are quantized to 16 bits of the largest possible magnitude.
+            const float magnitudeError = std::sqrt(3.0f) / 2.0f * (volume.maximum() - volume.minimum()) / 65535.0f;
+            for (int z = 0; z < dim.z; z += 3) {
+                for (int y = 0; y < dim.y; y += 2) {
+                    for (int x = 0; x < dim.x; x++) {
+                        const volume::GradientVoxel expected = full.getGradient(x, y, z);
+                        const volume::GradientVoxel gradient = compact.getGradient(x, y, z);
+                        REQUIRE(std::abs(gradient.magnitude - expected.magnitude) <= magnitudeError);
+                        if (expected.magnitude == 0.0f)
+                            REQUIRE(gradient.dir == glm::vec3(0.0f));
+                        else
+                            REQUIRE(glm::dot(glm::normalize(gradient.dir), glm::normalize(expected.dir)) >= minCosine);
+                    }
+                }
+            }
+
+            compact.interpolationMode = volume::InterpolationMode::Linear;
+            const volume::GradientVoxel interpolated = compact.getGradientInterpolate(glm::vec3(40.3f, 20.6f, 30.5f));
+            REQUIRE(interpolated.magnitude > 0.0f);
+            REQUIRE(compact.getGradientInterpolate(glm::vec3(40.3f, 20.6f, 30.5f), 1).magnitude > 0.0f);
+        }
+    }
+}
+
+TEST_CASE("On-the-fly Gradient Tests")
+{
+    const glm::ivec3 dim { 40, 36, 32 };
+    std::vector<float> data(size_t(dim.x) * size_t(dim.y) * size_t(dim.z));
+    for (int z = 0; z < dim.z; z++)
+        for (int y = 0; y < dim.y; y++)
+            for (int x = 0; x < dim.x; x++)
+                data[size_t(x) + size_t(dim.x) * (size_t(y) + size_t(dim.y) * size_t(z))] = float(x * x) + 3.0f * float(y) - 2.0f * float(y * z);
+
+    volume::Volume volume { data, dim };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    volume::GradientVolume gradientVolume { volume };
+    gradientVolume.interpolationMode = volume::InterpolationMode::Linear;
+    const TestRenderer precomputed { &volume, &gradientVolume, nullptr, render::RenderConfig {} };
+    const TestRenderer estimated { &volume, nullptr, nullptr, render::RenderConfig {} };
+
+    // Central differences of the voxels at the voxel centers, like the gradient volume. Interpolation does not reach the
+    // last voxel of each axis, so neither can the estimate.
+    for (int z = 1; z < dim.z - 2; z += 3) {
+        for (int y = 1; y < dim.y - 2; y += 2) {
+            for (int x = 1; x < dim.x - 2; x++) {
+                const glm::vec3 pos { float(x), float(y), float(z) };
+                const volume::GradientVoxel expected = precomputed.test_getGradient(pos);
+                const volume::GradientVoxel gradient = estimated.test_getGradient(pos);
+                REQUIRE(gradient.dir.x == Approx(expected.dir.x).margin(1e-3f));
+                REQUIRE(gradient.dir.y == Approx(expected.dir.y).margin(1e-3f));
+                REQUIRE(gradient.dir.z == Approx(expected.dir.z).margin(1e-3f));
+                REQUIRE(gradient.magnitude == Approx(expected.magnitude).margin(1e-3f));
+            }
+        }
+    }
+
+    // Between the voxel centers the estimate follows the interpolated volume (exact for the linear terms).
+    const volume::GradientVoxel gradient = estimated.test_getGradient(glm::vec3(20.5f, 10.25f, 12.0f));
+    REQUIRE(gradient.dir.x == Approx(41.0f));
+    REQUIRE(gradient.dir.y == Approx(3.0f - 2.0f * 12.0f));
+    REQUIRE(gradient.dir.z == Approx(-2.0f * 10.25f));
+    REQUIRE(gradient.magnitude == Approx(glm::length(gradient.dir)));
+
+    // At the border, where the differences would read zero samples outside of the volume, the estimate is zero like
+    // the gradient volume on its border voxels.
+    for (const glm::vec3& pos : { glm::vec3(0.0f, 10.0f, 10.0f), glm::vec3(20.0f, 0.5f, 10.0f), glm::vec3(20.0f, 10.0f, float(dim.z - 2)), glm::vec3(float(dim.x - 1), 10.0f, 10.0f) }) {
+        REQUIRE(estimated.test_getGradient(pos).magnitude == 0.0f);
+        REQUIRE(estimated.test_getGradient(pos).dir == glm::vec3(0.0f));
+    }
+    REQUIRE(precomputed.test_getGradient(glm::vec3(0.0f, 10.0f, 10.0f)).magnitude == 0.0f);
+}
+
+TEST_CASE("Lazy Gradient Tests")
+{
+    const glm::ivec3 dim { 50, 40, 35 };
+    std::vector<float> data(size_t(dim.x) * size_t(dim.y) * size_t(dim.z));
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = float((i * 7919) % 251) + 3.0f * float(i % size_t(dim.x));
+
+    for (const auto layout : { volume::VoxelLayout::Linear, volume::VoxelLayout::Morton }) {
+        const volume::Volume volume { data, dim, volume::LoadConfig { layout } };
+        const volume::GradientVolume full { volume };
+        volume::GradientVolume lazy { volume, volume::GradientFormat::Lazy };
+        REQUIRE(lazy.format() == volume::GradientFormat::Lazy);
+        REQUIRE(lazy.layout() == volume::VoxelLayout::Bricked);
+        REQUIRE(lazy.mipLevelCount() == 0);
+        REQUIRE(lazy.materializedBrickCount() == 0);
+        REQUIRE(lazy.byteSize() == 0);
+
+        // Sampling a voxel computes its brick only.
+        REQUIRE(lazy.getGradient(20, 20, 20).magnitude == full.getGradient(20, 20, 20).magnitude);
+        REQUIRE(lazy.materializedBrickCount() == 1);
+        REQUIRE(lazy.byteSize() == volume::VoxelIndexer::storedBrickVoxels * sizeof(volume::GradientVoxel));
+
+        // The bricks are computed concurrently when the gradients are sampled from multiple threads.
+        int mismatches = 0;
+#pragma omp parallel for reduction(+ : mismatches)
+        for (int z = 0; z < dim.z; z++) {
+            for (int y = 0; y < dim.y; y++) {
+                for (int x = 0; x < dim.x; x++) {
+                    const volume::GradientVoxel expected = full.getGradient(x, y, z);
+                    const volume::GradientVoxel gradient = lazy.getGradient(x, y, z);
+                    if (gradient.dir != expected.dir || gradient.magnitude != expected.magnitude)
+                        mismatches++;
+                }
+            }
+        }
+        REQUIRE(mismatches == 0);
+        const size_t brickCount = 4 * 3 * 3;
+        REQUIRE(lazy.materializedBrickCount() == brickCount);
+        REQUIRE(lazy.minMagnitude() == 0.0f);
+        REQUIRE(lazy.maxMagnitude() >= full.maxMagnitude());
+
+        volume::GradientVolume fullLinear { volume };
+        fullLinear.interpolationMode = lazy.interpolationMode = volume::InterpolationMode::Linear;
+        for (const glm::vec3 coord : { glm::vec3(15.5f, 15.7f, 15.2f), glm::vec3(33.1f, 2.9f, 30.4f), glm::vec3(48.5f, 38.5f, 33.5f) }) {
+            const volume::GradientVoxel expected = fullLinear.getGradientInterpolate(coord);
+            const volume::GradientVoxel gradient = lazy.getGradientInterpolate(coord);
+            REQUIRE(gradient.magnitude == Approx(expected.magnitude));
+            REQUIRE(glm::length(gradient.dir - expected.dir) == Approx(0.0f).margin(1e-4f));
+        }
+
+        // Updating discards the computed bricks.
+        lazy.update(volume);
+        REQUIRE(lazy.materializedBrickCount() == 0);
+        REQUIRE(lazy.getGradient(49, 39, 34).magnitude == 0.0f);
+        REQUIRE(lazy.materializedBrickCount() == 1);
+    }
+}
+
+TEST_CASE("Gradient Interpolation Tests")
+{
+    std::array<volume::GradientVoxel, 8> corners;
+    for (size_t i = 0; i < corners.size(); i++) {
+        const float f = float(i);
+        corners[i] = { glm::vec3(f - 3.5f, 2.0f * f * f, 10.0f / (f + 1.0f)), 1.5f * f + 0.25f };
+    }
+
+    // The corners themselves are reproduced exactly.
+    for (int k = 0; k < 2; k++) {
+        for (int j = 0; j < 2; j++) {
+            for (int i = 0; i < 2; i++) {
+                const volume::GradientVoxel gradient = volume::interpolateCell(corners, glm::vec3(float(i), float(j), float(k)));
+                const volume::GradientVoxel& expected = corners[size_t(i + 2 * j + 4 * k)];
+                REQUIRE(gradient.dir == expected.dir);
+                REQUIRE(gradient.magnitude == expected.magnitude);
+            }
+        }
+    }
+
+    // Same as interpolating with linearInterpolate along x, then y and then z.
+    auto lerp = [](const volume::GradientVoxel& g0, const volume::GradientVoxel& g1, float t) { return TestGradientVolume::test_linearInterpolate(g0, g1, t); };
+    for (const glm::vec3 t : { glm::vec3(0.5f), glm::vec3(0.1f, 0.7f, 0.3f), glm::vec3(0.99f, 0.01f, 0.6f), glm::vec3(0.0f, 1.0f, 0.25f) }) {
+        const volume::GradientVoxel c0 = lerp(lerp(corners[0], corners[1], t.x), lerp(corners[2], corners[3], t.x), t.y);
+        const volume::GradientVoxel c1 = lerp(lerp(corners[4], corners[5], t.x), lerp(corners[6], corners[7], t.x), t.y);
+        const volume::GradientVoxel expected = lerp(c0, c1, t.z);
+        const volume::GradientVoxel gradient = volume::interpolateCell(corners, t);
+        REQUIRE(gradient.dir.x == Approx(expected.dir.x));
+        REQUIRE(gradient.dir.y == Approx(expected.dir.y));
+        REQUIRE(gradient.dir.z == Approx(expected.dir.z));
+        REQUIRE(gradient.magnitude == Approx(expected.magnitude));
+    }
+}
+
+TEST_CASE("Batched Sampling Tests")
+{
+    // Odd dimensions, so the batches do not line up with the rows, and positions that cover the borders of the volume.
+    const glm::ivec3 dim { 21, 13, 9 };
+    const size_t voxelCount = size_t(dim.x) * size_t(dim.y) * size_t(dim.z);
+    std::vector<glm::vec3> positions;
+    uint32_t seed = 4321;
+    auto random = [&](float minimum, float maximum) {
+        seed = seed * 1664525u + 1013904223u;
+        return minimum + (maximum - minimum) * float(seed >> 8) / float(1 << 24);
+    };
+    for (int i = 0; i < 1000; i++)
+        positions.emplace_back(random(-2.0f, float(dim.x) + 1.0f), random(-2.0f, float(dim.y) + 1.0f), random(-2.0f, float(dim.z) + 1.0f));
+    for (const glm::vec3 border : { glm::vec3(0.0f), glm::vec3(dim - 1), glm::vec3(dim) - 1.5f, glm::vec3(dim) - 0.5f, glm::vec3(dim) - 0.51f, glm::vec3(-0.5f), glm::vec3(-0.49f) })
+        positions.push_back(border);
+
+    std::vector<std::vector<std::byte>> voxels(3);
+    for (size_t i = 0; i < voxelCount; i++) {
+        // The last voxel is the largest one, so reading the voxels before it instead would be noticed.
+        const auto value = uint16_t(i == voxelCount - 1 ? 65535 : (i * 7919) % 60000);
+        const auto byteValue = uint8_t(i == voxelCount - 1 ? 255 : value % 250);
+        const auto floatValue = float(value) * 0.5f;
+        voxels[0].push_back(std::byte { byteValue });
+        voxels[1].insert(std::end(voxels[1]), reinterpret_cast<const std::byte*>(&value), reinterpret_cast<const std::byte*>(&value + 1));
+        voxels[2].insert(std::end(voxels[2]), reinterpret_cast<const std::byte*>(&floatValue), reinterpret_cast<const std::byte*>(&floatValue + 1));
+    }
+    const std::array voxelTypes { volume::VoxelType::UInt8, volume::VoxelType::UInt16, volume::VoxelType::Float };
+
+    std::vector<float> samples(positions.size());
+    std::vector<volume::GradientVoxel> gradients(positions.size());
+    for (size_t type = 0; type < voxelTypes.size(); type++) {
+        volume::Volume volume { dim, voxelTypes[type], voxels[type] };
+        volume::GradientVolume gradientVolume { volume };
+        for (const auto mode : { volume::InterpolationMode::NearestNeighbour, volume::InterpolationMode::Linear, volume::InterpolationMode::Cubic }) {
+            volume.interpolationMode = gradientVolume.interpolationMode = mode;
+            for (const auto simdLevel : { volume::SimdLevel::Scalar, volume::SimdLevel::AVX2, volume::SimdLevel::AVX512 }) {
+                // Batches of all sizes up to a few blocks, and the odd remainder.
+                for (const size_t count : { size_t(1), size_t(7), size_t(8), size_t(17), size_t(33), positions.size() }) {
+                    const gsl::span<const glm::vec3> batch { positions.data(), count };
+                    volume.sampleBatch(batch, gsl::span(samples.data(), count), simdLevel);
+                    gradientVolume.sampleBatch(batch, gsl::span(gradients.data(), count), simdLevel);
+                    for (size_t i = 0; i < count; i++) {
+                        REQUIRE(samples[i] == Approx(volume.getSampleInterpolate(positions[i])).margin(1e-3f));
+                        const volume::GradientVoxel expected = gradientVolume.getGradientInterpolate(positions[i]);
+                        REQUIRE(gradients[i].magnitude == Approx(expected.magnitude).margin(1e-3f));
+                        REQUIRE(glm::length(gradients[i].dir - expected.dir) <= 1e-5f * (1.0f + expected.magnitude));
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Fixed-Point Interpolation Tests")
+{
+    const glm::ivec3 dim { 21, 13, 9 };
+    const size_t voxelCount = size_t(dim.x) * size_t(dim.y) * size_t(dim.z);
+    std::vector<glm::vec3> positions;
+    uint32_t seed = 8765;
+    auto random = [&](float minimum, float maximum) {
+        seed = seed * 1664525u + 1013904223u;
+        return minimum + (maximum - minimum) * float(seed >> 8) / float(1 << 24);
+    };
+    for (int i = 0; i < 2000; i++)
+        positions.emplace_back(random(-1.0f, float(dim.x)), random(-1.0f, float(dim.y)), random(-1.0f, float(dim.z)));
+    for (const glm::vec3 border : { glm::vec3(0.0f), glm::vec3(dim - 2), glm::vec3(dim) - 1.0001f, glm::vec3(dim - 1), glm::vec3(-0.01f) })
+        positions.push_back(border);
+
+    // Neighbouring voxels that jump between the smallest and the largest value give the largest errors.
+    std::vector<std::byte> bytes, words;
+    for (size_t i = 0; i < voxelCount; i++) {
+        const auto value = uint16_t(i % 3 == 0 ? 65535 : uint32_t((i * 7919) % 65536) * uint32_t(i % 2));
+        bytes.push_back(std::byte { uint8_t(value >> 8) });
+        words.insert(std::end(words), reinterpret_cast<const std::byte*>(&value), reinterpret_cast<const std::byte*>(&value + 1));
+    }
+
+    std::vector<float> samples(positions.size());
+    std::vector<float> reference(positions.size());
+    for (const auto& [voxelType, pVoxels, tolerance] : { std::tuple { volume::VoxelType::UInt8, &bytes, 1.0f / 32.0f }, std::tuple { volume::VoxelType::UInt16, &words, 8.0f } }) {
+        volume::Volume volume { dim, voxelType, *pVoxels };
+        volume.interpolationMode = volume::InterpolationMode::Linear;
+
+        // Close to the floating point interpolation, and exact at the voxels.
+        for (size_t i = 0; i < positions.size(); i++) {
+            reference[i] = volume.getSampleTriLinearFixedPoint(positions[i]);
+            REQUIRE(reference[i] == Approx(volume.getSampleInterpolate(positions[i])).margin(tolerance));
+        }
+        for (int z = 0; z < dim.z - 1; z++)
+            for (int y = 0; y < dim.y - 1; y++)
+                for (int x = 0; x < dim.x - 1; x++)
+                    REQUIRE(volume.getSampleTriLinearFixedPoint(glm::vec3(float(x), float(y), float(z))) == volume.getVoxel(x, y, z));
+
+        // The SIMD kernels compute exactly the same samples.
+        for (const auto simdLevel : { volume::SimdLevel::Scalar, volume::SimdLevel::AVX2, volume::SimdLevel::AVX512 }) {
+            for (const size_t count : { size_t(1), size_t(9), positions.size() }) {
+                volume.sampleBatchFixedPoint(gsl::span(positions.data(), count), gsl::span(samples.data(), count), simdLevel);
+                for (size_t i = 0; i < count; i++)
+                    REQUIRE(samples[i] == reference[i]);
+            }
+        }
+
+        // The other interpolation modes are not affected.
+        volume.interpolationMode = volume::InterpolationMode::NearestNeighbour;
+        volume.sampleBatchFixedPoint(positions, samples);
+        for (size_t i = 0; i < positions.size(); i++)
+            REQUIRE(samples[i] == volume.getSampleInterpolate(positions[i]));
+    }
+
+    SECTION("Float volume")
+    {
+        std::vector<float> data(voxelCount);
+        for (size_t i = 0; i < voxelCount; i++)
+            data[i] = float((i * 7919) % 1000) * 0.25f;
+        volume::Volume volume { data, dim };
+        volume.interpolationMode = volume::InterpolationMode::Linear;
+        volume.sampleBatch(positions, reference);
+        volume.sampleBatchFixedPoint(positions, samples);
+        REQUIRE(samples == reference);
+    }
+
+    SECTION("MIP")
+    {
+        volume::Volume volume { dim, volume::VoxelType::UInt16, words };
+        volume.interpolationMode = volume::InterpolationMode::Linear;
+        volume::GradientVolume gradientVolume { volume };
+        const TestCamera camera { glm::vec3(dim) / 2.0f, glm::vec3(1.0f, 0.5f, 0.25f), 60.0f };
+        render::RenderConfig config {};
+        config.renderMode = render::RenderMode::RenderMIP;
+        config.renderResolution = glm::ivec2(24);
+        config.stepSize = 0.5f;
+        render::Renderer floatRenderer { &volume, &gradientVolume, &camera, config };
+        config.fixedPointInterpolation = true;
+        render::Renderer fixedPointRenderer { &volume, &gradientVolume, &camera, config };
+        floatRenderer.render();
+        fixedPointRenderer.render();
+        const auto expected = floatRenderer.frameBuffer();
+        const auto frameBuffer = fixedPointRenderer.frameBuffer();
+        REQUIRE(frameBuffer.size() == expected.size());
+        for (size_t i = 0; i < frameBuffer.size(); i++)
+            REQUIRE(frameBuffer[i].r == Approx(expected[i].r).margin(8.0f / volume.maximum()));
+    }
+}
+
+TEST_CASE("Ray Marcher Specialization Tests")
+{
+    const glm::ivec3 dim { 40, 36, 32 };
+    std::vector<float> data(size_t(dim.x) * size_t(dim.y) * size_t(dim.z));
+    for (int z = 0; z < dim.z; z++)
+        for (int y = 0; y < dim.y; y++)
+            for (int x = 0; x < dim.x; x++)
+                data[size_t(x) + size_t(dim.x) * (size_t(y) + size_t(dim.y) * size_t(z))] = 100.0f * std::sin(0.3f * float(x)) * std::cos(0.2f * float(y + z)) + 100.0f;
+
+    volume::Volume volume { data, dim };
+    volume::GradientVolume gradientVolume { volume };
+    const TestCamera camera { glm::vec3(dim) / 2.0f, glm::vec3(1.0f, 0.5f, 0.25f), 80.0f };
+
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(24);
+    config.isoValue = 150.0f;
+    config.bisection = true;
+    config.tfColorMapIndexStart = 0.0f;
+    config.tfColorMapIndexRange = 200.0f;
+    for (size_t i = 0; i < config.tfColorMap.size(); i++)
+        config.tfColorMap[i] = glm::vec4(float(i) / 255.0f, 0.5f, 0.5f, float(i) / 2550.0f);
+
+    // The specialized ray marchers render exactly what selecting the interpolation for every sample renders, both with
+    // the steps smaller than a voxel (sampled through volume::RaySampler) and with steps of a voxel.
+    for (const float stepSize : { 0.5f, 1.0f }) {
+        config.stepSize = stepSize;
+        for (const auto renderMode : { render::RenderMode::RenderMIP, render::RenderMode::RenderIso, render::RenderMode::RenderComposite }) {
+            for (const auto mode : { volume::InterpolationMode::NearestNeighbour, volume::InterpolationMode::Linear, volume::InterpolationMode::Cubic }) {
+                for (const bool shading : { false, true }) {
+                    for (const int lod : { 0, 1 }) {
+                        volume.interpolationMode = gradientVolume.interpolationMode = mode;
+                        config.renderMode = renderMode;
+                        config.volumeShading = shading;
+                        render::Renderer specialized { &volume, &gradientVolume, &camera, config };
+                        TestRenderer dynamic { &volume, &gradientVolume, &camera, config };
+                        dynamic.test_setDynamicSampling(true);
+                        specialized.setLevelOfDetail(lod);
+                        dynamic.setLevelOfDetail(lod);
+                        specialized.render();
+                        dynamic.render();
+                        const auto expected = dynamic.frameBuffer();
+                        const auto frameBuffer = specialized.frameBuffer();
+                        REQUIRE(frameBuffer.size() == expected.size());
+                        if (renderMode == render::RenderMode::RenderMIP && mode != volume::InterpolationMode::Cubic && lod == 0 && volume.vectorizesSampleBatch()) {
+                            // The batched MIP ray marcher interpolates with the SIMD kernels of Volume::sampleBatch, which
+                            // round differently.
+                            for (size_t i = 0; i < frameBuffer.size(); i++)
+                                REQUIRE(frameBuffer[i].r == Approx(expected[i].r).margin(1e-5f));
+                        } else {
+                            // Compared bitwise, as shading a zero gradient gives NaN colors.
+                            REQUIRE(std::memcmp(frameBuffer.data(), expected.data(), frameBuffer.size_bytes()) == 0);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Tricubic Interpolation Tests")
+{
+    // B-spline weights: positive, summing to 1, and the interpolation reproduces constant and linear data.
+    REQUIRE(TestVolume::test_weight(0.0f) == Approx(2.0f / 3.0f));
+    REQUIRE(TestVolume::test_weight(-1.0f) == Approx(1.0f / 6.0f));
+    REQUIRE(TestVolume::test_weight(2.0f) == 0.0f);
+    for (const float factor : { 0.0f, 0.2f, 0.5f, 0.9f }) {
+        REQUIRE(TestVolume::test_weight(factor + 1.0f) + TestVolume::test_weight(factor) + TestVolume::test_weight(1.0f - factor) + TestVolume::test_weight(2.0f - factor) == Approx(1.0f));
+        REQUIRE(TestVolume::test_cubicInterpolate(3.0f, 3.0f, 3.0f, 3.0f, factor) == Approx(3.0f));
+        REQUIRE(TestVolume::test_cubicInterpolate(1.0f, 3.0f, 5.0f, 7.0f, factor) == Approx(3.0f + 2.0f * factor));
+    }
+
+    const glm::ivec3 dim { 19, 23, 18 };
+    std::vector<float> data(size_t(dim.x) * size_t(dim.y) * size_t(dim.z));
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = float((i * 7919) % 251);
+    uint32_t seed = 1234;
+    auto random = [&](float maximum) {
+        seed = seed * 1664525u + 1013904223u;
+        return maximum * float(seed >> 8) / float(1 << 24);
+    };
+
+    // The 8 trilinear samples give the same result as the 64 voxels (bicubic per slice, then cubic along z), including
+    // at the borders where the voxels beyond the volume are replaced by the border voxels.
+    for (const auto layout : { volume::VoxelLayout::Linear, volume::VoxelLayout::Bricked, volume::VoxelLayout::Morton }) {
+        const TestVolume volume { data, dim, volume::LoadConfig { layout } };
+        std::vector<glm::vec3> positions { glm::vec3(0.0f), glm::vec3(dim) - 1.001f, glm::vec3(0.5f, float(dim.y) - 1.5f, 0.25f) };
+        for (int i = 0; i < 500; i++)
+            positions.emplace_back(random(float(dim.x - 1)), random(float(dim.y - 1)), random(float(dim.z - 1)));
+        for (const glm::vec3& pos : positions) {
+            const int z0 = int(pos.z);
+            const glm::vec2 xy { pos.x, pos.y };
+            const float expected = TestVolume::test_cubicInterpolate(
+                volume.test_biCubicInterpolate(xy, z0 - 1), volume.test_biCubicInterpolate(xy, z0), volume.test_biCubicInterpolate(xy, z0 + 1), volume.test_biCubicInterpolate(xy, z0 + 2), pos.z - float(z0));
+            REQUIRE(volume.test_getSampleTriCubicInterpolation(pos) == Approx(expected).margin(1e-3f));
+        }
+        REQUIRE(volume.test_getSampleTriCubicInterpolation(glm::vec3(-0.1f, 2.0f, 2.0f)) == 0.0f);
+        REQUIRE(volume.test_getSampleTriCubicInterpolation(glm::vec3(2.0f, 2.0f, float(dim.z - 1))) == 0.0f);
+    }
+
+    // Away from the borders linear data is reproduced exactly, so the result equals trilinear interpolation.
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = 2.0f * float(i % size_t(dim.x)) + 0.5f * float(i / size_t(dim.x));
+    const TestVolume linear { data, dim };
+    for (int i = 0; i < 200; i++) {
+        const glm::vec3 pos = 1.0f + glm::vec3(random(float(dim.x - 4)), random(float(dim.y - 4)), random(float(dim.z - 4)));
+        REQUIRE(linear.test_getSampleTriCubicInterpolation(pos) == Approx(linear.test_getSampleTriLinearInterpolation(pos)));
+    }
+}
+
+TEST_CASE("Ray Sampler Tests")
+{
+    // Rays that start outside of the volume, cross it (through the borders) and take steps both smaller and larger
+    // than a voxel, such that consecutive samples land in the same cell, in a neighbouring cell and in a distant one.
+    const glm::ivec3 dim { 33, 19, 14 };
+    const size_t voxelCount = size_t(dim.x) * size_t(dim.y) * size_t(dim.z);
+    std::vector<float> data(voxelCount);
+    for (size_t i = 0; i < voxelCount; i++)
+        data[i] = float((i * 7919) % 251);
+    uint32_t seed = 2468;
+    auto random = [&](float minimum, float maximum) {
+        seed = seed * 1664525u + 1013904223u;
+        return minimum + (maximum - minimum) * float(seed >> 8) / float(1 << 24);
+    };
+    std::vector<std::vector<glm::vec3>> rays;
+    for (const float stepSize : { 0.1f, 0.5f, 1.0f, 3.0f }) {
+        for (int i = 0; i < 20; i++) {
+            const glm::vec3 origin { random(-2.0f, 0.0f), random(-2.0f, float(dim.y) + 1.0f), random(-2.0f, float(dim.z) + 1.0f) };
+            const glm::vec3 direction = glm::normalize(glm::vec3(1.0f, random(-0.5f, 0.5f), random(-0.5f, 0.5f)));
+            std::vector<glm::vec3> ray;
+            for (float t = 0.0f; t < float(dim.x) + 4.0f; t += stepSize)
+                ray.push_back(origin + t * direction);
+            rays.push_back(std::move(ray));
+        }
+    }
+
+    // The sampler returns exactly the samples of Volume::getSampleInterpolate, for every layout, level and mode.
+    auto requireSameSamples = [&](volume::Volume& volume, int maxLod) {
+        for (const auto mode : { volume::InterpolationMode::NearestNeighbour, volume::InterpolationMode::Linear, volume::InterpolationMode::Cubic }) {
+            volume.interpolationMode = mode;
+            for (int lod = 0; lod <= maxLod; lod++) {
+                for (const auto& ray : rays) {
+                    volume::RaySampler sampler { volume, lod };
+                    for (const glm::vec3& pos : ray)
+                        REQUIRE(sampler.sample(pos) == volume.getSampleInterpolate(pos, lod));
+                }
+            }
+        }
+    };
+    for (const auto layout : { volume::VoxelLayout::Linear, volume::VoxelLayout::Bricked, volume::VoxelLayout::Morton }) {
+        volume::Volume volume { data, dim, volume::LoadConfig { layout } };
+        requireSameSamples(volume, 2);
+    }
+    for (const auto voxelType : { volume::VoxelType::UInt8, volume::VoxelType::UInt16 }) {
+        std::vector<std::byte> voxels;
+        for (size_t i = 0; i < voxelCount; i++) {
+            const auto value = uint16_t(data[i]);
+            if (voxelType == volume::VoxelType::UInt8)
+                voxels.push_back(std::byte { uint8_t(value) });
+            else
+                voxels.insert(std::end(voxels), reinterpret_cast<const std::byte*>(&value), reinterpret_cast<const std::byte*>(&value + 1));
+        }
+        volume::Volume volume { dim, voxelType, voxels };
+        requireSameSamples(volume, 0);
+    }
+}
+
+TEST_CASE("Empty Space Skipping Tests")
+{
+    // Two spheres in an otherwise empty volume, so that most bricks can be skipped for most iso values.
+    const glm::ivec3 dim { 45, 38, 33 };
+    std::vector<float> data(size_t(dim.x) * size_t(dim.y) * size_t(dim.z));
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++) {
+                const glm::vec3 p { float(x), float(y), float(z) };
+                const float sphere0 = 200.0f - 40.0f * glm::length(p - glm::vec3(12.0f, 10.0f, 9.0f));
+                const float sphere1 = 120.0f - 20.0f * glm::length(p - glm::vec3(33.0f, 27.0f, 22.0f));
+                data[size_t(x) + size_t(dim.x) * (size_t(y) + size_t(dim.y) * size_t(z))] = std::max(0.0f, std::max(sphere0, sphere1));
+            }
+        }
+    }
+    uint32_t seed = 24680;
+    auto random = [&](float minimum, float maximum) {
+        seed = seed * 1664525u + 1013904223u;
+        return minimum + (maximum - minimum) * float(seed >> 8) / float(1 << 24);
+    };
+
+    // The range of a brick bounds the samples at all positions inside of it, in every interpolation mode and on every
+    // level.
+    volume::Volume volume { data, dim };
+    for (const int lod : { 0, 1 }) {
+        const volume::Volume& level = volume.mipLevel(lod);
+        const volume::MinMaxGrid grid { level };
+        REQUIRE(grid.dims() == (level.dims() + volume::MinMaxGrid::brickSize - 1) / volume::MinMaxGrid::brickSize);
+        for (int i = 0; i < 20000; i++) {
+            const glm::vec3 pos { random(-1.0f, float(level.dims().x)), random(-1.0f, float(level.dims().y)), random(-1.0f, float(level.dims().z)) };
+            const glm::ivec3 brick { glm::floor(pos / float(volume::MinMaxGrid::brickSize)) };
+            if (brick.x < 0 || brick.y < 0 || brick.z < 0 || brick.x >= grid.dims().x || brick.y >= grid.dims().y || brick.z >= grid.dims().z)
+                continue;
+            const volume::ValueRange& range = grid.range(brick);
+            for (const float value : { level.getSampleInterpolate<volume::InterpolationMode::NearestNeighbour>(pos, 0),
+                     level.getSampleInterpolate<volume::InterpolationMode::Linear>(pos, 0),
+                     level.getSampleInterpolate<volume::InterpolationMode::Cubic>(pos, 0) }) {
+                REQUIRE(value >= range.minimum);
+                REQUIRE(value <= range.maximum);
+            }
+        }
+    }
+
+    // Skipping the empty space does not change the image.
+    render::RenderConfig config {};
+    config.renderMode = render::RenderMode::RenderIso;
+    config.renderResolution = glm::ivec2(32);
+    config.stepSize = 0.5f;
+    config.bisection = true;
+    volume::GradientVolume gradientVolume { volume };
+    for (const glm::vec3 forward : { glm::vec3(1.0f, 0.5f, 0.25f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(-0.3f, -1.0f, 0.6f) }) {
+        const TestCamera camera { glm::vec3(dim) / 2.0f, forward, 70.0f };
+        for (const auto mode : { volume::InterpolationMode::NearestNeighbour, volume::InterpolationMode::Linear, volume::InterpolationMode::Cubic }) {
+            for (const float isoValue : { 10.0f, 100.0f, 150.0f, 500.0f }) {
+                for (const int lod : { 0, 1 }) {
+                    volume.interpolationMode = gradientVolume.interpolationMode = mode;
+                    config.isoValue = isoValue;
+                    config.volumeShading = lod == 0;
+                    config.emptySpaceSkipping = true;
+                    TestRenderer skipping { &volume, &gradientVolume, &camera, config };
+                    config.emptySpaceSkipping = false;
+                    render::Renderer marching { &volume, &gradientVolume, &camera, config };
+                    skipping.setLevelOfDetail(lod);
+                    marching.setLevelOfDetail(lod);
+                    skipping.render();
+                    marching.render();
+                    REQUIRE(skipping.test_minMaxGrid() != nullptr);
+                    const auto expected = marching.frameBuffer();
+                    const auto frameBuffer = skipping.frameBuffer();
+                    REQUIRE(frameBuffer.size() == expected.size());
+                    REQUIRE(std::memcmp(frameBuffer.data(), expected.data(), frameBuffer.size_bytes()) == 0);
+                }
+            }
+        }
+    }
+
+    // The grid is built once: changing the iso value keeps it, a new volume replaces it.
+    const TestCamera camera { glm::vec3(dim) / 2.0f, glm::vec3(1.0f, 0.5f, 0.25f), 70.0f };
+    config.emptySpaceSkipping = true;
+    config.isoValue = 100.0f;
+    TestRenderer renderer { &volume, nullptr, &camera, config };
+    REQUIRE(renderer.test_minMaxGrid() == nullptr);
+    renderer.render();
+    const volume::MinMaxGrid* pMinMaxGrid = renderer.test_minMaxGrid();
+    REQUIRE(pMinMaxGrid != nullptr);
+    config.isoValue = 60.0f;
+    renderer.setConfig(config);
+    renderer.render();
+    REQUIRE(renderer.test_minMaxGrid() == pMinMaxGrid);
+    renderer.setVolume(&volume, nullptr);
+    REQUIRE(renderer.test_minMaxGrid() == nullptr);
+}
@@ -14,13 +14,18 @@
 #include "ui/wireframe_cube.h"
 #include "volume/gradient_volume.h"
 #include "volume/volume.h"
+#include "volume/volume_loader.h"
+#include "volume/volume_sequence.h"
 #include <chrono>
 #include <cmath> // log2
+#include <exception>
+#include <future>
 #include <glm/geometric.hpp>
 #include <glm/gtx/component_wise.hpp>
 #include <glm/vec3.hpp>
 #include <imgui.h>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <ratio>
 #include <vector>
@@ -32,6 +37,8 @@ int main(int argc, char** argv)
     glm::ivec2 viewportSize { 720, 720 };
     glm::ivec2 windowSize { viewportSize.x + menuWidth, viewportSize.y };
     constexpr float frameTimeTarget = 1.0f / 60.0f; // Target 60 fps.
+    // Level of the mip pyramid that is rendered while the user interacts (see Renderer::setLevelOfDetail).
+    constexpr int interactionLod = 1;
 
     // === VIEWER ===
     ui::Window myWindow { "VolVis Viewer", windowSize };
@@ -45,12 +52,18 @@ int main(int argc, char** argv)
     ui::Trackball trackballCamera { &myWindow, glm::radians(60.0f), aspectRatio };
 
     // Render instance contains everything you need to render (volume + renderer). Initially there is
-    // nothing to render hence the optional (initially it is empty). The optional is passed to the menu
-    // class which is responsible for creating the volume + renderer when the user loads a volume.
-    std::optional<volume::Volume> optVolume;
-    std::optional<volume::GradientVolume> optGradientVolume;
+    // nothing to render hence the empty pointers/optional. Volumes are loaded in the background by the
+    // volume loader; once a load has finished the new volume is swapped in at the start of a frame. The
+    // volumes are heap allocated because the renderer keeps pointers to them.
+    std::unique_ptr<volume::Volume> pVolume;
+    std::unique_ptr<volume::GradientVolume> pGradientVolume;
     std::optional<render::Renderer> optRenderer;
+    volume::VolumeLoader volumeLoader;
     ui::Menu volVisMenu { viewportSize };
+    // A time-varying sequence replaces pVolume/pGradientVolume; the renderer then points at its current timestep.
+    // Sequences are created on a separate thread because they read (and with delta bricks, encode) their files.
+    std::unique_ptr<volume::VolumeSequence> pSequence;
+    std::future<std::unique_ptr<volume::VolumeSequence>> sequenceFuture;
 
     // Whether to redraw because the user interacted with the application. When this is the reason for the
     // redraw then dynamic resolution scaling is enabled. After the user interaction, one more render is
@@ -58,23 +71,51 @@ int main(int argc, char** argv)
     bool redrawUserInteraction = false;
     bool redrawFullResolution = true;
     auto loadVolume = [&](const std::filesystem::path& filePath) {
-        optVolume.emplace(filePath.string());
-        optVolume->interpolationMode = volVisMenu.interpolationMode();
-        optGradientVolume.emplace(optVolume.value());
-        optRenderer.emplace(&optVolume.value(), &optGradientVolume.value(), &trackballCamera, volVisMenu.renderConfig());
-
-        const float maxDimension = float(glm::compMax(optVolume->dims()));
+        volumeLoader.load(filePath, volVisMenu.loadConfig());
+    };
+    auto loadSequence = [&](const std::filesystem::path& filePath) {
+        sequenceFuture = std::async(std::launch::async,
+            [files = volume::VolumeSequence::findSeries(filePath), config = volVisMenu.sequenceConfig()]() {
+                return std::make_unique<volume::VolumeSequence>(files, config);
+            });
+    };
+    auto showVolume = [&](const volume::Volume& volume, const volume::GradientVolume* pGradientVolume) {
+        const float maxDimension = float(glm::compMax(volume.dims()));
         trackballCamera.setDistance(maxDimension);
         trackballCamera.setWorldScale(maxDimension);
-        trackballCamera.setLookAt(glm::vec3(optVolume->dims()) / 2.0f);
+        trackballCamera.setLookAt(glm::vec3(volume.dims()) / 2.0f);
 
-        volVisMenu.setLoadedVolume(optVolume.value(), optGradientVolume.value());
+        volVisMenu.setLoadedVolume(volume, pGradientVolume);
 
         redrawUserInteraction = true;
     };
+    auto swapInLoadedVolume = [&](volume::VolumeLoader::Result&& loadedVolume) {
+        loadedVolume.pVolume->interpolationMode = volVisMenu.interpolationMode();
+        if (loadedVolume.pGradientVolume)
+            loadedVolume.pGradientVolume->interpolationMode = volVisMenu.interpolationMode();
+        // Replace the renderer before the volumes that the old renderer points to are destroyed.
+        optRenderer.emplace(loadedVolume.pVolume.get(), loadedVolume.pGradientVolume.get(), &trackballCamera, volVisMenu.renderConfig());
+        pVolume = std::move(loadedVolume.pVolume);
+        pGradientVolume = std::move(loadedVolume.pGradientVolume);
+        volVisMenu.setLoadedSequence(nullptr);
+        pSequence.reset();
+        showVolume(*pVolume, pGradientVolume.get());
+    };
+    auto swapInSequence = [&](std::unique_ptr<volume::VolumeSequence> pLoadedSequence) {
+        pLoadedSequence->setInterpolationMode(volVisMenu.interpolationMode());
+        optRenderer.emplace(&pLoadedSequence->volume(), &pLoadedSequence->gradientVolume(), &trackballCamera, volVisMenu.renderConfig());
+        pSequence = std::move(pLoadedSequence);
+        pVolume.reset();
+        pGradientVolume.reset();
+        volVisMenu.setLoadedSequence(pSequence.get());
+        showVolume(pSequence->volume(), &pSequence->gradientVolume());
+        pSequence->play();
+    };
 
     // Callbacks.
     volVisMenu.setLoadVolumeCallback(loadVolume);
+    volVisMenu.setCancelLoadCallback([&]() { volumeLoader.cancel(); });
+    volVisMenu.setLoadSequenceCallback(loadSequence);
     volVisMenu.setRenderConfigChangedCallback(
         [&](const render::RenderConfig& renderConfig) {
             if (optRenderer)
@@ -83,10 +124,13 @@ int main(int argc, char** argv)
         });
     volVisMenu.setInterpolationModeChangedCallback(
         [&](volume::InterpolationMode interpolationMode) {
-            if (optVolume) {
-                optVolume->interpolationMode = interpolationMode;
-                optGradientVolume->interpolationMode = interpolationMode;
+            if (pVolume) {
+                pVolume->interpolationMode = interpolationMode;
+                if (pGradientVolume)
+                    pGradientVolume->interpolationMode = interpolationMode;
             }
+            if (pSequence)
+                pSequence->setInterpolationMode(interpolationMode);
             redrawUserInteraction = true;
         });
     myWindow.registerWindowResizeCallback(
@@ -109,8 +153,29 @@ int main(int argc, char** argv)
     // The dynamic resolution scale that was used in previous frame (to keep the frame time below the target).
     int prevResolutionScale = 1;
     std::chrono::duration<double> renderTime { 0 };
+    auto prevFrameStart = std::chrono::steady_clock::now();
     while (!myWindow.shouldClose()) {
         myWindow.updateInput();
+        const auto frameStart = std::chrono::steady_clock::now();
+        const std::chrono::duration<double> frameTime = frameStart - prevFrameStart;
+        prevFrameStart = frameStart;
+
+        // Swap in the volume that was loaded in the background (if it has finished loading).
+        if (auto optLoadedVolume = volumeLoader.takeResult())
+            swapInLoadedVolume(std::move(*optLoadedVolume));
+        volVisMenu.setLoadProgress(volumeLoader.progress());
+        if (sequenceFuture.valid() && sequenceFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            try {
+                swapInSequence(sequenceFuture.get());
+            } catch (const std::exception&) {
+                std::cerr << "Failed to load the volume sequence" << std::endl;
+            }
+        }
+        // Show the next timestep of the sequence once it is time (and once it has been decoded).
+        if (pSequence && pSequence->update(frameTime)) {
+            optRenderer->setVolume(&pSequence->volume(), &pSequence->gradientVolume());
+            redrawUserInteraction = true;
+        }
 
         if (optRenderer.has_value()) {
             // If camera changed in any way then we need to redraw.
@@ -143,11 +208,13 @@ int main(int argc, char** argv)
                     //  the associated callback. Make sure that you don't read redrawUserInteraction after
                     //  this call because it will always be true.
                     volVisMenu.setBaseRenderResolution(baseRenderResolution / resolutionScale);
+                    optRenderer->setLevelOfDetail(interactionLod);
                     redrawFullResolution = true;
                     prevResolutionScale = resolutionScale;
                 } else {
                     prevResolutionScale = 1;
                     volVisMenu.setBaseRenderResolution(baseRenderResolution);
+                    optRenderer->setLevelOfDetail(0);
                     redrawFullResolution = false;
                 }
                 redrawUserInteraction = false;
@@ -165,8 +232,9 @@ int main(int argc, char** argv)
 
             // Make the wireframe slightly larger than the volume to prevent z-fighting
             constexpr float wireframeMargin = 0.05f;
-            const auto wireframeCubeSize = glm::vec3(optVolume->dims()) * (1.0f + wireframeMargin);
-            const auto wireframeCubeOffset = -glm::vec3(optVolume->dims()) * wireframeMargin * 0.5f;
+            const glm::ivec3 volumeDims = pSequence ? pSequence->volume().dims() : pVolume->dims();
+            const auto wireframeCubeSize = glm::vec3(volumeDims) * (1.0f + wireframeMargin);
+            const auto wireframeCubeOffset = -glm::vec3(volumeDims) * wireframeMargin * 0.5f;
             constexpr glm::vec3 wireframeColor { 1.0f };
 
             // Draw on the left side of the screen next to the menu.
@@ -183,7 +251,7 @@ int main(int argc, char** argv)
             glDepthMask(GL_TRUE);
             glDepthFunc(GL_LEQUAL);
             glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-            surfaceCube.draw(trackballCamera, optVolume->dims());
+            surfaceCube.draw(trackballCamera, volumeDims);
 
             // Enable color writes and depth blending.
             glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
@@ -21,6 +21,12 @@ struct RenderConfig {
     bool volumeShading { false };
     float isoValue { 95.0f };
     bool bisection { false };
+    // Skip the parts of the rays of the iso surface renderer that pass bricks of the volume whose values all lie below
+    // the iso value (see volume::MinMaxGrid). This does not change the image.
+    bool emptySpaceSkipping { true };
+    // Interpolate uint8 and uint16 volumes linearly in fixed point (see volume::Volume::getSampleTriLinearFixedPoint) in
+    // the MIP renderer when it samples in batches. Slightly less accurate than floating point.
+    bool fixedPointInterpolation { false };
 
     // 1D transfer function.
     std::array<glm::vec4, 256> tfColorMap;
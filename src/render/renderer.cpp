@@ -1,11 +1,15 @@
 #include "renderer.h"
 #include <algorithm>
 #include <algorithm> // std::fill
+#include <array>
 #include <cmath>
+#include <exception>
 #include <functional>
 #include <glm/common.hpp>
 #include <glm/gtx/component_wise.hpp>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <tuple>
 
 namespace render {
@@ -36,6 +40,21 @@ void Renderer::setConfig(const RenderConfig& config)
     m_config = config;
 }
 
+void Renderer::setVolume(const volume::Volume* pVolume, const volume::GradientVolume* pGradientVolume)
+{
+    m_pVolume = pVolume;
+    m_pGradientVolume = pGradientVolume;
+    m_lod = std::min(m_lod, m_pVolume->mipLevelCount());
+    // The grids are built again for the new volume, also if it is the same volume with new voxels (see
+    // volume::Volume::readVoxels).
+    m_minMaxGrids.clear();
+}
+
+void Renderer::setLevelOfDetail(int lod)
+{
+    m_lod = std::clamp(lod, 0, m_pVolume->mipLevelCount());
+}
+
 // Resize the framebuffer and fill it with black pixels.
 void Renderer::resizeImage(const glm::ivec2& resolution)
 {
@@ -64,6 +83,18 @@ void Renderer::render()
     const glm::vec3 planeNormal = -glm::normalize(m_pCamera->forward());
     const glm::vec3 volumeCenter = glm::vec3(m_pVolume->dims()) / 2.0f;
     const Bounds bounds {glm::vec3(0.0f),  glm::vec3(m_pVolume->dims() - glm::ivec3(1))};
+    // A voxel of level m_lod of the mip pyramid spans 2^m_lod voxels, so the step size grows accordingly.
+    const float stepSize = m_config.stepSize * float(1 << m_lod);
+    // The ray marcher is selected once for all pixels instead of for every pixel (and its sample kernel instead of for
+    // every sample), see selectTraceFunction.
+    const TraceFunction traceRay = m_config.renderMode == RenderMode::RenderSlicer ? nullptr : selectTraceFunction(m_config.renderMode);
+    // The min-max grid does not depend on the iso value, so it is only built once for every level.
+    if (m_config.renderMode == RenderMode::RenderIso && m_config.emptySpaceSkipping) {
+        if (m_minMaxGrids.size() <= size_t(m_lod))
+            m_minMaxGrids.resize(size_t(m_lod) + 1);
+        if (!m_minMaxGrids[size_t(m_lod)])
+            m_minMaxGrids[size_t(m_lod)] = std::make_unique<volume::MinMaxGrid>(m_pVolume->mipLevel(m_lod));
+    }
 
     // 0 = sequential (single-core), 1 = OMP (multi-core)
 #ifdef NDEBUG
@@ -74,11 +105,18 @@ void Renderer::render()
 #define PARALLELISM 0
 #endif
 
+    // The pixels are rendered in tiles, so the rays that a thread traces one after the other go through the same bricks
+    // (a column of pixels goes through a whole slab of the volume, more than the decoded bricks of CompressedBricks).
+    constexpr int tileSize = 8;
+    const glm::ivec2 tileCount = (m_config.renderResolution + tileSize - 1) / tileSize;
 #if PARALLELISM == 1
     #pragma omp parallel for
 #endif
-    for (int x = 0; x < m_config.renderResolution.x; x++) {
-        for (int y = 0; y < m_config.renderResolution.y; y++) {
+    for (int tile = 0; tile < tileCount.x * tileCount.y; tile++) {
+        const glm::ivec2 tileBegin = tileSize * glm::ivec2(tile % tileCount.x, tile / tileCount.x);
+        const glm::ivec2 tileEnd = glm::min(tileBegin + tileSize, m_config.renderResolution);
+        for (int x = tileBegin.x; x < tileEnd.x; x++) {
+        for (int y = tileBegin.y; y < tileEnd.y; y++) {
 
             // Compute a ray for the current pixel.
             const glm::vec2 pixelPos = glm::vec2(x, y) / glm::vec2(m_config.renderResolution);
@@ -91,28 +129,15 @@ void Renderer::render()
 
             // Get a color for the current pixel according to the current render mode.
             glm::vec4 color {};
-            switch (m_config.renderMode) {
-            case RenderMode::RenderSlicer: {
+            if (m_config.renderMode == RenderMode::RenderSlicer)
                 color = traceRaySlice(ray, volumeCenter, planeNormal);
-                break;
-            }
-            case RenderMode::RenderMIP: {
-                color = traceRayMIP(ray, m_config.stepSize);
-                break;
-            }
-            case RenderMode::RenderComposite: {
-                color = traceRayComposite(ray, m_config.stepSize);
-                break;
-            }
-            case RenderMode::RenderIso: {
-                color = traceRayISO(ray, m_config.stepSize);
-                break;
-            }
-            };
+            else
+                color = (this->*traceRay)(ray, stepSize);
             // Write the resulting color to the screen.
             fillColor(x, y, color);
 
         }
+        }
     }
 }
 
@@ -148,6 +173,62 @@ glm::vec4 Renderer::traceRayMIP(const Ray& ray, float stepSize) const
     return glm::vec4(glm::vec3(maxVal) / m_pVolume->maximum(), 1.0f);
 }
 
+// traceRayMIP, specialized for how the volume is sampled, which samples level m_lod of the mip pyramid (render() uses
+// these rather than the function above).
+template <Renderer::Sampling sampling, typename Sampler>
+glm::vec4 Renderer::traceRayMIP(const Ray& ray, float stepSize) const
+{
+    float maxVal = 0.0f;
+
+    Sampler sampler { *m_pVolume, m_lod };
+    glm::vec3 samplePos = ray.origin + ray.tmin * ray.direction;
+    const glm::vec3 increment = stepSize * ray.direction;
+    for (float t = ray.tmin; t <= ray.tmax; t += stepSize, samplePos += increment) {
+        const float val = getSample<sampling>(sampler, samplePos);
+        maxVal = std::max(val, maxVal);
+    }
+
+    return glm::vec4(glm::vec3(maxVal) / m_pVolume->maximum(), 1.0f);
+}
+
+// traceRayMIP that samples the volume (at full resolution) in packets of positions along the ray, each with a single
+// call to Volume::sampleBatch, whose SIMD kernels sample 8 or 16 of the positions at once. The positions are the same as
+// those of the other MIP ray marchers. With fixedPoint set the linear mode interpolates in fixed point (see
+// Volume::sampleBatchFixedPoint).
+template <bool fixedPoint>
+glm::vec4 Renderer::traceRayMIPBatched(const Ray& ray, float stepSize) const
+{
+    constexpr size_t packetSize = 64;
+    std::array<glm::vec3, packetSize> positions;
+    std::array<float, packetSize> samples;
+    size_t count = 0;
+    float maxVal = 0.0f;
+    auto samplePacket = [&]() {
+        if constexpr (fixedPoint)
+            m_pVolume->sampleBatchFixedPoint(gsl::span(positions.data(), count), gsl::span(samples.data(), count));
+        else
+            m_pVolume->sampleBatch(gsl::span(positions.data(), count), gsl::span(samples.data(), count));
+        for (size_t i = 0; i < count; i++)
+            maxVal = std::max(samples[i], maxVal);
+        count = 0;
+    };
+
+    glm::vec3 samplePos = ray.origin + ray.tmin * ray.direction;
+    const glm::vec3 increment = stepSize * ray.direction;
+    for (float t = ray.tmin; t <= ray.tmax; t += stepSize, samplePos += increment) {
+        positions[count++] = samplePos;
+        if (count == packetSize)
+            samplePacket();
+    }
+    if (count > 0)
+        samplePacket();
+
+    return glm::vec4(glm::vec3(maxVal) / m_pVolume->maximum(), 1.0f);
+}
+
+template glm::vec4 Renderer::traceRayMIPBatched<false>(const Ray&, float) const;
+template glm::vec4 Renderer::traceRayMIPBatched<true>(const Ray&, float) const;
+
 // ======= TODO: IMPLEMENT ========
 // This function should find the position where the ray intersects with the volume's isosurface.
 // If volume shading is DISABLED then simply return the isoColor.
@@ -155,21 +236,53 @@ glm::vec4 Renderer::traceRayMIP(const Ray& ray, float stepSize) const
 //   Use the camera position (m_pCamera->position()) as the light position.
 // Use the bisectionAccuracy function (to be implemented) to get a more precise isosurface location between two steps.
 glm::vec4 Renderer::traceRayISO(const Ray& ray, float stepSize) const
+{
+    if (m_config.volumeShading)
+        return traceRayISO<Sampling::Dynamic, volume::VolumeSampler, true>(ray, stepSize);
+    return traceRayISO<Sampling::Dynamic, volume::VolumeSampler, false>(ray, stepSize);
+}
+
+template <Renderer::Sampling sampling, typename Sampler, bool shading>
+glm::vec4 Renderer::traceRayISO(const Ray& ray, float stepSize) const
 {
     static constexpr glm::vec3 isoColor { 0.8f, 0.8f, 0.2f };
     float isoValue = m_config.isoValue;
-    for (float t = ray.tmin; t < ray.tmax; t += stepSize) {
+    Sampler sampler { *m_pVolume, m_lod };
+    // The samples in bricks whose values all lie below the iso value are skipped. The remaining samples are taken at
+    // the same distances as without skipping (sample i at ray.tmin + i * stepSize), so the image does not change.
+    std::optional<volume::BrickTraversal> optTraversal;
+    if (const volume::MinMaxGrid* pMinMaxGrid = minMaxGrid()) {
+        // The grid is in voxels of the rendered level (see volume::Volume::getSampleInterpolate(coord, lod)).
+        const float scale = float(1 << m_lod);
+        optTraversal.emplace(*pMinMaxGrid, (ray.origin + 0.5f) / scale - 0.5f, ray.direction / scale, ray.tmin);
+    }
+    auto sampleDistance = [&](int i) { return ray.tmin + float(i) * stepSize; };
+    for (int i = 0;; i++) {
+        float t = sampleDistance(i);
+        if (optTraversal) {
+            // Jump to the first sample at or after next. The division may round either way, so the index that it gives
+            // is corrected with the distances of the samples themselves.
+            const float next = std::min(optTraversal->skipBelow(t, isoValue), ray.tmax);
+            if (t < next) {
+                i = std::max(i, static_cast<int>((next - ray.tmin) / stepSize) - 1);
+                while (sampleDistance(i) < next)
+                    i++;
+                t = sampleDistance(i);
+            }
+        }
+        if (t >= ray.tmax)
+            break;
         const glm::vec3 samplePos = ray.origin + t * ray.direction;
-        const float val = m_pVolume->getSampleInterpolate(samplePos);
+        const float val = getSample<sampling>(sampler, samplePos);
         if (val > isoValue) {
             const float t0 = t - stepSize;
             const float t1 = t;
             if (m_config.bisection) {
-                t = bisectionAccuracy(ray, t0, t1, isoValue);
+                t = bisectionAccuracy<sampling>(sampler, ray, t0, t1, isoValue);
             }
             const glm::vec3 isoPos = ray.origin + t * ray.direction;
-            if (m_config.volumeShading) {
-                const volume::GradientVoxel gradient = m_pGradientVolume->getGradientInterpolate(isoPos);
+            if constexpr (shading) {
+                const volume::GradientVoxel gradient = getGradient(isoPos);
                 const glm::vec3 L = glm::normalize(m_pCamera->position() - isoPos);
                 const glm::vec3 V = glm::normalize(ray.direction);
                 return glm::vec4(computePhongShading(isoColor, gradient, L, V), 1.0f);
@@ -185,12 +298,19 @@ glm::vec4 Renderer::traceRayISO(const Ray& ray, float stepSize) const
 // closely matches the iso value (less than 0.01 difference). Add a limit to the number of
 // iterations such that it does not get stuck in degerate cases.
 float Renderer::bisectionAccuracy(const Ray& ray, float t0, float t1, float isoValue) const
+{
+    volume::VolumeSampler sampler { *m_pVolume, m_lod };
+    return bisectionAccuracy<Sampling::Dynamic>(sampler, ray, t0, t1, isoValue);
+}
+
+template <Renderer::Sampling sampling, typename Sampler>
+float Renderer::bisectionAccuracy(Sampler& sampler, const Ray& ray, float t0, float t1, float isoValue) const
 {
     int maxIterations = 100;
     for (int i = 0; i < maxIterations; i++) {
         const float t = (t0 + t1) / 2.0f;
         const glm::vec3 samplePos = ray.origin + t * ray.direction;
-        const float val = m_pVolume->getSampleInterpolate(samplePos);
+        const float val = getSample<sampling>(sampler, samplePos);
         if (std::abs(val - isoValue) < 0.01f) {
             return t;
         }
@@ -200,6 +320,7 @@ float Renderer::bisectionAccuracy(const Ray& ray, float t0, float t1, float isoV
             t1 = t;
         }
     }
+    return (t0 + t1) / 2.0f;
 }
 
 // ======= TODO: IMPLEMENT ========
@@ -233,6 +354,12 @@ glm::vec3 Renderer::computePhongShading(const glm::vec3& color, const volume::Gr
 // In this function, implement 1D transfer function raycasting.
 // Use getTFValue to compute the color for a given volume value according to the 1D transfer function.
 glm::vec4 Renderer::traceRayComposite(const Ray& ray, float stepSize) const
+{
+    return traceRayComposite<Sampling::Dynamic, volume::VolumeSampler>(ray, stepSize);
+}
+
+template <Renderer::Sampling sampling, typename Sampler>
+glm::vec4 Renderer::traceRayComposite(const Ray& ray, float stepSize) const
 {
     glm::vec3 accumulatedColor(0.0f);
     float accumulatedAlpha = 0.0f;
@@ -240,18 +367,22 @@ glm::vec4 Renderer::traceRayComposite(const Ray& ray, float stepSize) const
     // the number of steps ray length and step size.
     float rayLength = ray.tmax - ray.tmin;
     int numSteps = static_cast<int>(std::ceil(rayLength / stepSize));
+    Sampler sampler { *m_pVolume, m_lod };
 
     for (int i = 0; i < numSteps; ++i) {
         float currentT = ray.tmin + i * stepSize;
         glm::vec3 samplePos = ray.origin + ray.direction * currentT;
 
         // volume value at the current sample position.
-        float val = m_pVolume->getSampleInterpolate(samplePos);
+        float val = getSample<sampling>(sampler, samplePos);
 
         // Use volume value to get color and opacity.
         glm::vec4 tfValue = getTFValue(val);
         glm::vec3 color = glm::vec3(tfValue);
         float alpha = tfValue.a;
+        // A step through a coarser level of the mip pyramid covers 2^m_lod steps at full resolution.
+        if (m_lod > 0)
+            alpha = 1.0f - std::pow(1.0f - alpha, float(1 << m_lod));
 
         // Perform front-to-back compositing.
         accumulatedColor += (1.0f - accumulatedAlpha) * color * alpha;
@@ -269,6 +400,130 @@ glm::vec4 Renderer::traceRayComposite(const Ray& ray, float stepSize) const
 
  
 
+// The ray marcher for renderMode (any mode but RenderSlicer) that matches the interpolation mode of the volume, the
+// volume shading setting and the step size.
+Renderer::TraceFunction Renderer::selectTraceFunction(RenderMode renderMode) const
+{
+    const Sampling sampling = selectSampling();
+    if (renderMode == RenderMode::RenderMIP) {
+        // Batched sampling only pays off if it is vectorized, and it only samples the full resolution volume.
+        const bool batched = (sampling == Sampling::NearestNeighbour || sampling == Sampling::Linear) && m_pVolume->vectorizesSampleBatch()
+            && (m_lod <= 0 || m_pVolume->mipLevelCount() == 0);
+        if (batched && m_config.fixedPointInterpolation && sampling == Sampling::Linear && m_pVolume->voxelType() != volume::VoxelType::Float)
+            return &Renderer::traceRayMIPBatched<true>;
+        if (batched)
+            return &Renderer::traceRayMIPBatched<false>;
+    }
+    // Samples less than a voxel (of the rendered level) apart mostly land in the cell of the previous sample, whose
+    // voxels volume::RaySampler keeps. With larger steps they hardly ever do, and keeping the voxels only costs time.
+    if (m_config.stepSize < 1.0f)
+        return traceFunction<volume::RaySampler>(renderMode, sampling, m_config.volumeShading);
+    return traceFunction<volume::VolumeSampler>(renderMode, sampling, m_config.volumeShading);
+}
+
+// The ray marcher for renderMode that samples through a Sampler. The tables are indexed by sampling, and the one of iso
+// (the only ray marcher that shades) by [sampling][shading].
+template <typename Sampler>
+Renderer::TraceFunction Renderer::traceFunction(RenderMode renderMode, Sampling sampling, bool shading)
+{
+    static constexpr std::array<TraceFunction, 4> mipFunctions {
+        &Renderer::traceRayMIP<Sampling::Dynamic, Sampler>,
+        &Renderer::traceRayMIP<Sampling::NearestNeighbour, Sampler>,
+        &Renderer::traceRayMIP<Sampling::Linear, Sampler>,
+        &Renderer::traceRayMIP<Sampling::Cubic, Sampler>
+    };
+    static constexpr std::array<std::array<TraceFunction, 2>, 4> isoFunctions { {
+        { &Renderer::traceRayISO<Sampling::Dynamic, Sampler, false>, &Renderer::traceRayISO<Sampling::Dynamic, Sampler, true> },
+        { &Renderer::traceRayISO<Sampling::NearestNeighbour, Sampler, false>, &Renderer::traceRayISO<Sampling::NearestNeighbour, Sampler, true> },
+        { &Renderer::traceRayISO<Sampling::Linear, Sampler, false>, &Renderer::traceRayISO<Sampling::Linear, Sampler, true> },
+        { &Renderer::traceRayISO<Sampling::Cubic, Sampler, false>, &Renderer::traceRayISO<Sampling::Cubic, Sampler, true> },
+    } };
+    static constexpr std::array<TraceFunction, 4> compositeFunctions {
+        &Renderer::traceRayComposite<Sampling::Dynamic, Sampler>,
+        &Renderer::traceRayComposite<Sampling::NearestNeighbour, Sampler>,
+        &Renderer::traceRayComposite<Sampling::Linear, Sampler>,
+        &Renderer::traceRayComposite<Sampling::Cubic, Sampler>
+    };
+
+    switch (renderMode) {
+    case RenderMode::RenderMIP: {
+        return mipFunctions[size_t(sampling)];
+    }
+    case RenderMode::RenderIso: {
+        return isoFunctions[size_t(sampling)][shading ? 1 : 0];
+    }
+    case RenderMode::RenderComposite: {
+        return compositeFunctions[size_t(sampling)];
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
+// The sampling kernel that matches the interpolation mode of the volume.
+Renderer::Sampling Renderer::selectSampling() const
+{
+    switch (m_pVolume->interpolationMode) {
+    case volume::InterpolationMode::NearestNeighbour: {
+        return Sampling::NearestNeighbour;
+    }
+    case volume::InterpolationMode::Linear: {
+        return Sampling::Linear;
+    }
+    case volume::InterpolationMode::Cubic: {
+        return Sampling::Cubic;
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
+const volume::MinMaxGrid* Renderer::minMaxGrid() const
+{
+    if (!m_config.emptySpaceSkipping || size_t(m_lod) >= m_minMaxGrids.size())
+        return nullptr;
+    return m_minMaxGrids[size_t(m_lod)].get();
+}
+
+template <Renderer::Sampling sampling, typename Sampler>
+float Renderer::getSample(Sampler& sampler, const glm::vec3& pos)
+{
+    if constexpr (sampling == Sampling::NearestNeighbour)
+        return sampler.template sample<volume::InterpolationMode::NearestNeighbour>(pos);
+    else if constexpr (sampling == Sampling::Linear)
+        return sampler.template sample<volume::InterpolationMode::Linear>(pos);
+    else if constexpr (sampling == Sampling::Cubic)
+        return sampler.template sample<volume::InterpolationMode::Cubic>(pos);
+    else
+        return sampler.sample(pos);
+}
+
+// The gradient at a shading point. Without a gradient volume the gradient is estimated with central differences of
+// interpolated samples, one voxel (of the current level of detail) apart. This costs six samples per shading point but
+// no memory, and matches the gradient volume (which uses central differences of the voxels) at the voxel centers. Like
+// the gradient volume, which is zero on the border voxels, the estimate is zero where the differences would read
+// samples outside of the volume (which are zero and would give large gradients at the border).
+volume::GradientVoxel Renderer::getGradient(const glm::vec3& pos) const
+{
+    if (m_pGradientVolume)
+        return m_pGradientVolume->getGradientInterpolate(pos, m_lod);
+
+    // The same level and coordinates as Volume::getSampleInterpolate(pos, m_lod).
+    const volume::Volume& level = m_pVolume->mipLevel(m_lod);
+    const float h = float(1 << (m_lod <= 0 || m_pVolume->mipLevelCount() == 0 ? 0 : std::min(m_lod, m_pVolume->mipLevelCount())));
+    const glm::vec3 levelPos = (pos + 0.5f) / h - 0.5f;
+    if (glm::any(glm::lessThan(levelPos, glm::vec3(1.0f))) || glm::any(glm::greaterThanEqual(levelPos, glm::vec3(level.dims() - 2))))
+        return { glm::vec3(0.0f), 0.0f };
+
+    auto difference = [&](const glm::vec3& offset) {
+        return (m_pVolume->getSampleInterpolate(pos + offset, m_lod) - m_pVolume->getSampleInterpolate(pos - offset, m_lod)) / (2.0f * h);
+    };
+    const glm::vec3 gradient { difference(glm::vec3(h, 0, 0)), difference(glm::vec3(0, h, 0)), difference(glm::vec3(0, 0, h)) };
+    return { gradient, glm::length(gradient) };
+}
+
 // ======= DO NOT MODIFY THIS FUNCTION ========
 // Looks up the color+opacity corresponding to the given volume value from the 1D tranfer function LUT (m_config.tfColorMap).
 // The value will initially range from (m_config.tfColorMapIndexStart) to (m_config.tfColorMapIndexStart + m_config.tfColorMapIndexRange) .
@@ -316,7 +571,7 @@ bool Renderer::instersectRayVolumeBounds(Ray& ray, const Bounds& bounds) const
 // This function inserts a color into the framebuffer at position x,y
 void Renderer::fillColor(int x, int y, const glm::vec4& color)
 {
-    const size_t index = static_cast<size_t>(m_config.renderResolution.x * y + x);
+    const size_t index = size_t(m_config.renderResolution.x) * size_t(y) + size_t(x);
     m_frameBuffer[index] = color;
 }
 }
\ No newline at end of file
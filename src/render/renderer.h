@@ -3,6 +3,8 @@
 #include "render/ray_trace_camera.h"
 #include "render/render_config.h"
 #include "volume/gradient_volume.h"
+#include "volume/min_max_grid.h"
+#include "volume/ray_sampler.h"
 #include "volume/volume.h"
 #include <cstring> // memcmp
 #include <glm/mat4x4.hpp>
@@ -26,13 +28,21 @@ union Bounds {
 
 class Renderer {
 public:
+    // pGradientVolume may be nullptr, in which case the gradients are estimated from the volume where they are needed
+    // for shading (see getGradient).
     Renderer(
         const volume::Volume* pVolume,
         const volume::GradientVolume* pGradientVolume,
         const render::RayTraceCamera* pCamera,
         const RenderConfig& config);
+    virtual ~Renderer() = default;
 
     void setConfig(const RenderConfig& config);
+    // Render another volume, such as the next timestep of a VolumeSequence.
+    void setVolume(const volume::Volume* pVolume, const volume::GradientVolume* pGradientVolume);
+    // Render from level lod of the mip pyramid of the volume (see Volume::getSampleInterpolate(coord, lod)) with
+    // proportionally larger steps. Used to keep interaction responsive; 0 renders the volume at full resolution.
+    void setLevelOfDetail(int lod);
     void render();
     gsl::span<const glm::vec4> frameBuffer() const;
 
@@ -47,7 +57,42 @@ protected:
 
     static glm::vec3 computePhongShading(const glm::vec3& color, const volume::GradientVoxel& gradient, const glm::vec3& L, const glm::vec3& V, float ambientCoefficient=0.1f, float diffuseCoefficient=0.7f, float specularCoefficient=0.2f, int specularPower=100);
 
+    volume::GradientVoxel getGradient(const glm::vec3& pos) const;
 
+    // The ray marchers, specialized for how they sample the volume (and iso for volume shading) such that their loops
+    // call the interpolation kernel directly. Sampling::Dynamic samples with the interpolation mode of the volume, which
+    // Volume::getSampleInterpolate selects for every sample. render() selects the ray marcher once per frame (with the
+    // sampling of selectSampling); the functions above use Sampling::Dynamic (through a volume::VolumeSampler).
+    enum class Sampling {
+        Dynamic,
+        NearestNeighbour,
+        Linear,
+        Cubic
+    };
+    using TraceFunction = glm::vec4 (Renderer::*)(const Ray& ray, float sampleStep) const;
+    TraceFunction selectTraceFunction(RenderMode renderMode) const;
+    template <typename Sampler>
+    static TraceFunction traceFunction(RenderMode renderMode, Sampling sampling, bool shading);
+    // Virtual so that tests can render with Sampling::Dynamic to compare the specialized ray marchers against.
+    virtual Sampling selectSampling() const;
+
+    // Every ray samples the volume through a Sampler: a volume::RaySampler, which reuses the voxels of the last cell, for
+    // steps smaller than a voxel and a volume::VolumeSampler otherwise.
+    template <Sampling sampling, typename Sampler>
+    static float getSample(Sampler& sampler, const glm::vec3& pos);
+    template <Sampling sampling, typename Sampler>
+    glm::vec4 traceRayMIP(const Ray& ray, float sampleStep) const;
+    template <bool fixedPoint = false>
+    glm::vec4 traceRayMIPBatched(const Ray& ray, float sampleStep) const;
+    template <Sampling sampling, typename Sampler, bool shading>
+    glm::vec4 traceRayISO(const Ray& ray, float sampleStep) const;
+    template <Sampling sampling, typename Sampler>
+    float bisectionAccuracy(Sampler& sampler, const Ray& ray, float t0, float t1, float isoValue) const;
+    template <Sampling sampling, typename Sampler>
+    glm::vec4 traceRayComposite(const Ray& ray, float sampleStep) const;
+
+    // The min-max grid of the level of the mip pyramid that is rendered, if render() built it (nullptr otherwise).
+    const volume::MinMaxGrid* minMaxGrid() const;
 
 private:
     void resizeImage(const glm::ivec2& resolution);
@@ -63,6 +108,9 @@ protected:
     const volume::GradientVolume* m_pGradientVolume;
     const render::RayTraceCamera* m_pCamera;
     RenderConfig m_config;
+    int m_lod { 0 };
+    // Min-max grids of the levels of the mip pyramid (for empty space skipping), built when they are first rendered.
+    std::vector<std::unique_ptr<volume::MinMaxGrid>> m_minMaxGrids;
 
     std::vector<glm::vec4> m_frameBuffer;
 };
@@ -1,9 +1,13 @@
 #include "menu.h"
 #include "render/renderer.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
 #include <filesystem>
 #include <fmt/format.h>
 #include <imgui.h>
 #include <iostream>
+#include <limits>
 #include <nfd.h>
 
 namespace ui {
@@ -29,6 +33,16 @@ void Menu::setInterpolationModeChangedCallback(InterpolationModeChangedCallback&
     m_optInterpolationModeChangedCallback = std::move(callback);
 }
 
+void Menu::setCancelLoadCallback(CancelLoadCallback&& callback)
+{
+    m_optCancelLoadCallback = std::move(callback);
+}
+
+void Menu::setLoadSequenceCallback(LoadSequenceCallback&& callback)
+{
+    m_optLoadSequenceCallback = std::move(callback);
+}
+
 render::RenderConfig Menu::renderConfig() const
 {
     return m_renderConfig;
@@ -39,6 +53,21 @@ volume::InterpolationMode Menu::interpolationMode() const
     return m_interpolationMode;
 }
 
+volume::LoadConfig Menu::loadConfig() const
+{
+    volume::LoadConfig out = m_loadConfig;
+    if (m_cropToRegion) {
+        out.cropMin = m_cropMin;
+        out.cropMax = m_cropMax;
+    }
+    return out;
+}
+
+volume::SequenceConfig Menu::sequenceConfig() const
+{
+    return m_sequenceConfig;
+}
+
 void Menu::setBaseRenderResolution(const glm::ivec2& baseRenderResolution)
 {
     m_baseRenderResolution = baseRenderResolution;
@@ -48,19 +77,45 @@ void Menu::setBaseRenderResolution(const glm::ivec2& baseRenderResolution)
 
 // This function handles a part of the volume loading where we create the widget histograms, set some config values
 //  and set the menu volume information
-void Menu::setLoadedVolume(const volume::Volume& volume, const volume::GradientVolume& gradientVolume)
+void Menu::setLoadedVolume(const volume::Volume& volume, const volume::GradientVolume* pGradientVolume)
 {
     m_tfWidget = TransferFunctionWidget(volume);
 
     m_tfWidget->updateRenderConfig(m_renderConfig);
 
     const glm::ivec3 dim = volume.dims();
-    m_volumeInfo = fmt::format("Volume info:\n{}\nDimensions: ({}, {}, {})\nVoxel value range: {} - {}\n",
-        volume.fileName(), dim.x, dim.y, dim.z, volume.minimum(), volume.maximum());
+    m_volumeInfo = fmt::format("Volume info:\n{}\nDimensions: ({}, {}, {})\nVoxel value range: {} - {}\nMean: {:.2f}, standard deviation: {:.2f}\n",
+        volume.fileName(), dim.x, dim.y, dim.z, volume.minimum(), volume.maximum(), volume.mean(), std::sqrt(volume.variance()));
+    if (const auto* pCompressedBricks = volume.compressedBricks()) {
+        m_volumeInfo += fmt::format("Compressed voxels: {:.1f} MB ({:.1f}x smaller), decoded bricks: up to {} MB per render thread\n",
+            double(pCompressedBricks->compressedBytes()) / double(1 << 20), double(pCompressedBricks->uncompressedBytes()) / double(pCompressedBricks->compressedBytes()),
+            volume::CompressedBricks::decodedBrickCacheBudget >> 20);
+    }
+    if (volume.mipLevelCount() > 0)
+        m_volumeInfo += fmt::format("Mip levels: {}\n", volume.mipLevelCount());
+    if (pGradientVolume && pGradientVolume->format() == volume::GradientFormat::Lazy)
+        m_volumeInfo += "Gradients: computed per brick while rendering\n";
+    else if (pGradientVolume)
+        m_volumeInfo += fmt::format("Gradients: {:.1f} MB\n", double(pGradientVolume->byteSize()) / double(1 << 20));
+    else
+        m_volumeInfo += "Gradients: estimated while rendering\n";
     m_volumeMax = int(volume.maximum());
+    m_pBrickCache = volume.brickCache();
+    m_pLazyGradientVolume = pGradientVolume && pGradientVolume->format() == volume::GradientFormat::Lazy ? pGradientVolume : nullptr;
     m_volumeLoaded = true;
 }
 
+void Menu::setLoadedSequence(volume::VolumeSequence* pSequence)
+{
+    m_pSequence = pSequence;
+}
+
+// Progress of the volume that is being loaded in the background (if any), shown in the Load tab.
+void Menu::setLoadProgress(const std::optional<volume::VolumeLoader::Progress>& optLoadProgress)
+{
+    m_optLoadProgress = optLoadProgress;
+}
+
 // This function draws the menu
 void Menu::drawMenu(const glm::ivec2& pos, const glm::ivec2& size, std::chrono::duration<double> renderTime)
 {
@@ -92,6 +147,53 @@ void Menu::drawMenu(const glm::ivec2& pos, const glm::ivec2& size, std::chrono::
 void Menu::showLoadVolTab()
 {
     if (ImGui::BeginTabItem("Load")) {
+        // The load settings are applied to the next volume that is loaded.
+        int* pVoxelLayoutInt = reinterpret_cast<int*>(&m_loadConfig.layout);
+        ImGui::Text("Voxel layout:");
+        ImGui::RadioButton("Linear", pVoxelLayoutInt, int(volume::VoxelLayout::Linear));
+        ImGui::RadioButton("Bricked", pVoxelLayoutInt, int(volume::VoxelLayout::Bricked));
+        ImGui::RadioButton("Morton", pVoxelLayoutInt, int(volume::VoxelLayout::Morton));
+
+        ImGui::NewLine();
+
+        ImGui::Checkbox("Out-of-core (brick cache)", &m_loadConfig.outOfCore);
+        int brickCacheBudgetMB = int(m_loadConfig.brickCacheBudget >> 20);
+        if (ImGui::DragInt("Brick cache budget (MB)", &brickCacheBudgetMB, 16.0f, 16, 1 << 16))
+            m_loadConfig.brickCacheBudget = size_t(brickCacheBudgetMB) << 20;
+        ImGui::Checkbox("Compress voxels in memory", &m_loadConfig.compressed);
+        int* pMipPyramidInt = reinterpret_cast<int*>(&m_loadConfig.mipPyramid);
+        ImGui::Text("Mip pyramid (faster interaction):");
+        ImGui::RadioButton("Never", pMipPyramidInt, int(volume::MipPyramid::Never));
+        ImGui::RadioButton("For voxels loaded from the file", pMipPyramidInt, int(volume::MipPyramid::LoadedVoxels));
+        ImGui::RadioButton("Always (also cache file, out-of-core and compressed)", pMipPyramidInt, int(volume::MipPyramid::Always));
+        ImGui::Checkbox("Use cache file", &m_loadConfig.useCacheFile);
+
+        ImGui::NewLine();
+
+        ImGui::Checkbox("Precompute gradients (not for out-of-core volumes)", &m_loadConfig.precomputeGradients);
+        int* pGradientFormatInt = reinterpret_cast<int*>(&m_loadConfig.gradientFormat);
+        ImGui::Text("Gradient storage:");
+        ImGui::RadioButton("Full (16 bytes)", pGradientFormatInt, int(volume::GradientFormat::Full));
+        ImGui::RadioButton("Octahedral 8-bit (4 bytes)", pGradientFormatInt, int(volume::GradientFormat::Octahedral8));
+        ImGui::RadioButton("Octahedral 16-bit (6 bytes)", pGradientFormatInt, int(volume::GradientFormat::Octahedral16));
+        ImGui::RadioButton("Lazy (16 bytes, per brick on first use)", pGradientFormatInt, int(volume::GradientFormat::Lazy));
+
+        ImGui::NewLine();
+
+        // Cropped or downsampled volumes are read partially from the file (see LoadConfig::cropMin).
+        ImGui::Text("Region of interest:");
+        ImGui::Checkbox("Crop to region", &m_cropToRegion);
+        if (m_cropToRegion) {
+            ImGui::DragInt3("Crop min", &m_cropMin.x, 1.0f, 0, std::numeric_limits<uint16_t>::max());
+            ImGui::DragInt3("Crop max", &m_cropMax.x, 1.0f, 1, std::numeric_limits<uint16_t>::max());
+        }
+        ImGui::DragInt("Downsample factor", &m_loadConfig.downsampleFactor, 0.05f, 1, 16);
+        int* pDownsampleFilterInt = reinterpret_cast<int*>(&m_loadConfig.downsampleFilter);
+        ImGui::RadioButton("Stride", pDownsampleFilterInt, int(volume::DownsampleFilter::Stride));
+        ImGui::SameLine();
+        ImGui::RadioButton("Box filter", pDownsampleFilterInt, int(volume::DownsampleFilter::BoxFilter));
+
+        ImGui::NewLine();
 
         if (ImGui::Button("Load volume")) {
             nfdchar_t* pOutPath = nullptr;
@@ -105,6 +207,26 @@ void Menu::showLoadVolTab()
             }
         }
 
+        ImGui::NewLine();
+
+        // A sequence is loaded from any of its files; the other timesteps are found by their numbers.
+        ImGui::Text("Time-varying sequence:");
+        ImGui::DragInt("Prefetched timesteps", &m_sequenceConfig.prefetchCount, 0.1f, 1, 32);
+        ImGui::Checkbox("Store timesteps as delta bricks", &m_sequenceConfig.deltaBricks);
+        if (ImGui::Button("Load sequence")) {
+            nfdchar_t* pOutPath = nullptr;
+            nfdresult_t result = NFD_OpenDialog("fld,dat", nullptr, &pOutPath);
+
+            if (result == NFD_OKAY) {
+                std::filesystem::path path = pOutPath;
+                if (m_optLoadSequenceCallback)
+                    (*m_optLoadSequenceCallback)(path);
+            }
+        }
+
+        showLoadProgress();
+        showSequencePlayback();
+
         if (m_volumeLoaded)
             ImGui::Text("%s", m_volumeInfo.c_str());
 
@@ -112,6 +234,70 @@ void Menu::showLoadVolTab()
     }
 }
 
+// This shows which step of the background load is running (with a button to cancel it), or why the last load stopped
+void Menu::showLoadProgress()
+{
+    if (!m_optLoadProgress)
+        return;
+
+    const auto& progress = *m_optLoadProgress;
+    const std::string fileName = progress.file.filename().string();
+    const double seconds = progress.elapsed.count();
+    switch (progress.stage) {
+    case volume::VolumeLoader::Stage::LoadingVolume:
+    case volume::VolumeLoader::Stage::ComputingGradients:
+    case volume::VolumeLoader::Stage::WritingCache: {
+        static constexpr std::array<const char*, 3> stepNames { "reading voxels", "computing gradients", "writing cache file" };
+        const int step = int(progress.stage);
+        const std::string progressText = fmt::format("Loading {} (step {}/{}: {}, {:.1f}s)",
+            fileName, step + 1, stepNames.size(), stepNames[size_t(step)], seconds);
+        ImGui::Text("%s", progressText.c_str());
+        if (ImGui::Button("Cancel") && m_optCancelLoadCallback)
+            (*m_optCancelLoadCallback)();
+        ImGui::NewLine();
+        break;
+    }
+    case volume::VolumeLoader::Stage::Cancelled: {
+        ImGui::Text("Loading %s was cancelled", fileName.c_str());
+        ImGui::NewLine();
+        break;
+    }
+    case volume::VolumeLoader::Stage::Failed: {
+        ImGui::Text("Failed to load %s", fileName.c_str());
+        ImGui::NewLine();
+        break;
+    }
+    case volume::VolumeLoader::Stage::Done: {
+        break;
+    }
+    }
+}
+
+// Playback controls of the loaded sequence (if any)
+void Menu::showSequencePlayback()
+{
+    if (!m_pSequence)
+        return;
+
+    if (ImGui::Button(m_pSequence->isPlaying() ? "Pause" : "Play")) {
+        if (m_pSequence->isPlaying())
+            m_pSequence->pause();
+        else
+            m_pSequence->play();
+    }
+    float framesPerSecond = m_pSequence->framesPerSecond();
+    if (ImGui::DragFloat("Frames per second", &framesPerSecond, 0.1f, 0.1f, 120.0f))
+        m_pSequence->setFramesPerSecond(framesPerSecond);
+
+    const size_t timestep = m_pSequence->currentTimestep();
+    std::string playbackText = fmt::format("Timestep {} / {} ({}), stalls: {}",
+        timestep + 1, m_pSequence->timestepCount(), m_pSequence->file(timestep).filename().string(), m_pSequence->stalls());
+    if (m_pSequence->deltaBytes() > 0)
+        playbackText += fmt::format("\nDelta bricks: {} MB", m_pSequence->deltaBytes() >> 20);
+    ImGui::Text("%s", playbackText.c_str());
+    ImGui::NewLine();
+}
+
 // This renders the RayCast tab, where the user can set the render mode, interpolation mode and other
 //  render-related settings
 void Menu::showRayCastTab(std::chrono::duration<double> renderTime)
@@ -120,6 +306,16 @@ void Menu::showRayCastTab(std::chrono::duration<double> renderTime)
         const std::string renderText = fmt::format("rendering time: {}ms\nrendering resolution: ({}, {})\n",
             std::chrono::duration_cast<std::chrono::milliseconds>(renderTime).count(), m_renderConfig.renderResolution.x, m_renderConfig.renderResolution.y);
         ImGui::Text("%s", renderText.c_str());
+        if (m_pBrickCache) {
+            const std::string brickCacheText = fmt::format("brick cache: {} hits, {} misses, {} / {} MB resident\n",
+                m_pBrickCache->hits(), m_pBrickCache->misses(), m_pBrickCache->residentBytes() >> 20, m_pBrickCache->budget() >> 20);
+            ImGui::Text("%s", brickCacheText.c_str());
+        }
+        if (m_pLazyGradientVolume) {
+            const std::string gradientText = fmt::format("gradient bricks: {} computed, {} MB\n",
+                m_pLazyGradientVolume->materializedBrickCount(), m_pLazyGradientVolume->byteSize() >> 20);
+            ImGui::Text("%s", gradientText.c_str());
+        }
         ImGui::NewLine();
 
         int* pRenderModeInt = reinterpret_cast<int*>(&m_renderConfig.renderMode);
@@ -138,6 +334,7 @@ void Menu::showRayCastTab(std::chrono::duration<double> renderTime)
         ImGui::DragFloat("Iso Value", &m_renderConfig.isoValue, 0.1f, 0.0f, float(m_volumeMax));
         
         ImGui::Checkbox("Use Bisection", &m_renderConfig.bisection);
+        ImGui::Checkbox("Empty space skipping", &m_renderConfig.emptySpaceSkipping);
 
         ImGui::NewLine();
 
@@ -150,6 +347,7 @@ void Menu::showRayCastTab(std::chrono::duration<double> renderTime)
         ImGui::RadioButton("Nearest Neighbour", pInterpolationModeInt, int(volume::InterpolationMode::NearestNeighbour));
         ImGui::RadioButton("Linear", pInterpolationModeInt, int(volume::InterpolationMode::Linear));
         ImGui::RadioButton("TriCubic", pInterpolationModeInt, int(volume::InterpolationMode::Cubic));
+        ImGui::Checkbox("Fixed-point linear MIP (8/16-bit volumes)", &m_renderConfig.fixedPointInterpolation);
 
         ImGui::EndTabItem();
     }
@@ -3,6 +3,8 @@
 #include "ui/transfer_func.h"
 #include "volume/gradient_volume.h"
 #include "volume/volume.h"
+#include "volume/volume_loader.h"
+#include "volume/volume_sequence.h"
 #include <chrono>
 #include <filesystem>
 #include <functional>
@@ -25,17 +27,29 @@ public:
     void setRenderConfigChangedCallback(RenderConfigChangedCallback&& callback);
     using InterpolationModeChangedCallback = std::function<void(volume::InterpolationMode)>;
     void setInterpolationModeChangedCallback(InterpolationModeChangedCallback&& callback);
+    using CancelLoadCallback = std::function<void()>;
+    void setCancelLoadCallback(CancelLoadCallback&& callback);
+    using LoadSequenceCallback = std::function<void(const std::filesystem::path&)>;
+    void setLoadSequenceCallback(LoadSequenceCallback&& callback);
 
     render::RenderConfig renderConfig() const;
     volume::InterpolationMode interpolationMode() const;
+    volume::LoadConfig loadConfig() const;
+    volume::SequenceConfig sequenceConfig() const;
 
     void setBaseRenderResolution(const glm::ivec2& baseRenderResolution);
-    void setLoadedVolume(const volume::Volume& volume, const volume::GradientVolume& gradientVolume);
+    // pGradientVolume is nullptr if the gradients are not precomputed.
+    void setLoadedVolume(const volume::Volume& volume, const volume::GradientVolume* pGradientVolume);
+    void setLoadProgress(const std::optional<volume::VolumeLoader::Progress>& optLoadProgress);
+    // The sequence that is being played back (nullptr when a single volume is shown), controlled from the Load tab.
+    void setLoadedSequence(volume::VolumeSequence* pSequence);
 
     void drawMenu(const glm::ivec2& pos, const glm::ivec2& size, std::chrono::duration<double> renderTime);
 
 private:
     void showLoadVolTab();
+    void showLoadProgress();
+    void showSequencePlayback();
     void showRayCastTab(std::chrono::duration<double> renderTime);
     void showTransFuncTab();
 
@@ -46,6 +60,10 @@ private:
     bool m_volumeLoaded = false;
     std::string m_volumeInfo;
     int m_volumeMax;
+    const volume::BrickCache* m_pBrickCache { nullptr };
+    const volume::GradientVolume* m_pLazyGradientVolume { nullptr };
+    std::optional<volume::VolumeLoader::Progress> m_optLoadProgress;
+    volume::VolumeSequence* m_pSequence { nullptr };
 
     std::optional<TransferFunctionWidget> m_tfWidget;
 
@@ -53,10 +71,17 @@ private:
     float m_resolutionScale { 1.0f };
     render::RenderConfig m_renderConfig {};
     volume::InterpolationMode m_interpolationMode { volume::InterpolationMode::NearestNeighbour };
+    volume::LoadConfig m_loadConfig {};
+    bool m_cropToRegion { false };
+    glm::ivec3 m_cropMin { 0 };
+    glm::ivec3 m_cropMax { 256 };
+    volume::SequenceConfig m_sequenceConfig {};
 
     std::optional<LoadVolumeCallback> m_optLoadVolumeCallback;
     std::optional<RenderConfigChangedCallback> m_optRenderConfigChangedCallback;
     std::optional<InterpolationModeChangedCallback> m_optInterpolationModeChangedCallback;
+    std::optional<CancelLoadCallback> m_optCancelLoadCallback;
+    std::optional<LoadSequenceCallback> m_optLoadSequenceCallback;
 };
 
 }
@@ -0,0 +1,157 @@
+#include "brick_cache.h"
+#include <algorithm>
+#include <glm/common.hpp>
+
+namespace volume {
+
+// The brick that the calling thread looked up last, which belongs to the BrickCache object with the given id (ids are
+// never reused, so the brick of a destroyed object can never be mistaken for one of a new object).
+struct LastBrick {
+    uint64_t owner { 0 };
+    size_t brickIndex { 0 };
+    BrickCache::BrickPtr pBrick;
+};
+static thread_local LastBrick lastBrick;
+static std::atomic<uint64_t> nextId { 1 };
+
+BrickCache::BrickCache(const std::filesystem::path& file, size_t dataOffset, const glm::ivec3& dim, size_t elementSize, size_t budget)
+    : m_id(nextId.fetch_add(1))
+    , m_dim(dim)
+    , m_brickCount((dim + (brickSize - 1)) / brickSize)
+    , m_elementSize(elementSize)
+    , m_dataOffset(dataOffset)
+    , m_budget(budget)
+    , m_bricks(size_t(m_brickCount.x) * size_t(m_brickCount.y) * size_t(m_brickCount.z))
+    , m_used(std::make_unique<std::atomic<bool>[]>(m_bricks.size()))
+{
+    // Bricks are read row by row after a seek. The rows are short, so the stream is unbuffered to prevent it from
+    // filling its whole buffer for every row.
+    m_file.rdbuf()->pubsetbuf(nullptr, 0);
+    m_file.open(file, std::ios::binary);
+}
+
+const std::byte* BrickCache::brick(int x, int y, int z) const
+{
+    const auto ux = unsigned(x), uy = unsigned(y), uz = unsigned(z);
+    const size_t brickIndex = ux / brickSize + size_t(m_brickCount.x) * (uy / brickSize + size_t(m_brickCount.y) * (uz / brickSize));
+    if (lastBrick.owner != m_id || lastBrick.brickIndex != brickIndex) {
+        lastBrick.pBrick = lookUpBrick(brickIndex);
+        lastBrick.owner = m_id;
+        lastBrick.brickIndex = brickIndex;
+    } else {
+        // Otherwise the brick that a thread is sampling could be evicted (and kept alive outside of the budget).
+        markUsed(brickIndex);
+    }
+    return lastBrick.pBrick->data();
+}
+
+BrickCache::BrickPtr BrickCache::lookUpBrick(size_t brickIndex) const
+{
+    {
+        std::shared_lock lock { m_mutex };
+        if (BrickPtr pBrick = m_bricks[brickIndex]) {
+            markUsed(brickIndex);
+            m_hits.fetch_add(1, std::memory_order_relaxed);
+            return pBrick;
+        }
+    }
+
+    // Read the brick without holding the lock so other threads can keep sampling the resident bricks in the meantime.
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    auto pBrick = std::make_shared<const std::vector<std::byte>>(readBrick(brickIndex));
+
+    std::unique_lock lock { m_mutex };
+    // Another thread may have read the same brick while this thread was reading it.
+    if (m_bricks[brickIndex])
+        return m_bricks[brickIndex];
+
+    insertBrick(brickIndex, pBrick);
+    return pBrick;
+}
+
+// The flag is only written if it is not set yet, so that threads that keep sampling the same brick only read it.
+void BrickCache::markUsed(size_t brickIndex) const
+{
+    if (!m_used[brickIndex].load(std::memory_order_relaxed))
+        m_used[brickIndex].store(true, std::memory_order_relaxed);
+}
+
+VoxelCell BrickCache::cell(int x, int y, int z)
+{
+    const auto ux = unsigned(x), uy = unsigned(y), uz = unsigned(z);
+    const size_t local = ux % brickSize + storedBrickSize * (uy % brickSize + storedBrickSize * (uz % brickSize));
+    return { local, 1, storedBrickSize, storedBrickSize * storedBrickSize };
+}
+
+size_t BrickCache::budget() const
+{
+    return m_budget;
+}
+
+size_t BrickCache::residentBytes() const
+{
+    std::shared_lock lock { m_mutex };
+    return m_residentBricks.size() * storedBrickVoxels * m_elementSize;
+}
+
+uint64_t BrickCache::hits() const
+{
+    return m_hits.load();
+}
+
+uint64_t BrickCache::misses() const
+{
+    return m_misses.load();
+}
+
+// Read a brick (including its apron) from the file. The voxels of a brick are spread over many rows of the file, each
+// row is read with a separate seek. Parts of the brick that lie outside of the volume are left at zero.
+std::vector<std::byte> BrickCache::readBrick(size_t brickIndex) const
+{
+    const glm::ivec3 brickPos {
+        int(brickIndex % size_t(m_brickCount.x)),
+        int(brickIndex / size_t(m_brickCount.x) % size_t(m_brickCount.y)),
+        int(brickIndex / (size_t(m_brickCount.x) * size_t(m_brickCount.y)))
+    };
+    const glm::ivec3 begin = brickPos * brickSize;
+    const glm::ivec3 end = glm::min(begin + int(storedBrickSize), m_dim);
+    const size_t rowBytes = size_t(end.x - begin.x) * m_elementSize;
+
+    std::vector<std::byte> out(storedBrickVoxels * m_elementSize);
+    std::lock_guard lock { m_fileMutex };
+    for (int z = begin.z; z < end.z; z++) {
+        for (int y = begin.y; y < end.y; y++) {
+            const size_t fileIndex = size_t(begin.x) + size_t(m_dim.x) * (size_t(y) + size_t(m_dim.y) * size_t(z));
+            const size_t brickLocalIndex = storedBrickSize * (size_t(y - begin.y) + storedBrickSize * size_t(z - begin.z));
+            m_file.seekg(std::streamoff(m_dataOffset + fileIndex * m_elementSize));
+            m_file.read(reinterpret_cast<char*>(out.data() + brickLocalIndex * m_elementSize), std::streamsize(rowBytes));
+        }
+    }
+    // A truncated file leaves the stream in a failed state; the missing voxels stay zero.
+    m_file.clear();
+    return out;
+}
+
+// Make a brick resident. If the ring of resident bricks is full then the clock hand sweeps it for a brick that was not
+// used since the hand passed it last, clearing the flags of the bricks that were, and the new brick takes the place of
+// that brick. An insertion thus takes constant time on average instead of a search for the least recently used brick.
+// Threads that hold on to their last brick keep setting its flag without the lock, so the sweep stops after one round
+// (at which point it evicts the brick under the hand regardless). Requires an exclusive lock on m_mutex.
+void BrickCache::insertBrick(size_t brickIndex, BrickPtr pBrick) const
+{
+    // New bricks start out unused, the thread that read the brick marks it when it samples it again. Otherwise a
+    // sweep after reading as many new bricks as fit in the ring would find all flags set and evict any brick.
+    m_bricks[brickIndex] = std::move(pBrick);
+    m_used[brickIndex].store(false, std::memory_order_relaxed);
+    const size_t capacity = std::max(m_budget / (storedBrickVoxels * m_elementSize), size_t(1));
+    if (m_residentBricks.size() < capacity) {
+        m_residentBricks.push_back(brickIndex);
+        return;
+    }
+    for (size_t i = 0; i < m_residentBricks.size() && m_used[m_residentBricks[m_clockHand]].exchange(false, std::memory_order_relaxed); i++)
+        m_clockHand = (m_clockHand + 1) % m_residentBricks.size();
+    m_bricks[m_residentBricks[m_clockHand]].reset();
+    m_residentBricks[m_clockHand] = brickIndex;
+    m_clockHand = (m_clockHand + 1) % m_residentBricks.size();
+}
+}
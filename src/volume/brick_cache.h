@@ -0,0 +1,82 @@
+#pragma once
+#include "voxel_layout.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <glm/vec3.hpp>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+namespace volume {
+
+// Keeps the voxels of a volume file on disk and pages them into memory in bricks of brickSize^3 voxels when they are
+// accessed. At most budget bytes of bricks stay resident; when a new brick would exceed the budget a brick that was not
+// used recently is evicted (with the CLOCK algorithm, see insertBrick). Lookups are thread-safe so the renderer can
+// sample the volume from multiple threads. Every thread keeps a reference to the brick that it used last, so the many
+// lookups in the same brick (such as those of neighbouring samples) do not take the lock; they only mark the brick as
+// used.
+class BrickCache {
+public:
+    static constexpr int brickSize = 32;
+    // A resident brick (its raw voxels). Holding on to it keeps the voxels alive even if the cache evicts the brick.
+    using BrickPtr = std::shared_ptr<const std::vector<std::byte>>;
+
+public:
+    // The voxels (elementSize bytes each, in scanline order) start at dataOffset in the file.
+    BrickCache(const std::filesystem::path& file, size_t dataOffset, const glm::ivec3& dim, size_t elementSize, size_t budget);
+
+    // Voxels of the brick containing voxel (x, y, z), which is read from disk if it is not resident. The pointer stays
+    // valid (also if the brick is evicted) until the calling thread looks up another brick of any brick cache.
+    const std::byte* brick(int x, int y, int z) const;
+    // Element indices within brick(x, y, z) of the 8 corners of the cell at (x, y, z). Like the bricked layout each
+    // brick has a 1 voxel apron on its +x, +y and +z sides, so all corners of a cell are stored in the same brick.
+    static VoxelCell cell(int x, int y, int z);
+
+    size_t budget() const;
+    size_t residentBytes() const;
+    // Lookups of the resident bricks and of the bricks that were read from disk. Repeated lookups of the brick that
+    // a thread used last are not counted.
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+private:
+    BrickPtr lookUpBrick(size_t brickIndex) const;
+    std::vector<std::byte> readBrick(size_t brickIndex) const;
+    void insertBrick(size_t brickIndex, BrickPtr pBrick) const;
+    void markUsed(size_t brickIndex) const;
+
+private:
+    // Brick dimensions including the apron.
+    static constexpr size_t storedBrickSize = brickSize + 1;
+    static constexpr size_t storedBrickVoxels = storedBrickSize * storedBrickSize * storedBrickSize;
+
+    // Identifies the cache in the last brick of every thread.
+    const uint64_t m_id;
+    const glm::ivec3 m_dim;
+    const glm::ivec3 m_brickCount;
+    const size_t m_elementSize;
+    const size_t m_dataOffset;
+    const size_t m_budget;
+
+    mutable std::mutex m_fileMutex;
+    mutable std::ifstream m_file;
+
+    // m_bricks has an entry for every brick of the volume which is empty if the brick is not resident. It is
+    // protected by m_mutex: lookups take a shared lock and inserting/evicting a brick takes an exclusive lock.
+    mutable std::shared_mutex m_mutex;
+    mutable std::vector<BrickPtr> m_bricks;
+    // The resident bricks form the ring that the clock hand sweeps, which holds at most m_budget bytes of bricks (but
+    // at least one brick).
+    mutable std::vector<size_t> m_residentBricks;
+    mutable size_t m_clockHand { 0 };
+    // Whether a brick was used since the clock hand passed it last. Set without the lock on every lookup.
+    std::unique_ptr<std::atomic<bool>[]> m_used;
+
+    mutable std::atomic<uint64_t> m_hits { 0 };
+    mutable std::atomic<uint64_t> m_misses { 0 };
+};
+}
@@ -0,0 +1,298 @@
+#include "compressed_bricks.h"
+#include "volume.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+namespace volume {
+
+static constexpr size_t brickSize = VoxelIndexer::brickSize;
+static constexpr size_t storedBrickSize = VoxelIndexer::storedBrickSize;
+static constexpr size_t storedBrickVoxels = VoxelIndexer::storedBrickVoxels;
+
+// Unsigned integer with the same size as T, used to compute the residuals on the bit patterns of the voxels.
+template <typename T>
+using Bits = std::conditional_t<sizeof(T) == 1, uint8_t, std::conditional_t<sizeof(T) == 2, uint16_t, uint32_t>>;
+
+static void writeVarint(std::vector<uint8_t>& out, uint32_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+static uint32_t readVarint(const uint8_t*& pData)
+{
+    uint32_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        const uint8_t byte = *pData++;
+        value |= uint32_t(byte & 0x7f) << shift;
+        if (byte < 0x80)
+            return value;
+    }
+}
+
+// The residual of an integer voxel is its difference with the previous voxel (zigzag encoded so that small negative
+// differences become small numbers). Floats are not predicted arithmetically, instead the residual is the XOR of the
+// bit patterns, which is zero for repeated values and keeps the compression lossless.
+template <typename T>
+static uint32_t residual(Bits<T> value, Bits<T> previous)
+{
+    if constexpr (std::is_integral_v<T>) {
+        const int32_t difference = int32_t(value) - int32_t(previous);
+        return uint32_t(difference * 2) ^ uint32_t(difference >> 31);
+    } else {
+        return uint32_t(value ^ previous);
+    }
+}
+
+template <typename T>
+static Bits<T> applyResidual(Bits<T> previous, uint32_t residual)
+{
+    if constexpr (std::is_integral_v<T>) {
+        const int32_t difference = int32_t(residual >> 1) ^ -int32_t(residual & 1);
+        return Bits<T>(int32_t(previous) + difference);
+    } else {
+        return Bits<T>(previous ^ residual);
+    }
+}
+
+// Residuals are written as variable length integers. A zero residual is followed by the number of additional zero
+// residuals in the run.
+template <typename T>
+static void encodeBrick(gsl::span<const Bits<T>> voxels, std::vector<uint8_t>& out)
+{
+    Bits<T> previous = 0;
+    size_t zeroRun = 0;
+    for (const Bits<T> value : voxels) {
+        const uint32_t r = residual<T>(value, previous);
+        previous = value;
+        if (r == 0) {
+            zeroRun++;
+            continue;
+        }
+        if (zeroRun > 0) {
+            writeVarint(out, 0);
+            writeVarint(out, uint32_t(zeroRun - 1));
+            zeroRun = 0;
+        }
+        writeVarint(out, r);
+    }
+    if (zeroRun > 0) {
+        writeVarint(out, 0);
+        writeVarint(out, uint32_t(zeroRun - 1));
+    }
+}
+
+template <typename T>
+static void decodeBrick(const uint8_t* pData, Bits<T>* pOut)
+{
+    Bits<T> previous = 0;
+    for (size_t i = 0; i < storedBrickVoxels;) {
+        const uint32_t r = readVarint(pData);
+        if (r == 0) {
+            const size_t run = size_t(readVarint(pData)) + 1;
+            std::fill_n(pOut + i, run, previous);
+            i += run;
+        } else {
+            previous = applyResidual<T>(previous, r);
+            pOut[i++] = previous;
+        }
+    }
+}
+
+// Copy a brick (including its apron) out of the scanline ordered voxels and compress it. Parts of the brick outside of
+// the volume are zero, like in the bricked layout.
+template <typename T>
+static std::vector<uint8_t> compressBrick(gsl::span<const std::byte> voxels, const glm::ivec3& dim, const glm::ivec3& brickPos)
+{
+    std::array<Bits<T>, storedBrickVoxels> brick {};
+    const glm::ivec3 begin = brickPos * int(brickSize);
+    for (size_t z = 0; z < storedBrickSize; z++) {
+        for (size_t y = 0; y < storedBrickSize; y++) {
+            for (size_t x = 0; x < storedBrickSize; x++) {
+                const glm::ivec3 p = begin + glm::ivec3(int(x), int(y), int(z));
+                if (p.x < dim.x && p.y < dim.y && p.z < dim.z) {
+                    const size_t index = size_t(p.x) + size_t(dim.x) * (size_t(p.y) + size_t(dim.y) * size_t(p.z));
+                    std::memcpy(&brick[x + storedBrickSize * (y + storedBrickSize * z)], voxels.data() + index * sizeof(T), sizeof(T));
+                }
+            }
+        }
+    }
+    std::vector<uint8_t> out;
+    encodeBrick<T>(brick, out);
+    return out;
+}
+
+template <typename T>
+static void compressBricks(gsl::span<const std::byte> voxels, const glm::ivec3& dim, std::vector<uint8_t>& data, std::vector<size_t>& brickOffsets)
+{
+    const glm::ivec3 brickCount = (dim + int(brickSize - 1)) / int(brickSize);
+    std::vector<std::vector<uint8_t>> bricks(size_t(brickCount.x) * size_t(brickCount.y) * size_t(brickCount.z));
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t i = 0; i < int64_t(bricks.size()); i++) {
+        const glm::ivec3 brickPos {
+            int(size_t(i) % size_t(brickCount.x)),
+            int(size_t(i) / size_t(brickCount.x) % size_t(brickCount.y)),
+            int(size_t(i) / (size_t(brickCount.x) * size_t(brickCount.y)))
+        };
+        bricks[size_t(i)] = compressBrick<T>(voxels, dim, brickPos);
+    }
+
+    brickOffsets.resize(bricks.size() + 1);
+    brickOffsets[0] = 0;
+    for (size_t i = 0; i < bricks.size(); i++)
+        brickOffsets[i + 1] = brickOffsets[i] + bricks[i].size();
+    data.reserve(brickOffsets.back());
+    for (auto& brick : bricks) {
+        data.insert(std::end(data), std::begin(brick), std::end(brick));
+        brick = {};
+    }
+}
+
+// The decoded bricks of a thread, which belong to the CompressedBricks object with id owner (ids are never reused, so
+// the bricks of a destroyed object can never be mistaken for those of a new object). The cache is direct mapped. The
+// thread reads and writes the slots without a lock; the mutex only protects owner and slots against the destructor of
+// the owner, which empties the cache from another thread while this thread samples no other object (or does so with
+// another owner, which the destructor leaves alone).
+struct DecodedBrick {
+    size_t brickIndex { 0 };
+    std::vector<std::byte> voxels;
+};
+struct DecodedBrickCache {
+    std::mutex mutex;
+    std::atomic<uint64_t> owner { 0 };
+    std::vector<DecodedBrick> slots;
+};
+static std::atomic<uint64_t> nextId { 1 };
+
+static size_t elementSize(VoxelType voxelType)
+{
+    return voxelType == VoxelType::UInt8 ? 1 : (voxelType == VoxelType::UInt16 ? 2 : 4);
+}
+
+static int slotBits(size_t brickBytes)
+{
+    int bits = 0;
+    while ((brickBytes << (bits + 1)) <= CompressedBricks::decodedBrickCacheBudget)
+        bits++;
+    return bits;
+}
+
+CompressedBricks::CompressedBricks(gsl::span<const std::byte> voxels, const glm::ivec3& dim, VoxelType voxelType)
+    : m_id(nextId.fetch_add(1))
+    , m_voxelType(voxelType)
+    , m_elementSize(elementSize(voxelType))
+    , m_uncompressedBytes(voxels.size())
+    , m_slotBits(slotBits(storedBrickVoxels * m_elementSize))
+{
+    switch (m_voxelType) {
+    case VoxelType::UInt8: {
+        compressBricks<uint8_t>(voxels, dim, m_data, m_brickOffsets);
+        break;
+    }
+    case VoxelType::UInt16: {
+        compressBricks<uint16_t>(voxels, dim, m_data, m_brickOffsets);
+        break;
+    }
+    case VoxelType::Float: {
+        compressBricks<float>(voxels, dim, m_data, m_brickOffsets);
+        break;
+    }
+    }
+}
+
+// Release the decoded bricks of this object in the threads that still cache them (such as the idle threads of OpenMP).
+CompressedBricks::~CompressedBricks()
+{
+    std::lock_guard lock { m_threadCachesMutex };
+    for (const auto& weakCache : m_threadCaches) {
+        if (const auto pCache = weakCache.lock()) {
+            std::lock_guard cacheLock { pCache->mutex };
+            if (pCache->owner.load() == m_id) {
+                pCache->owner.store(0);
+                pCache->slots = {};
+            }
+        }
+    }
+}
+
+// The cache of the calling thread, emptied and taken over by this object if it belonged to another one.
+DecodedBrickCache& CompressedBricks::threadCache() const
+{
+    static thread_local const std::shared_ptr<DecodedBrickCache> pCache = std::make_shared<DecodedBrickCache>();
+    if (pCache->owner.load(std::memory_order_relaxed) != m_id) {
+        {
+            std::lock_guard cacheLock { pCache->mutex };
+            pCache->owner.store(m_id, std::memory_order_relaxed);
+            pCache->slots = std::vector<DecodedBrick>(size_t(1) << m_slotBits);
+        }
+        std::lock_guard lock { m_threadCachesMutex };
+        // Drop the caches of threads that have exited while registering this one.
+        m_threadCaches.erase(std::remove_if(std::begin(m_threadCaches), std::end(m_threadCaches), [](const auto& weakCache) { return weakCache.expired(); }),
+            std::end(m_threadCaches));
+        m_threadCaches.push_back(pCache);
+    }
+    return *pCache;
+}
+
+const std::byte* CompressedBricks::brick(size_t brickIndex) const
+{
+    // The multiplicative hash spreads neighbouring bricks (also along y and z) over the slots. Empty slots have no
+    // voxels, so they never match.
+    DecodedBrickCache& cache = threadCache();
+    const size_t slot = m_slotBits == 0 ? 0 : size_t((brickIndex * 0x9E3779B97F4A7C15ull) >> (64 - m_slotBits));
+    DecodedBrick& decodedBrick = cache.slots[slot];
+    if (decodedBrick.brickIndex == brickIndex && !decodedBrick.voxels.empty())
+        return decodedBrick.voxels.data();
+
+    decodedBrick.brickIndex = brickIndex;
+    decodedBrick.voxels.resize(storedBrickVoxels * m_elementSize);
+    const uint8_t* pData = m_data.data() + m_brickOffsets[brickIndex];
+    switch (m_voxelType) {
+    case VoxelType::UInt8: {
+        decodeBrick<uint8_t>(pData, reinterpret_cast<uint8_t*>(decodedBrick.voxels.data()));
+        break;
+    }
+    case VoxelType::UInt16: {
+        decodeBrick<uint16_t>(pData, reinterpret_cast<uint16_t*>(decodedBrick.voxels.data()));
+        break;
+    }
+    case VoxelType::Float: {
+        decodeBrick<float>(pData, reinterpret_cast<uint32_t*>(decodedBrick.voxels.data()));
+        break;
+    }
+    }
+    return decodedBrick.voxels.data();
+}
+
+size_t CompressedBricks::compressedBytes() const
+{
+    return m_data.size() + m_brickOffsets.size() * sizeof(size_t);
+}
+
+size_t CompressedBricks::uncompressedBytes() const
+{
+    return m_uncompressedBytes;
+}
+
+size_t CompressedBricks::decodedBytes() const
+{
+    size_t bytes = 0;
+    std::lock_guard lock { m_threadCachesMutex };
+    for (const auto& weakCache : m_threadCaches) {
+        if (const auto pCache = weakCache.lock()) {
+            std::lock_guard cacheLock { pCache->mutex };
+            if (pCache->owner.load() == m_id) {
+                for (const DecodedBrick& decodedBrick : pCache->slots)
+                    bytes += decodedBrick.voxels.size();
+            }
+        }
+    }
+    return bytes;
+}
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "voxel_layout.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/vec3.hpp>
+#include <gsl/span>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace volume {
+
+enum class VoxelType;
+struct DecodedBrickCache;
+
+// Voxels of a volume in the bricked layout (see VoxelLayout::Bricked) with every brick compressed losslessly. Each voxel
+// is predicted from the previous voxel of the brick; the residuals are stored as variable length integers and runs of
+// zero residuals (uniform regions such as air) are run-length encoded. Bricks are decoded when they are accessed into
+// a small cache that every thread has for itself, so lookups do not need any synchronization. A thread caches the
+// bricks of one object at a time: its cache is emptied when it samples another object, and the destructor empties the
+// caches of all threads that sampled the object.
+class CompressedBricks {
+public:
+    // Bytes of decoded bricks that every thread keeps around at most (64 float, 128 uint16 or 256 uint8 bricks).
+    static constexpr size_t decodedBrickCacheBudget = size_t(2) << 20;
+
+public:
+    // Compress voxels that are stored in scanline order.
+    CompressedBricks(gsl::span<const std::byte> voxels, const glm::ivec3& dim, VoxelType voxelType);
+    ~CompressedBricks();
+
+    // Decoded voxels of a brick (VoxelIndexer::storedBrickVoxels elements in the order of the bricked layout). The cache
+    // is direct mapped, so the pointer stays valid only until the calling thread looks up any other brick (which may
+    // replace it); it should only be used for the voxels of a single sample.
+    const std::byte* brick(size_t brickIndex) const;
+
+    size_t compressedBytes() const;
+    size_t uncompressedBytes() const;
+    // Bytes of the decoded bricks of this object in the caches of all threads.
+    size_t decodedBytes() const;
+
+private:
+    DecodedBrickCache& threadCache() const;
+
+private:
+    const uint64_t m_id;
+    const VoxelType m_voxelType;
+    const size_t m_elementSize;
+    const size_t m_uncompressedBytes;
+    // The caches have 2^m_slotBits slots, as many as fit in decodedBrickCacheBudget.
+    const int m_slotBits;
+
+    // The caches of the threads that sampled this object (they may have moved on to another object since).
+    mutable std::mutex m_threadCachesMutex;
+    mutable std::vector<std::weak_ptr<DecodedBrickCache>> m_threadCaches;
+
+    // Brick i is stored in m_data[m_brickOffsets[i], m_brickOffsets[i + 1]).
+    std::vector<uint8_t> m_data;
+    std::vector<size_t> m_brickOffsets;
+};
+}
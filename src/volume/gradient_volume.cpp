@@ -1,9 +1,19 @@
 #include "gradient_volume.h"
+#include "sample_batch.h"
+#include "volume_cache.h"
 #include <algorithm>
+#include <cassert>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <exception>
+#include <glm/common.hpp>
 #include <glm/geometric.hpp>
+#include <glm/vec2.hpp>
 #include <glm/vector_relational.hpp>
 #include <gsl/span>
+#include <limits>
 
 namespace volume {
 
@@ -31,34 +41,416 @@ static float computeMinMagnitude(gsl::span<const GradientVoxel> data)
         ->magnitude;
 }
 
-// Compute a gradient volume from a volume
-static std::vector<GradientVoxel> computeGradientVolume(const Volume& volume)
+struct MagnitudeRange {
+    float minimum, maximum;
+};
+
+// Same as in volume.cpp: the voxels of a mapped file are not necessarily aligned to the element size.
+template <typename T>
+static float loadVoxel(const std::byte* pVoxels, size_t index)
 {
-    const auto dim = volume.dims();
+    T out;
+    std::memcpy(&out, pVoxels + index * sizeof(T), sizeof(T));
+    return float(out);
+}
 
-    std::vector<GradientVoxel> out(static_cast<size_t>(dim.x * dim.y * dim.z));
-    for (int z = 1; z < dim.z - 1; z++) {
-        for (int y = 1; y < dim.y - 1; y++) {
-            for (int x = 1; x < dim.x - 1; x++) {
-                const float gx = (volume.getVoxel(x + 1, y, z) - volume.getVoxel(x - 1, y, z)) / 2.0f;
-                const float gy = (volume.getVoxel(x, y + 1, z) - volume.getVoxel(x, y - 1, z)) / 2.0f;
-                const float gz = (volume.getVoxel(x, y, z + 1) - volume.getVoxel(x, y, z - 1)) / 2.0f;
+// A gradient in one of the compact formats: the octahedral encoded unit normal with C (uint8_t or uint16_t) per
+// coordinate and the magnitude as a multiple of the magnitude scale of the gradient volume.
+template <typename C>
+struct CompactGradient {
+    std::array<C, 2> normal;
+    uint16_t magnitude;
+};
+static_assert(sizeof(CompactGradient<uint8_t>) == 4 && sizeof(CompactGradient<uint16_t>) == 6);
+
+static size_t compactGradientSize(GradientFormat format)
+{
+    return format == GradientFormat::Octahedral8 ? sizeof(CompactGradient<uint8_t>) : sizeof(CompactGradient<uint16_t>);
+}
+
+static glm::vec2 signNotZero(const glm::vec2& v)
+{
+    return { v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f };
+}
+
+// Map a (non-zero) direction onto the octahedron |x| + |y| + |z| = 1 and unfold it into the square [-1, 1]^2: the upper
+// half is projected onto the xy-plane, the lower half is folded outwards over the diagonals of the square.
+static glm::vec2 octahedralEncode(const glm::vec3& direction)
+{
+    const glm::vec2 p = glm::vec2(direction.x, direction.y) / (std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z));
+    return direction.z >= 0.0f ? p : (1.0f - glm::abs(glm::vec2(p.y, p.x))) * signNotZero(p);
+}
+
+static glm::vec3 octahedralDecode(const glm::vec2& p)
+{
+    const float z = 1.0f - std::abs(p.x) - std::abs(p.y);
+    const glm::vec2 xy = z >= 0.0f ? p : (1.0f - glm::abs(glm::vec2(p.y, p.x))) * signNotZero(p);
+    return glm::normalize(glm::vec3(xy, z));
+}
 
-                const glm::vec3 v { gx, gy, gz };
-                const size_t index = static_cast<size_t>(x + dim.x * (y + dim.y * z));
-                out[index] = GradientVoxel { v, glm::length(v) };
+template <typename C>
+static void encodeGradients(gsl::span<const GradientVoxel> gradients, float magnitudeScale, size_t begin, gsl::span<std::byte> out)
+{
+    constexpr float maxNormal = float(std::numeric_limits<C>::max());
+    constexpr float maxMagnitude = float(std::numeric_limits<uint16_t>::max());
+#pragma omp parallel for schedule(static)
+    for (int64_t i = 0; i < int64_t(gradients.size()); i++) {
+        const GradientVoxel& gradient = gradients[size_t(i)];
+        // Zero gradients have no direction; they are decoded as zero through their magnitude.
+        const glm::vec2 normal = gradient.magnitude > 0.0f ? octahedralEncode(gradient.dir) : glm::vec2(0.0f);
+        const glm::vec2 quantizedNormal = glm::round((normal * 0.5f + 0.5f) * maxNormal);
+        const CompactGradient<C> compact {
+            { C(quantizedNormal.x), C(quantizedNormal.y) },
+            uint16_t(std::min(std::round(gradient.magnitude / magnitudeScale), maxMagnitude))
+        };
+        std::memcpy(out.data() + (begin + size_t(i)) * sizeof(compact), &compact, sizeof(compact));
+    }
+}
+
+template <typename C>
+static GradientVoxel decodeGradient(const std::byte* pData, size_t index, float magnitudeScale)
+{
+    constexpr float maxNormal = float(std::numeric_limits<C>::max());
+    CompactGradient<C> compact;
+    std::memcpy(&compact, pData + index * sizeof(compact), sizeof(compact));
+    const float magnitude = float(compact.magnitude) * magnitudeScale;
+    const glm::vec2 normal = glm::vec2(float(compact.normal[0]), float(compact.normal[1])) * (2.0f / maxNormal) - 1.0f;
+    return { octahedralDecode(normal) * magnitude, magnitude };
+}
+
+// Compute the gradient at a voxel using central differences, reading the voxels with getVoxel(x, y, z). Voxels on the
+// border of the volume get a zero gradient.
+template <typename F>
+static GradientVoxel computeGradient(const glm::ivec3& dim, int x, int y, int z, F&& getVoxel)
+{
+    if (x < 1 || x >= dim.x - 1 || y < 1 || y >= dim.y - 1 || z < 1 || z >= dim.z - 1)
+        return { glm::vec3(0.0f), 0.0f };
+
+    const float gx = (getVoxel(x + 1, y, z) - getVoxel(x - 1, y, z)) / 2.0f;
+    const float gy = (getVoxel(x, y + 1, z) - getVoxel(x, y - 1, z)) / 2.0f;
+    const float gz = (getVoxel(x, y, z + 1) - getVoxel(x, y, z - 1)) / 2.0f;
+
+    const glm::vec3 v { gx, gy, gz };
+    return GradientVoxel { v, glm::length(v) };
+}
+
+// Compute the gradients [begin, begin + out.size()) in storage order (so that the apron of each brick is filled as
+// well) and return the range of their magnitudes.
+template <typename F>
+static MagnitudeRange computeGradientsInStorageOrder(const VoxelIndexer& indexer, const glm::ivec3& dim, size_t begin, gsl::span<GradientVoxel> out, F&& getVoxel)
+{
+    float minimum = std::numeric_limits<float>::max();
+    float maximum = 0.0f;
+#pragma omp parallel for schedule(static) reduction(min : minimum) reduction(max : maximum)
+    for (int64_t i = 0; i < int64_t(out.size()); i++) {
+        const glm::ivec3 p = indexer.position(begin + size_t(i));
+        const GradientVoxel gradient = computeGradient(dim, p.x, p.y, p.z, getVoxel);
+        out[size_t(i)] = gradient;
+        minimum = std::min(minimum, gradient.magnitude);
+        maximum = std::max(maximum, gradient.magnitude);
+    }
+    return { minimum, maximum };
+}
+
+template <typename T>
+static MagnitudeRange computeGradientsInStorageOrder(gsl::span<const std::byte> voxels, const VoxelIndexer& indexer, const glm::ivec3& dim, size_t begin, gsl::span<GradientVoxel> out)
+{
+    const std::byte* pVoxels = voxels.data();
+    return computeGradientsInStorageOrder(indexer, dim, begin, out, [&](int x, int y, int z) { return loadVoxel<T>(pVoxels, indexer.index(x, y, z)); });
+}
+
+// Central differences directly on the voxels of a volume in the linear layout. The slices are divided over the threads
+// in slabs of consecutive slices (schedule(static)), so the three slices that a row of gradients reads from are shared
+// with the neighbouring rows while they are in cache. The inner loop over a row has no branches (the border voxels are
+// written separately) and is vectorized. The magnitude range is reduced in the same pass; the zero gradients on the
+// border are part of it. Computes the slices that gradients [begin, begin + out.size()) consist of.
+template <typename T>
+static MagnitudeRange computeGradientsLinear(gsl::span<const std::byte> voxels, const glm::ivec3& dim, size_t begin, gsl::span<GradientVoxel> out)
+{
+    const GradientVoxel zero { glm::vec3(0.0f), 0.0f };
+    const std::byte* pVoxels = voxels.data();
+    const size_t strideY = size_t(dim.x);
+    const size_t strideZ = size_t(dim.x) * size_t(dim.y);
+    const auto zBegin = int(begin / strideZ);
+    const auto zEnd = int((begin + out.size()) / strideZ);
+
+    float minimum = std::numeric_limits<float>::max();
+    float maximum = 0.0f;
+#pragma omp parallel for schedule(static) reduction(min : minimum) reduction(max : maximum)
+    for (int z = zBegin; z < zEnd; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            const size_t row = size_t(y) * strideY + size_t(z) * strideZ;
+            GradientVoxel* pOut = out.data() + (row - begin);
+            minimum = std::min(minimum, zero.magnitude);
+            if (z < 1 || z >= dim.z - 1 || y < 1 || y >= dim.y - 1) {
+                std::fill(pOut, pOut + dim.x, zero);
+                continue;
+            }
+
+            pOut[0] = pOut[dim.x - 1] = zero;
+#pragma omp simd reduction(min : minimum) reduction(max : maximum)
+            for (int x = 1; x < dim.x - 1; x++) {
+                const size_t i = row + size_t(x);
+                const float gx = (loadVoxel<T>(pVoxels, i + 1) - loadVoxel<T>(pVoxels, i - 1)) / 2.0f;
+                const float gy = (loadVoxel<T>(pVoxels, i + strideY) - loadVoxel<T>(pVoxels, i - strideY)) / 2.0f;
+                const float gz = (loadVoxel<T>(pVoxels, i + strideZ) - loadVoxel<T>(pVoxels, i - strideZ)) / 2.0f;
+                const float magnitude = std::sqrt(gx * gx + gy * gy + gz * gz);
+                pOut[x] = GradientVoxel { glm::vec3(gx, gy, gz), magnitude };
+                minimum = std::min(minimum, magnitude);
+                maximum = std::max(maximum, magnitude);
             }
         }
     }
-    return out;
+    return { minimum, maximum };
 }
 
-GradientVolume::GradientVolume(const Volume& volume)
+// Compute gradients [begin, begin + out.size()) of a volume and return the range of their magnitudes. The gradients are
+// stored in the same layout as the voxels (see GradientVolume::m_indexer). In the linear layout the range must consist
+// of whole slices. Voxels that are in memory are read directly from the voxel storage, with the kernel above for the
+// linear layout. Out-of-core and compressed volumes are read through Volume::getVoxel.
+static MagnitudeRange computeGradientVolume(const Volume& volume, const VoxelIndexer& indexer, size_t begin, gsl::span<GradientVoxel> out)
+{
+    const glm::ivec3 dim = volume.dims();
+    const gsl::span<const std::byte> voxels = volume.voxels();
+    if (voxels.empty())
+        return computeGradientsInStorageOrder(indexer, dim, begin, out, [&](int x, int y, int z) { return volume.getVoxel(x, y, z); });
+
+    const bool linear = indexer.layout() == VoxelLayout::Linear;
+    switch (volume.voxelType()) {
+    case VoxelType::UInt8: {
+        return linear ? computeGradientsLinear<uint8_t>(voxels, dim, begin, out) : computeGradientsInStorageOrder<uint8_t>(voxels, indexer, dim, begin, out);
+    }
+    case VoxelType::UInt16: {
+        return linear ? computeGradientsLinear<uint16_t>(voxels, dim, begin, out) : computeGradientsInStorageOrder<uint16_t>(voxels, indexer, dim, begin, out);
+    }
+    case VoxelType::Float: {
+        return linear ? computeGradientsLinear<float>(voxels, dim, begin, out) : computeGradientsInStorageOrder<float>(voxels, indexer, dim, begin, out);
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
+GradientVolume::GradientVolume(const Volume& volume, GradientFormat format)
     : m_dim(volume.dims())
-    , m_data(computeGradientVolume(volume))
-    , m_minMagnitude(computeMinMagnitude(m_data))
-    , m_maxMagnitude(computeMaxMagnitude(m_data))
+    , m_indexer(format == GradientFormat::Lazy ? VoxelLayout::Bricked : volume.layout(), volume.dims())
+    , m_format(format)
+{
+    // The largest possible magnitude is that of the central differences between the minimum and maximum voxel value
+    // along all three axes.
+    const float maxPossibleMagnitude = std::sqrt(3.0f) / 2.0f * (volume.maximum() - volume.minimum());
+    m_magnitudeScale = maxPossibleMagnitude > 0.0f ? maxPossibleMagnitude / float(std::numeric_limits<uint16_t>::max()) : 1.0f;
+    if (m_format == GradientFormat::Octahedral8 || m_format == GradientFormat::Octahedral16)
+        m_compactData.resize(m_indexer.size() * compactGradientSize(m_format));
+
+    // The bricks of lazy gradients are computed when they are first sampled (see gradientAt). The magnitude range is not
+    // known before all bricks have been computed, so its bounds are used instead.
+    if (m_format == GradientFormat::Lazy) {
+        m_pVolume = &volume;
+        m_lazyBrickCount = m_indexer.size() / VoxelIndexer::storedBrickVoxels;
+        m_lazyBricks = std::make_unique<std::atomic<const GradientVoxel*>[]>(m_lazyBrickCount);
+        m_minMagnitude = 0.0f;
+        m_maxMagnitude = maxPossibleMagnitude;
+        return;
+    }
+
+    // A volume that was loaded from a cache file comes with its gradients, which are used in place (or encoded). So
+    // are the levels of the mip pyramid if the volume has the levels of the cache file (it has none if it did not build
+    // its pyramid).
+    if (auto pCache = volume.cache()) {
+        if (m_format == GradientFormat::Full)
+            m_data = pCache->gradients();
+        else
+            encode(pCache->gradients(), 0);
+        m_minMagnitude = pCache->minMagnitude();
+        m_maxMagnitude = pCache->maxMagnitude();
+        m_pCache = std::move(pCache);
+    } else {
+        computeGradients(volume);
+    }
+
+    const bool cachedMipLevels = m_pCache && m_pCache->mipLevelCount() == volume.mipLevelCount();
+    const GradientVolume* pLevel = this;
+    for (int level = 0; level < volume.mipLevelCount(); level++) {
+        if (cachedMipLevels)
+            m_mipLevels.push_back(std::unique_ptr<GradientVolume>(new GradientVolume(*m_pCache, level + 1, m_format, m_magnitudeScale)));
+        else
+            m_mipLevels.push_back(pLevel->createMipLevel());
+        pLevel = m_mipLevels.back().get();
+    }
+}
+
+void GradientVolume::update(const Volume& volume)
 {
+    if (m_pCache || volume.dims() != m_dim)
+        throw std::exception();
+
+    if (m_format == GradientFormat::Lazy) {
+        std::lock_guard lock { m_lazyMutex };
+        for (size_t brick = 0; brick < m_lazyBrickCount; brick++)
+            m_lazyBricks[brick].store(nullptr, std::memory_order_relaxed);
+        m_ownedLazyBricks.clear();
+        m_pVolume = &volume;
+        return;
+    }
+
+    computeGradients(volume);
+}
+
+GradientVolume::GradientVolume(const glm::ivec3& dim, std::vector<GradientVoxel> data, GradientFormat format, float magnitudeScale)
+    : m_dim(dim)
+    , m_indexer(VoxelLayout::Linear, dim)
+    , m_format(format)
+    , m_magnitudeScale(magnitudeScale)
+{
+    m_minMagnitude = computeMinMagnitude(data);
+    m_maxMagnitude = computeMaxMagnitude(data);
+    if (m_format == GradientFormat::Full) {
+        m_ownedData = std::move(data);
+        m_data = m_ownedData;
+    } else {
+        m_compactData.resize(data.size() * compactGradientSize(m_format));
+        encode(data, 0);
+    }
+}
+
+GradientVolume::GradientVolume(const VolumeCache& cache, int lod, GradientFormat format, float magnitudeScale)
+    : m_dim(cache.mipLevelDims(lod))
+    , m_indexer(VoxelLayout::Linear, m_dim)
+    , m_format(format)
+    , m_magnitudeScale(magnitudeScale)
+{
+    const auto gradients = cache.mipLevelGradients(lod);
+    m_minMagnitude = computeMinMagnitude(gradients);
+    m_maxMagnitude = computeMaxMagnitude(gradients);
+    if (m_format == GradientFormat::Full) {
+        m_data = gradients;
+    } else {
+        m_compactData.resize(gradients.size() * compactGradientSize(m_format));
+        encode(gradients, 0);
+    }
+}
+
+// Compute the gradients of level 0. Compact gradients are computed in chunks of whole slices that are encoded right
+// away, so the full gradients are never all in memory at the same time.
+void GradientVolume::computeGradients(const Volume& volume)
+{
+    MagnitudeRange magnitudeRange;
+    if (m_format == GradientFormat::Full) {
+        m_ownedData.resize(m_indexer.size());
+        magnitudeRange = computeGradientVolume(volume, m_indexer, 0, m_ownedData);
+        m_data = m_ownedData;
+    } else {
+        constexpr size_t chunkTarget = size_t(1) << 20;
+        const size_t sliceSize = m_indexer.layout() == VoxelLayout::Linear ? size_t(m_dim.x) * size_t(m_dim.y) : 1;
+        const size_t chunkSize = std::max(chunkTarget / sliceSize, size_t(1)) * sliceSize;
+        std::vector<GradientVoxel> chunk(std::min(chunkSize, m_indexer.size()));
+        magnitudeRange = { std::numeric_limits<float>::max(), 0.0f };
+        for (size_t begin = 0; begin < m_indexer.size(); begin += chunkSize) {
+            const gsl::span<GradientVoxel> gradients { chunk.data(), std::min(chunkSize, m_indexer.size() - begin) };
+            const MagnitudeRange chunkRange = computeGradientVolume(volume, m_indexer, begin, gradients);
+            encode(gradients, begin);
+            magnitudeRange.minimum = std::min(magnitudeRange.minimum, chunkRange.minimum);
+            magnitudeRange.maximum = std::max(magnitudeRange.maximum, chunkRange.maximum);
+        }
+    }
+    m_minMagnitude = magnitudeRange.minimum;
+    m_maxMagnitude = magnitudeRange.maximum;
+}
+
+void GradientVolume::encode(gsl::span<const GradientVoxel> gradients, size_t begin)
+{
+    switch (m_format) {
+    case GradientFormat::Octahedral8: {
+        encodeGradients<uint8_t>(gradients, m_magnitudeScale, begin, m_compactData);
+        break;
+    }
+    case GradientFormat::Octahedral16: {
+        encodeGradients<uint16_t>(gradients, m_magnitudeScale, begin, m_compactData);
+        break;
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
+GradientVoxel GradientVolume::gradientAt(size_t index) const
+{
+    switch (m_format) {
+    case GradientFormat::Full: {
+        return m_data[index];
+    }
+    case GradientFormat::Octahedral8: {
+        return decodeGradient<uint8_t>(m_compactData.data(), index, m_magnitudeScale);
+    }
+    case GradientFormat::Octahedral16: {
+        return decodeGradient<uint16_t>(m_compactData.data(), index, m_magnitudeScale);
+    }
+    case GradientFormat::Lazy: {
+        const size_t brick = index / VoxelIndexer::storedBrickVoxels;
+        const GradientVoxel* pBrick = m_lazyBricks[brick].load(std::memory_order_acquire);
+        if (!pBrick)
+            pBrick = computeLazyBrick(brick);
+        return pBrick[index % VoxelIndexer::storedBrickVoxels];
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
+// Compute the gradients of a brick (including its apron) for GradientFormat::Lazy. Like BrickCache::brick, the work is
+// done without holding the lock so other threads can keep sampling in the meantime. If another thread computed the same
+// brick first then its gradients are used and these are dropped.
+const GradientVoxel* GradientVolume::computeLazyBrick(size_t brick) const
+{
+    auto pGradients = std::make_unique<GradientVoxel[]>(VoxelIndexer::storedBrickVoxels);
+    const gsl::span<GradientVoxel> gradients { pGradients.get(), VoxelIndexer::storedBrickVoxels };
+    const Volume& volume = *m_pVolume;
+    computeGradientsInStorageOrder(m_indexer, m_dim, brick * VoxelIndexer::storedBrickVoxels, gradients, [&](int x, int y, int z) { return volume.getVoxel(x, y, z); });
+
+    std::lock_guard lock { m_lazyMutex };
+    if (const GradientVoxel* pBrick = m_lazyBricks[brick].load(std::memory_order_relaxed))
+        return pBrick;
+    m_lazyBricks[brick].store(pGradients.get(), std::memory_order_release);
+    m_ownedLazyBricks.push_back(std::move(pGradients));
+    return m_ownedLazyBricks.back().get();
+}
+
+// Downsample the gradients by averaging blocks of 2x2x2 voxels, in the same way as Volume::createMipLevel. The
+// directions and magnitudes are averaged separately (like linearInterpolate does), so the magnitudes of a level stay
+// comparable to those of level 0.
+std::unique_ptr<GradientVolume> GradientVolume::createMipLevel() const
+{
+    const glm::ivec3 levelDim = (m_dim + 1) / 2;
+    std::vector<GradientVoxel> data(size_t(levelDim.x) * size_t(levelDim.y) * size_t(levelDim.z));
+#pragma omp parallel for
+    for (int z = 0; z < levelDim.z; z++) {
+        for (int y = 0; y < levelDim.y; y++) {
+            for (int x = 0; x < levelDim.x; x++) {
+                GradientVoxel sum { glm::vec3(0.0f), 0.0f };
+                int count = 0;
+                for (int dz = 0; dz < 2; dz++) {
+                    for (int dy = 0; dy < 2; dy++) {
+                        for (int dx = 0; dx < 2; dx++) {
+                            const glm::ivec3 p { 2 * x + dx, 2 * y + dy, 2 * z + dz };
+                            if (glm::all(glm::lessThan(p, m_dim))) {
+                                const GradientVoxel gradient = getGradient(p.x, p.y, p.z);
+                                sum.dir += gradient.dir;
+                                sum.magnitude += gradient.magnitude;
+                                count++;
+                            }
+                        }
+                    }
+                }
+                const size_t index = size_t(x) + size_t(levelDim.x) * (size_t(y) + size_t(levelDim.y) * size_t(z));
+                data[index] = { sum.dir / float(count), sum.magnitude / float(count) };
+            }
+        }
+    }
+    return std::unique_ptr<GradientVolume>(new GradientVolume(levelDim, std::move(data), m_format, m_magnitudeScale));
 }
 
 float GradientVolume::maxMagnitude() const
@@ -76,6 +468,48 @@ glm::ivec3 GradientVolume::dims() const
     return m_dim;
 }
 
+VoxelLayout GradientVolume::layout() const
+{
+    return m_indexer.layout();
+}
+
+GradientFormat GradientVolume::format() const
+{
+    return m_format;
+}
+
+gsl::span<const GradientVoxel> GradientVolume::data() const
+{
+    return m_data;
+}
+
+size_t GradientVolume::byteSize() const
+{
+    size_t out = m_data.size() * sizeof(GradientVoxel) + m_compactData.size();
+    out += materializedBrickCount() * VoxelIndexer::storedBrickVoxels * sizeof(GradientVoxel);
+    for (const auto& pMipLevel : m_mipLevels)
+        out += pMipLevel->byteSize();
+    return out;
+}
+
+int GradientVolume::mipLevelCount() const
+{
+    return int(m_mipLevels.size());
+}
+
+const GradientVolume& GradientVolume::mipLevel(int lod) const
+{
+    if (lod <= 0 || m_mipLevels.empty())
+        return *this;
+    return *m_mipLevels[size_t(std::min(lod, mipLevelCount()) - 1)];
+}
+
+size_t GradientVolume::materializedBrickCount() const
+{
+    std::lock_guard lock { m_lazyMutex };
+    return m_ownedLazyBricks.size();
+}
+
 // This function returns a gradientVoxel at coord based on the current interpolation mode.
 GradientVoxel GradientVolume::getGradientInterpolate(const glm::vec3& coord) const
 {
@@ -96,11 +530,57 @@ GradientVoxel GradientVolume::getGradientInterpolate(const glm::vec3& coord) con
     };
 }
 
+// Interpolate the gradient in a coarser level of the mip pyramid (see Volume::getSampleInterpolate(coord, lod)).
+GradientVoxel GradientVolume::getGradientInterpolate(const glm::vec3& coord, int lod) const
+{
+    if (lod <= 0 || m_mipLevels.empty())
+        return getGradientInterpolate(coord);
+
+    const int level = std::min(lod, mipLevelCount());
+    const float scale = float(1 << level);
+    const glm::vec3 levelCoord = (coord + 0.5f) / scale - 0.5f;
+    const GradientVolume& mipLevel = *m_mipLevels[size_t(level - 1)];
+    switch (interpolationMode) {
+    case InterpolationMode::NearestNeighbour: {
+        return mipLevel.getGradientNearestNeighbor(levelCoord);
+    }
+    case InterpolationMode::Linear:
+    case InterpolationMode::Cubic: {
+        return mipLevel.getGradientLinearInterpolate(levelCoord);
+    }
+    default: {
+        throw std::exception();
+    }
+    };
+}
+
+void GradientVolume::sampleBatch(gsl::span<const glm::vec3> positions, gsl::span<GradientVoxel> out, SimdLevel simdLevel) const
+{
+    assert(out.size() == positions.size());
+#if defined(VOLUME_SIMD_KERNELS)
+    simdLevel = std::min(simdLevel, bestSimdLevel());
+    const bool vectorized = simdLevel != SimdLevel::Scalar && !positions.empty() && m_format == GradientFormat::Full && m_indexer.layout() == VoxelLayout::Linear
+        && m_data.size() <= size_t(std::numeric_limits<int>::max()) / 4;
+    if (vectorized) {
+        const bool avx512 = simdLevel == SimdLevel::AVX512;
+        const float* pGradients = &m_data[0].dir.x;
+        if (interpolationMode == InterpolationMode::NearestNeighbour)
+            (avx512 ? avx512::sampleGradientsNearest : avx2::sampleGradientsNearest)(pGradients, m_dim.x, m_dim.y, m_dim.z, &positions[0].x, positions.size(), &out[0].dir.x);
+        else
+            (avx512 ? avx512::sampleGradientsLinear : avx2::sampleGradientsLinear)(pGradients, m_dim.x, m_dim.y, m_dim.z, &positions[0].x, positions.size(), &out[0].dir.x);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < positions.size(); i++)
+        out[i] = getGradientInterpolate(positions[i]);
+}
+
 // This function returns the nearest neighbour given a position in the volume given by coord.
 // Notice that in this framework we assume that the distance between neighbouring voxels is 1 in all directions
 GradientVoxel GradientVolume::getGradientNearestNeighbor(const glm::vec3& coord) const
 {
-    if (glm::any(glm::lessThan(coord, glm::vec3(0))) || glm::any(glm::greaterThanEqual(coord, glm::vec3(m_dim))))
+    // Rounding to the nearest voxel must not leave the volume, so (like in Volume) check within 0.5 of the boundary.
+    if (glm::any(glm::lessThan(coord + 0.5f, glm::vec3(0))) || glm::any(glm::greaterThanEqual(coord + 0.5f, glm::vec3(m_dim))))
         return { glm::vec3(0.0f), 0.0f };
 
     auto roundToPositiveInt = [](float f) {
@@ -148,39 +628,34 @@ GradientVoxel GradientVolume::getGradientLinearInterpolate(const glm::vec3& coor
     // Since we are working with gradients we need to get the respective gradient for each of the cube corners points
     // the cube corners correspond to the combinations of the coordinates calculated aboce
 
+    // The corners are addressed relative to the lower corner of the cell (in the bricked layout they all lie in the same
+    // brick). Clamped coordinates (x1 == x0) on the border of the volume point back to the lower corner.
+    const VoxelCell cell = m_indexer.cell(x0, y0, z0);
+    const size_t dx = x1 != x0 ? cell.dx : 0;
+    const size_t dy = y1 != y0 ? cell.dy : 0;
+    const size_t dz = z1 != z0 ? cell.dz : 0;
+
     // LOWER PLANE
     //  - front side
-    GradientVoxel c000 = getGradient(x0, y0, z0);
-    GradientVoxel c100 = getGradient(x1, y0, z0);
-    
+    const GradientVoxel c000 = gradientAt(cell.base);
+    const GradientVoxel c100 = gradientAt(cell.base + dx);
+
     //  - back side
-    GradientVoxel c010 = getGradient(x0, y1, z0);
-    GradientVoxel c110 = getGradient(x1, y1, z0);
+    const GradientVoxel c010 = gradientAt(cell.base + dy);
+    const GradientVoxel c110 = gradientAt(cell.base + dx + dy);
 
     // UPPER PLANE
     //  - front side
-    GradientVoxel c001 = getGradient(x0, y0, z1);
-    GradientVoxel c101 = getGradient(x1, y0, z1);
+    const GradientVoxel c001 = gradientAt(cell.base + dz);
+    const GradientVoxel c101 = gradientAt(cell.base + dx + dz);
 
     //  - back side
-    GradientVoxel c011 = getGradient(x0, y1, z1);
-    GradientVoxel c111 = getGradient(x1, y1, z1);
+    const GradientVoxel c011 = gradientAt(cell.base + dy + dz);
+    const GradientVoxel c111 = gradientAt(cell.base + dx + dy + dz);
 
     // INTERPOLATING
-    // First we interpolate along x
-    GradientVoxel c00 = linearInterpolate(c000, c100, xd);
-    GradientVoxel c01 = linearInterpolate(c001, c101, xd);
-    GradientVoxel c10 = linearInterpolate(c010, c110, xd);
-    GradientVoxel c11 = linearInterpolate(c011, c111, xd);
-
-    // Then we interpolate along y
-    GradientVoxel c0 = linearInterpolate(c00, c10, yd);
-    GradientVoxel c1 = linearInterpolate(c01, c11, yd);
-
-    // And then z
-    GradientVoxel c = linearInterpolate(c0, c1, zd);
-
-    return c;
+    // Along x, y and z at once (up to rounding the same as calling linearInterpolate along x, then y and then z).
+    return interpolateCell({ c000, c100, c010, c110, c001, c101, c011, c111 }, glm::vec3(xd, yd, zd));
 }
 
 // ======= TODO : IMPLEMENT ========
@@ -196,7 +671,6 @@ GradientVoxel GradientVolume::linearInterpolate(const GradientVoxel& g0, const G
 // This function returns a gradientVoxel without using interpolation
 GradientVoxel GradientVolume::getGradient(int x, int y, int z) const
 {
-    const size_t i = static_cast<size_t>(x + m_dim.x * (y + m_dim.y * z));
-    return m_data[i];
+    return gradientAt(m_indexer.index(x, y, z));
 }
 }
\ No newline at end of file
@@ -1,7 +1,16 @@
 #pragma once
+#include "load_config.h"
 #include "volume.h"
+#include "voxel_layout.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <glm/common.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <gsl/span>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -11,29 +20,112 @@ struct GradientVoxel {
     float magnitude;
 };
 
+// Trilinearly interpolate the gradients at the corners of a cell, where corners[i + 2 * j + 4 * k] is the corner at
+// offset (i, j, k) and t is the position inside the cell.
+GradientVoxel interpolateCell(const std::array<GradientVoxel, 8>& corners, const glm::vec3& t);
+
 class GradientVolume {
 public:
     // DO NOT REMOVE
     InterpolationMode interpolationMode { InterpolationMode::NearestNeighbour };
 
 public:
-    GradientVolume(const Volume& volume);
+    // With GradientFormat::Lazy the gradients are computed from volume while they are sampled, so volume must outlive
+    // the gradient volume. Lazy gradient volumes have no mip pyramid (coarser levels are sampled from level 0).
+    GradientVolume(const Volume& volume, GradientFormat format = GradientFormat::Full);
+
+    // Recompute the gradients in place after the voxels of volume (which this gradient volume was computed from) were
+    // changed, see Volume::readVoxels. Only the gradients of level 0 are updated, not those of the mip pyramid. Lazy
+    // gradients are discarded and computed again (from volume) when they are sampled.
+    void update(const Volume& volume);
 
     GradientVoxel getGradientInterpolate(const glm::vec3& coord) const;
+    // Interpolate the gradient in level lod of the mip pyramid (see Volume::getSampleInterpolate(coord, lod)).
+    GradientVoxel getGradientInterpolate(const glm::vec3& coord, int lod) const;
+    // Sample many positions at once: out[i] = getGradientInterpolate(positions[i]). Like Volume::sampleBatch, full
+    // gradients in the linear layout are sampled 8 or 16 positions at a time; other formats one by one.
+    void sampleBatch(gsl::span<const glm::vec3> positions, gsl::span<GradientVoxel> out, SimdLevel simdLevel = bestSimdLevel()) const;
     GradientVoxel getGradient(int x, int y, int z) const;
 
+    // Lazy gradient volumes return the bounds of the range instead: 0 and the largest possible magnitude.
     float minMagnitude() const;
     float maxMagnitude() const;
     glm::ivec3 dims() const;
+    // The layout of the volume the gradients were computed from, or VoxelLayout::Bricked for lazy gradients.
+    VoxelLayout layout() const;
+    GradientFormat format() const;
+    // The gradients in storage order. Empty for the compact and lazy formats, whose gradients are only available through
+    // getGradient.
+    gsl::span<const GradientVoxel> data() const;
+    // Memory used by the gradients, including those of the mip pyramid.
+    size_t byteSize() const;
+    // The gradient volume has as many mip levels as the volume it was computed from.
+    int mipLevelCount() const;
+    // The level of the mip pyramid that getGradientInterpolate(coord, lod) samples (see Volume::mipLevel).
+    const GradientVolume& mipLevel(int lod) const;
+    // Number of bricks whose gradients have been computed so far (always 0 unless the format is GradientFormat::Lazy).
+    size_t materializedBrickCount() const;
 
 protected:
     GradientVoxel getGradientNearestNeighbor(const glm::vec3& coord) const;
     GradientVoxel getGradientLinearInterpolate(const glm::vec3& coord) const;
     static GradientVoxel linearInterpolate(const GradientVoxel& g0, const GradientVoxel& g1, float factor);
 
+private:
+    // Constructor for the levels of the mip pyramid (gradients in scanline order, stored in the given format).
+    GradientVolume(const glm::ivec3& dim, std::vector<GradientVoxel> data, GradientFormat format, float magnitudeScale);
+    // Constructor for the levels of the mip pyramid that are stored in the cache file (see
+    // VolumeCache::mipLevelGradients), which are used in place. The gradient volume of level 0 keeps the file mapped.
+    GradientVolume(const VolumeCache& cache, int lod, GradientFormat format, float magnitudeScale);
+
+    std::unique_ptr<GradientVolume> createMipLevel() const;
+    void computeGradients(const Volume& volume);
+    // Encode gradients [begin, begin + gradients.size()) into m_compactData.
+    void encode(gsl::span<const GradientVoxel> gradients, size_t begin);
+    // The gradient at the given index in storage order, decoded (or computed) if needed.
+    GradientVoxel gradientAt(size_t index) const;
+    const GradientVoxel* computeLazyBrick(size_t brick) const;
+
 protected:
     const glm::ivec3 m_dim;
-    const std::vector<GradientVoxel> m_data;
-    const float m_minMagnitude, m_maxMagnitude;
+    // Gradients are stored in the same layout as the voxels of the volume they were computed from.
+    const VoxelIndexer m_indexer;
+    // Points to m_ownedData, or into the cache file that the volume was loaded from (which m_pCache keeps mapped).
+    gsl::span<const GradientVoxel> m_data;
+    std::vector<GradientVoxel> m_ownedData;
+    std::shared_ptr<const VolumeCache> m_pCache;
+    const GradientFormat m_format;
+    // Gradients in a compact format (m_data is empty then), see GradientFormat. The quantized magnitudes are multiples
+    // of m_magnitudeScale.
+    std::vector<std::byte> m_compactData;
+    float m_magnitudeScale { 1.0f };
+    float m_minMagnitude, m_maxMagnitude;
+    // GradientFormat::Lazy: the gradients are stored in the bricked layout and m_lazyBricks[i] points to the gradients of
+    // brick i once they have been computed from m_pVolume (nullptr before that). The gradients are owned by
+    // m_ownedLazyBricks, which is protected by m_lazyMutex.
+    const Volume* m_pVolume { nullptr };
+    std::unique_ptr<std::atomic<const GradientVoxel*>[]> m_lazyBricks;
+    size_t m_lazyBrickCount { 0 };
+    mutable std::mutex m_lazyMutex;
+    mutable std::vector<std::unique_ptr<GradientVoxel[]>> m_ownedLazyBricks;
+    // Level i + 1 of the mip pyramid is stored in m_mipLevels[i] (in the linear layout).
+    std::vector<std::unique_ptr<GradientVolume>> m_mipLevels;
 };
+
+// The batched SIMD kernels (see sampleBatch) and the cache file treat a GradientVoxel (direction followed by magnitude)
+// as four consecutive floats.
+static_assert(sizeof(GradientVoxel) == 4 * sizeof(float) && offsetof(GradientVoxel, magnitude) == 3 * sizeof(float));
+
+// Called for every interpolated gradient so it is defined in the header to allow inlining. All channels are
+// interpolated along x, then y and then z (like calling GradientVolume::linearInterpolate seven times), which the
+// compiler vectorizes on its own; hand-written SSE/AVX versions were not faster.
+inline GradientVoxel interpolateCell(const std::array<GradientVoxel, 8>& corners, const glm::vec3& t)
+{
+    auto mixGradients = [](const GradientVoxel& g0, const GradientVoxel& g1, float factor) {
+        return GradientVoxel { glm::mix(g0.dir, g1.dir, factor), glm::mix(g0.magnitude, g1.magnitude, factor) };
+    };
+    const GradientVoxel c0 = mixGradients(mixGradients(corners[0], corners[1], t.x), mixGradients(corners[2], corners[3], t.x), t.y);
+    const GradientVoxel c1 = mixGradients(mixGradients(corners[4], corners[5], t.x), mixGradients(corners[6], corners[7], t.x), t.y);
+    return mixGradients(c0, c1, t.z);
+}
 }
@@ -0,0 +1,84 @@
+#pragma once
+#include "voxel_layout.h"
+#include <cstddef>
+#include <glm/vec3.hpp>
+#include <limits>
+
+namespace volume {
+
+enum class DownsampleFilter {
+    Stride, // Keep the first voxel of every block.
+    BoxFilter // Average all voxels of every block.
+};
+
+// Storage of the gradient volume (see GradientVolume). The compact formats store the direction as a unit normal that is
+// octahedral encoded (the unit sphere is mapped onto an octahedron which is unfolded into a square) with 8 or 16 bits
+// per coordinate, and the magnitude quantized to 16 bits. They are decoded when the gradients are sampled, which makes
+// a sample of a compact gradient about 2-2.5x as expensive as one of a full gradient (see the "Gradient interpolation
+// performance" benchmark); renders that sample a gradient per step rather than per ray are slower accordingly.
+enum class GradientFormat {
+    Full, // GradientVoxel: a vec3 direction and a float magnitude (16 bytes).
+    Octahedral8, // 2x8-bit normal + 16-bit magnitude (4 bytes).
+    Octahedral16, // 2x16-bit normal + 16-bit magnitude (6 bytes).
+    Lazy // Full gradients that are computed per brick, the first time that a gradient in the brick is sampled.
+};
+
+// When to build a mip pyramid: a chain of levels that each have half the resolution of the previous one (see
+// Volume::getSampleInterpolate(coord, lod)). The pyramid takes about 1/7th of the memory of the volume itself.
+enum class MipPyramid {
+    Never,
+    // Only for volumes whose voxels are in memory: read from the volume file, loaded from the cache file (which stores
+    // the pyramid) or constructed from memory. Volumes that are loaded out-of-core or compressed are sampled at full
+    // resolution only.
+    LoadedVoxels,
+    // Also for volumes that are loaded out-of-core (which reads the file once more, and keeps the levels in memory
+    // outside of the brick cache budget) or compressed.
+    Always
+};
+
+// Settings that control how the voxels of a volume are kept in memory. The file related settings are ignored for
+// volumes that are constructed from memory.
+struct LoadConfig {
+    VoxelLayout layout { VoxelLayout::Linear };
+
+    // Out-of-core loading for volumes that do not fit in memory. The voxels stay on disk and are paged in brick by
+    // brick (see BrickCache) while at most brickCacheBudget bytes of bricks are kept in memory. The bricks form their
+    // own layout, so the layout setting above is ignored in this mode.
+    bool outOfCore { false };
+    size_t brickCacheBudget { size_t(1) << 30 };
+
+    // Keep the voxels compressed in memory (see CompressedBricks) and decode them when they are sampled. The voxels are
+    // stored in the bricked layout in this mode.
+    bool compressed { false };
+
+    MipPyramid mipPyramid { MipPyramid::LoadedVoxels };
+
+    // Load the volume from its preprocessed cache file (see VolumeCache) if there is an up-to-date one, and write the
+    // cache file after loading otherwise. Not used for out-of-core or compressed volumes.
+    bool useCacheFile { true };
+
+    // Compute a gradient volume at all. Without one the renderer estimates the gradients from the voxels where it needs
+    // them (see render::Renderer), which saves the memory and the time to compute the gradient volume. Ignored for
+    // out-of-core volumes, whose gradient volume (in memory) would be several times larger than the volume itself.
+    bool precomputeGradients { true };
+    // Storage of the gradient volume that is computed for the volume. Compact gradients are not written to the cache file
+    // (they are encoded from the full gradients in a cache file that already exists). Lazy gradients are neither written
+    // to nor read from the cache file.
+    GradientFormat gradientFormat { GradientFormat::Full };
+
+    // Only load the voxels in the box [cropMin, cropMax) (in voxels of the file; the box is clamped to the volume) and
+    // reduce the resolution by downsampleFactor along every axis, i.e. every voxel of the result covers a block of
+    // downsampleFactor^3 voxels of the file. Both are applied while streaming through the file: rows and slices that
+    // do not contribute are skipped with seeks, so memory use and I/O scale with the region rather than the file.
+    // Such sub-volumes are always loaded into memory (outOfCore is ignored) and do not use the cache file.
+    glm::ivec3 cropMin { 0 };
+    glm::ivec3 cropMax { std::numeric_limits<int>::max() };
+    int downsampleFactor { 1 };
+    DownsampleFilter downsampleFilter { DownsampleFilter::Stride };
+
+    bool loadsSubVolume() const
+    {
+        return cropMin != glm::ivec3(0) || cropMax != glm::ivec3(std::numeric_limits<int>::max()) || downsampleFactor > 1;
+    }
+};
+}
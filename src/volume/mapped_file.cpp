@@ -0,0 +1,102 @@
+#include "mapped_file.h"
+#include <utility>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace volume {
+
+// Map the whole file into (virtual) memory. If anything goes wrong the object is left in an unopened state, which
+// the caller can check with isOpen().
+MappedFile::MappedFile(const std::filesystem::path& file)
+{
+#ifdef _WIN32
+    HANDLE fileHandle = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(fileHandle, &fileSize) && fileSize.QuadPart > 0) {
+        HANDLE mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mappingHandle) {
+            // The view keeps the file mapping alive, so both handles can be closed right away.
+            if (void* pView = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0)) {
+                m_pData = static_cast<const std::byte*>(pView);
+                m_size = static_cast<size_t>(fileSize.QuadPart);
+            }
+            CloseHandle(mappingHandle);
+        }
+    }
+    CloseHandle(fileHandle);
+#else
+    const int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0) {
+        const size_t size = static_cast<size_t>(fileStat.st_size);
+        // The mapping keeps a reference to the file, so the file descriptor can be closed right away.
+        void* pView = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (pView != MAP_FAILED) {
+            m_pData = static_cast<const std::byte*>(pView);
+            m_size = size;
+        }
+    }
+    close(fd);
+#endif
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : m_pData(std::exchange(other.m_pData, nullptr))
+    , m_size(std::exchange(other.m_size, 0))
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other) {
+        unmap();
+        m_pData = std::exchange(other.m_pData, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+bool MappedFile::isOpen() const
+{
+    return m_pData != nullptr;
+}
+
+gsl::span<const std::byte> MappedFile::bytes() const
+{
+    return { m_pData, m_size };
+}
+
+void MappedFile::unmap()
+{
+    if (!m_pData)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_pData);
+#else
+    munmap(const_cast<std::byte*>(m_pData), m_size);
+#endif
+    m_pData = nullptr;
+    m_size = 0;
+}
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <gsl/span>
+
+namespace volume {
+
+// Read-only memory mapping of an entire file. Pages are only loaded by the OS when they are accessed, so opening
+// even a very large file is cheap. The mapping stays valid (and at the same address) for the lifetime of the object.
+class MappedFile {
+public:
+    MappedFile(const std::filesystem::path& file);
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool isOpen() const;
+    gsl::span<const std::byte> bytes() const;
+
+private:
+    void unmap();
+
+private:
+    const std::byte* m_pData { nullptr };
+    size_t m_size { 0 };
+};
+}
@@ -0,0 +1,73 @@
+#include "min_max_grid.h"
+#include <algorithm>
+#include <cstdint>
+#include <glm/common.hpp>
+#include <glm/vec3.hpp>
+#include <limits>
+#include <vector>
+
+namespace volume {
+
+MinMaxGrid::MinMaxGrid(const Volume& volume)
+{
+    const glm::ivec3 dim = volume.dims();
+    m_dims = (dim + (brickSize - 1)) / brickSize;
+
+    // First the ranges of the voxels in blocks of half a brick, which each voxel is read for once. The range of a brick
+    // then combines the blocks of the brick and the blocks next to it, which cover the voxels two beyond the brick.
+    constexpr int blockSize = brickSize / 2;
+    const glm::ivec3 blockDims = (dim + (blockSize - 1)) / blockSize;
+    std::vector<ValueRange> blocks(size_t(blockDims.x) * size_t(blockDims.y) * size_t(blockDims.z));
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t i = 0; i < int64_t(blocks.size()); i++) {
+        const glm::ivec3 block {
+            int(size_t(i) % size_t(blockDims.x)),
+            int(size_t(i) / size_t(blockDims.x) % size_t(blockDims.y)),
+            int(size_t(i) / (size_t(blockDims.x) * size_t(blockDims.y)))
+        };
+        const glm::ivec3 begin = block * blockSize;
+        const glm::ivec3 end = glm::min(begin + blockSize, dim);
+        ValueRange range { std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() };
+        for (int z = begin.z; z < end.z; z++) {
+            for (int y = begin.y; y < end.y; y++) {
+                for (int x = begin.x; x < end.x; x++) {
+                    const float voxel = volume.getVoxel(x, y, z);
+                    range.minimum = std::min(range.minimum, voxel);
+                    range.maximum = std::max(range.maximum, voxel);
+                }
+            }
+        }
+        blocks[size_t(i)] = range;
+    }
+
+    m_ranges.resize(size_t(m_dims.x) * size_t(m_dims.y) * size_t(m_dims.z));
+#pragma omp parallel for
+    for (int64_t i = 0; i < int64_t(m_ranges.size()); i++) {
+        const glm::ivec3 brick {
+            int(size_t(i) % size_t(m_dims.x)),
+            int(size_t(i) / size_t(m_dims.x) % size_t(m_dims.y)),
+            int(size_t(i) / (size_t(m_dims.x) * size_t(m_dims.y)))
+        };
+        const glm::ivec3 beginBlock = glm::max(brick * 2 - 1, glm::ivec3(0));
+        const glm::ivec3 endBlock = glm::min(brick * 2 + 3, blockDims);
+        ValueRange range { std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() };
+        for (int z = beginBlock.z; z < endBlock.z; z++) {
+            for (int y = beginBlock.y; y < endBlock.y; y++) {
+                for (int x = beginBlock.x; x < endBlock.x; x++) {
+                    const ValueRange& block = blocks[size_t(x) + size_t(blockDims.x) * (size_t(y) + size_t(blockDims.y) * size_t(z))];
+                    range.minimum = std::min(range.minimum, block.minimum);
+                    range.maximum = std::max(range.maximum, block.maximum);
+                }
+            }
+        }
+        // Samples that lie (or read voxels) outside of the volume are zero.
+        const glm::ivec3 lower = brick * brickSize - 2;
+        const glm::ivec3 upper = (brick + 1) * brickSize + 2;
+        if (lower.x < 0 || lower.y < 0 || lower.z < 0 || upper.x > dim.x - 1 || upper.y > dim.y - 1 || upper.z > dim.z - 1) {
+            range.minimum = std::min(range.minimum, 0.0f);
+            range.maximum = std::max(range.maximum, 0.0f);
+        }
+        m_ranges[size_t(i)] = range;
+    }
+}
+}
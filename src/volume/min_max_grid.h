@@ -0,0 +1,132 @@
+#pragma once
+#include "volume.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/vec3.hpp>
+#include <limits>
+#include <vector>
+
+namespace volume {
+
+// The range of the values in a region of a volume.
+struct ValueRange {
+    float minimum;
+    float maximum;
+};
+
+// Conservative value ranges of the bricks of brickSize^3 voxels of a volume, for skipping the parts of a ray that
+// cannot contain a value of interest (see BrickTraversal and render::Renderer::traceRayISO). The range of a brick
+// bounds every sample (in any interpolation mode) at the positions inside of it: it includes the voxels up to two
+// beyond the brick on every side, which cubic interpolation reads, and zero for the bricks at the borders of the volume
+// where the samples become zero. The ranges do not depend on the value that is looked for, so the grid only has to be
+// built once per volume.
+class MinMaxGrid {
+public:
+    static constexpr int brickSize = 8;
+
+public:
+    explicit MinMaxGrid(const Volume& volume);
+
+    // Number of bricks along every axis.
+    glm::ivec3 dims() const;
+    // The brick must lie inside of the grid.
+    const ValueRange& range(const glm::ivec3& brick) const;
+
+private:
+    glm::ivec3 m_dims;
+    // The range of brick (x, y, z) is stored at x + m_dims.x * (y + m_dims.y * z).
+    std::vector<ValueRange> m_ranges;
+};
+
+// Walks through the bricks of a MinMaxGrid that a ray passes, one brick boundary at a time (a 3D DDA), to find the
+// parts of the ray that only pass bricks whose values all lie below a given value. Like RaySampler it is meant to be
+// used by one ray.
+class BrickTraversal {
+public:
+    // The origin and direction of the ray are in voxels of the volume that the grid was built from; the traversal
+    // starts at distance t along the ray.
+    BrickTraversal(const MinMaxGrid& grid, const glm::vec3& origin, const glm::vec3& direction, float t);
+
+    // The distance (of at least t) at which the ray enters the first brick that may contain a value of at least value,
+    // or t itself if the ray is in such a brick at t. Bricks outside of the grid may contain any value. The distances
+    // must not decrease from one call to the next.
+    float skipBelow(float t, float value);
+
+private:
+    bool isBelow(float value) const;
+    // The distance at which the ray leaves the current brick, and move on to the brick that it enters there.
+    float exitDistance() const;
+    void step();
+
+    const MinMaxGrid& m_grid;
+    glm::ivec3 m_brick;
+    glm::ivec3 m_step { 0 };
+    // Distance at which the ray crosses the next brick boundary along every axis, and between the boundaries.
+    glm::vec3 m_tNext { std::numeric_limits<float>::infinity() };
+    glm::vec3 m_tDelta { std::numeric_limits<float>::infinity() };
+};
+
+inline glm::ivec3 MinMaxGrid::dims() const
+{
+    return m_dims;
+}
+
+inline const ValueRange& MinMaxGrid::range(const glm::ivec3& brick) const
+{
+    return m_ranges[size_t(brick.x) + size_t(m_dims.x) * (size_t(brick.y) + size_t(m_dims.y) * size_t(brick.z))];
+}
+
+inline BrickTraversal::BrickTraversal(const MinMaxGrid& grid, const glm::vec3& origin, const glm::vec3& direction, float t)
+    : m_grid(grid)
+{
+    const glm::vec3 pos = origin + t * direction;
+    const float brickSize = float(MinMaxGrid::brickSize);
+    for (int axis = 0; axis < 3; axis++) {
+        m_brick[axis] = static_cast<int>(std::floor(pos[axis] / brickSize));
+        if (direction[axis] > 0.0f) {
+            m_step[axis] = 1;
+            m_tNext[axis] = (float(m_brick[axis] + 1) * brickSize - origin[axis]) / direction[axis];
+            m_tDelta[axis] = brickSize / direction[axis];
+        } else if (direction[axis] < 0.0f) {
+            m_step[axis] = -1;
+            m_tNext[axis] = (float(m_brick[axis]) * brickSize - origin[axis]) / direction[axis];
+            m_tDelta[axis] = -brickSize / direction[axis];
+        }
+    }
+}
+
+inline float BrickTraversal::skipBelow(float t, float value)
+{
+    // The brick at distance t. Near a brick boundary this may be the brick on the other side of it (due to rounding),
+    // which is fine because the ranges of the bricks include the voxels two beyond them.
+    while (exitDistance() <= t)
+        step();
+    while (isBelow(value)) {
+        t = exitDistance();
+        if (std::isinf(t))
+            return t;
+        step();
+    }
+    return t;
+}
+
+inline bool BrickTraversal::isBelow(float value) const
+{
+    const glm::ivec3 dims = m_grid.dims();
+    if (m_brick.x < 0 || m_brick.y < 0 || m_brick.z < 0 || m_brick.x >= dims.x || m_brick.y >= dims.y || m_brick.z >= dims.z)
+        return false;
+    return m_grid.range(m_brick).maximum < value;
+}
+
+inline float BrickTraversal::exitDistance() const
+{
+    return std::min(m_tNext.x, std::min(m_tNext.y, m_tNext.z));
+}
+
+inline void BrickTraversal::step()
+{
+    const int axis = m_tNext.x <= m_tNext.y ? (m_tNext.x <= m_tNext.z ? 0 : 2) : (m_tNext.y <= m_tNext.z ? 1 : 2);
+    m_brick[axis] += m_step[axis];
+    m_tNext[axis] += m_tDelta[axis];
+}
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include "volume.h"
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <glm/vec3.hpp>
+#include <limits>
+
+namespace volume {
+
+// Samples a volume at a sequence of nearby positions, such as the samples along a ray, with the same results as
+// Volume::getSampleInterpolate(coord, lod). With nearest neighbour and linear interpolation it keeps the last voxel or
+// the corners of the last cell that it sampled, so a sample that lands on the same voxel or in the same cell as the
+// previous one (as most do for steps smaller than a voxel) does not fetch the voxels again. A sampler is meant to be used by one ray (on one thread).
+class RaySampler {
+public:
+    RaySampler(const Volume& volume, int lod);
+
+    // Sample with the interpolation mode of the volume.
+    float sample(const glm::vec3& coord);
+    // Sample with a fixed interpolation mode (see Volume::getSampleInterpolate<mode>).
+    template <InterpolationMode mode>
+    float sample(const glm::vec3& coord);
+
+private:
+    const Volume& m_volume;
+    int m_lod;
+    // Level of the mip pyramid that is sampled, and the number of voxels of the volume per voxel of that level.
+    const Volume& m_level;
+    float m_scale;
+    glm::ivec3 m_dim;
+
+    // The cell whose corners are in m_corners, or the voxel in m_corners[0] with nearest neighbour interpolation (none
+    // yet at the start).
+    glm::ivec3 m_cell { std::numeric_limits<int>::min() };
+    std::array<float, 8> m_corners {};
+};
+
+// The interface of RaySampler without keeping any voxels: every sample calls Volume::getSampleInterpolate(coord, lod).
+// For steps of a voxel or more, where consecutive samples hardly ever share a cell, this saves the cell compares and
+// copies of RaySampler.
+class VolumeSampler {
+public:
+    VolumeSampler(const Volume& volume, int lod);
+
+    float sample(const glm::vec3& coord) const;
+    template <InterpolationMode mode>
+    float sample(const glm::vec3& coord) const;
+
+private:
+    const Volume& m_volume;
+    int m_lod;
+};
+
+inline RaySampler::RaySampler(const Volume& volume, int lod)
+    : m_volume(volume)
+    , m_lod(lod)
+    , m_level(volume.mipLevel(lod))
+    , m_scale(float(1 << (lod <= 0 || volume.mipLevelCount() == 0 ? 0 : std::min(lod, volume.mipLevelCount()))))
+    , m_dim(m_level.dims())
+{
+}
+
+inline float RaySampler::sample(const glm::vec3& coord)
+{
+    switch (m_volume.interpolationMode) {
+    case InterpolationMode::NearestNeighbour: {
+        return sample<InterpolationMode::NearestNeighbour>(coord);
+    }
+    case InterpolationMode::Linear: {
+        return sample<InterpolationMode::Linear>(coord);
+    }
+    case InterpolationMode::Cubic: {
+        return sample<InterpolationMode::Cubic>(coord);
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
+template <InterpolationMode mode>
+inline float RaySampler::sample(const glm::vec3& coord)
+{
+    if constexpr (mode == InterpolationMode::Cubic) {
+        return m_volume.getSampleInterpolate<mode>(coord, m_lod);
+    } else if constexpr (mode == InterpolationMode::NearestNeighbour) {
+        // The same coordinates, bounds and rounding as Volume::getSampleNearestNeighbourInterpolation on the level.
+        const glm::vec3 levelCoord = &m_level == &m_volume ? coord : (coord + 0.5f) / m_scale - 0.5f;
+        const glm::vec3 shifted = levelCoord + 0.5f;
+        if (shifted.x < 0.0f || shifted.x >= float(m_dim.x) || shifted.y < 0.0f || shifted.y >= float(m_dim.y) || shifted.z < 0.0f || shifted.z >= float(m_dim.z))
+            return 0.0f;
+
+        const glm::ivec3 voxel { static_cast<int>(shifted.x), static_cast<int>(shifted.y), static_cast<int>(shifted.z) };
+        if (voxel != m_cell) {
+            m_corners[0] = m_level.getVoxel(voxel.x, voxel.y, voxel.z);
+            m_cell = voxel;
+        }
+        return m_corners[0];
+    } else {
+        // The same coordinates, bounds and interpolation as Volume::getSampleTriLinearInterpolation on the level.
+        const glm::vec3 levelCoord = &m_level == &m_volume ? coord : (coord + 0.5f) / m_scale - 0.5f;
+        if (levelCoord.x < 0.0f || levelCoord.x >= float(m_dim.x - 1) || levelCoord.y < 0.0f || levelCoord.y >= float(m_dim.y - 1) || levelCoord.z < 0.0f || levelCoord.z >= float(m_dim.z - 1))
+            return 0.0f;
+
+        const glm::ivec3 cell { static_cast<int>(levelCoord.x), static_cast<int>(levelCoord.y), static_cast<int>(levelCoord.z) };
+        if (cell != m_cell) {
+            m_corners = m_level.getCellCorners(cell.x, cell.y, cell.z);
+            m_cell = cell;
+        }
+        return interpolateCell(m_corners, levelCoord - glm::vec3(cell));
+    }
+}
+
+inline VolumeSampler::VolumeSampler(const Volume& volume, int lod)
+    : m_volume(volume)
+    , m_lod(lod)
+{
+}
+
+inline float VolumeSampler::sample(const glm::vec3& coord) const
+{
+    return m_volume.getSampleInterpolate(coord, m_lod);
+}
+
+template <InterpolationMode mode>
+inline float VolumeSampler::sample(const glm::vec3& coord) const
+{
+    return m_volume.getSampleInterpolate<mode>(coord, m_lod);
+}
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+
+// Kernels behind Volume::sampleBatch and GradientVolume::sampleBatch. They are compiled once per instruction set
+// (sample_batch_avx2.cpp and sample_batch_avx512.cpp are built with the matching compiler flags, see
+// src/CMakeLists.txt) and selected at runtime with bestSimdLevel. Their interface only uses plain pointers: an inline
+// function (of the standard library, glm or gsl) that is instantiated in one of those translation units may be
+// compiled with the wider instructions, and the linker is free to use that copy in the rest of the program.
+namespace volume {
+
+// Voxels in the linear layout. elementSize is 1 (uint8_t), 2 (uint16_t) or 4 (float). The byte offsets of all voxels
+// fit in an int (so the kernels can use 32-bit gather indices) and there are at least 2 voxels along every axis.
+struct BatchVoxels {
+    const std::byte* pVoxels;
+    size_t byteSize;
+    size_t elementSize;
+    int dimX, dimY, dimZ;
+};
+
+// Fractional bits of the interpolation factors of Volume::getSampleTriLinearFixedPoint (and sampleLinearFixedPoint).
+constexpr int fixedPointFactorBits = 14;
+
+// The positions are count vec3's and the gradients are GradientVoxels (both as consecutive floats). The kernels
+// produce the same samples as Volume::getSampleInterpolate and GradientVolume::getGradientInterpolate (in the nearest
+// neighbour and linear modes); the gradient kernels require the full format in the linear layout. sampleLinearFixedPoint
+// produces the samples of Volume::getSampleTriLinearFixedPoint and requires uint8 or uint16 voxels.
+namespace avx2 {
+    void sampleNearest(const BatchVoxels& voxels, const float* pPositions, size_t count, float* pOut);
+    void sampleLinear(const BatchVoxels& voxels, const float* pPositions, size_t count, float* pOut);
+    void sampleLinearFixedPoint(const BatchVoxels& voxels, const float* pPositions, size_t count, float* pOut);
+    void sampleGradientsNearest(const float* pGradients, int dimX, int dimY, int dimZ, const float* pPositions, size_t count, float* pOut);
+    void sampleGradientsLinear(const float* pGradients, int dimX, int dimY, int dimZ, const float* pPositions, size_t count, float* pOut);
+}
+namespace avx512 {
+    void sampleNearest(const BatchVoxels& voxels, const float* pPositions, size_t count, float* pOut);
+    void sampleLinear(const BatchVoxels& voxels, const float* pPositions, size_t count, float* pOut);
+    void sampleLinearFixedPoint(const BatchVoxels& voxels, const float* pPositions, size_t count, float* pOut);
+    void sampleGradientsNearest(const float* pGradients, int dimX, int dimY, int dimZ, const float* pPositions, size_t count, float* pOut);
+    void sampleGradientsLinear(const float* pGradients, int dimX, int dimY, int dimZ, const float* pPositions, size_t count, float* pOut);
+}
+}
@@ -0,0 +1,69 @@
+// Compiled with AVX2 enabled (see src/CMakeLists.txt); only called if the CPU supports it.
+#include "sample_batch_kernels.h"
+#include <immintrin.h>
+
+namespace volume::avx2 {
+
+// The vector operations used by the kernels, on 8 lanes.
+struct Simd {
+    static constexpr size_t width = 8;
+    using F = __m256;
+    using I = __m256i;
+    using M = __m256;
+
+    static F setF(float v) { return _mm256_set1_ps(v); }
+    static I setI(int v) { return _mm256_set1_epi32(v); }
+    static I iota() { return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7); }
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F minF(F a, F b) { return _mm256_min_ps(a, b); }
+    static F maxF(F a, F b) { return _mm256_max_ps(a, b); }
+    static F floor(F a) { return _mm256_floor_ps(a); }
+    static I toInt(F a) { return _mm256_cvttps_epi32(a); }
+    static F toFloat(I a) { return _mm256_cvtepi32_ps(a); }
+    static I addI(I a, I b) { return _mm256_add_epi32(a, b); }
+    static I subI(I a, I b) { return _mm256_sub_epi32(a, b); }
+    static I mulI(I a, I b) { return _mm256_mullo_epi32(a, b); }
+    static I minI(I a, I b) { return _mm256_min_epi32(a, b); }
+    static I maxI(I a, I b) { return _mm256_max_epi32(a, b); }
+    static I andI(I a, I b) { return _mm256_and_si256(a, b); }
+    static I sllv(I a, I count) { return _mm256_sllv_epi32(a, count); }
+    static I srlv(I a, I count) { return _mm256_srlv_epi32(a, count); }
+    static I srav(I a, I count) { return _mm256_srav_epi32(a, count); }
+    static M less(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static M greaterEqual(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static M equalI(I a, I b) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)); }
+    static M maskOr(M a, M b) { return _mm256_or_ps(a, b); }
+    static F select(M mask, F ifSet, F ifClear) { return _mm256_blendv_ps(ifClear, ifSet, mask); }
+    static I selectI(M mask, I ifSet, I ifClear) { return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(ifClear), _mm256_castsi256_ps(ifSet), mask)); }
+    static F gatherF(const float* pBase, I index) { return _mm256_i32gather_ps(pBase, index, 4); }
+    static I gatherBytes(const std::byte* pBase, I byteOffset) { return _mm256_i32gather_epi32(reinterpret_cast<const int*>(pBase), byteOffset, 1); }
+    static void storeF(float* pOut, F a) { _mm256_storeu_ps(pOut, a); }
+};
+
+void sampleNearest(const BatchVoxels& voxels, const float* pPositions, size_t count, float* pOut)
+{
+    kernels::sampleNearest<Simd>(voxels, pPositions, count, pOut);
+}
+
+void sampleLinear(const BatchVoxels& voxels, const float* pPositions, size_t count, float* pOut)
+{
+    kernels::sampleLinear<Simd>(voxels, pPositions, count, pOut);
+}
+
+void sampleLinearFixedPoint(const BatchVoxels& voxels, const float* pPositions, size_t count, float* pOut)
+{
+    kernels::sampleLinearFixedPoint<Simd>(voxels, pPositions, count, pOut);
+}
+
+void sampleGradientsNearest(const float* pGradients, int dimX, int dimY, int dimZ, const float* pPositions, size_t count, float* pOut)
+{
+    kernels::sampleGradientsNearest<Simd>(pGradients, dimX, dimY, dimZ, pPositions, count, pOut);
+}
+
+void sampleGradientsLinear(const float* pGradients, int dimX, int dimY, int dimZ, const float* pPositions, size_t count, float* pOut)
+{
+    kernels::sampleGradientsLinear<Simd>(pGradients, dimX, dimY, dimZ, pPositions, count, pOut);
+}
+}
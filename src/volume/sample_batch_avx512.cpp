@@ -0,0 +1,76 @@
+// Compiled with AVX-512 enabled (see src/CMakeLists.txt); only called if the CPU supports it.
+#include "sample_batch_kernels.h"
+#include <immintrin.h>
+
+// The AVX-512 intrinsics of GCC 12 start from deliberately uninitialized vectors, which it then warns about when they
+// are inlined.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+namespace volume::avx512 {
+
+// The vector operations used by the kernels, on 16 lanes (AVX-512F only).
+struct Simd {
+    static constexpr size_t width = 16;
+    using F = __m512;
+    using I = __m512i;
+    using M = __mmask16;
+
+    static F setF(float v) { return _mm512_set1_ps(v); }
+    static I setI(int v) { return _mm512_set1_epi32(v); }
+    static I iota() { return _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15); }
+    static F add(F a, F b) { return _mm512_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+    static F minF(F a, F b) { return _mm512_min_ps(a, b); }
+    static F maxF(F a, F b) { return _mm512_max_ps(a, b); }
+    static F floor(F a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+    static I toInt(F a) { return _mm512_cvttps_epi32(a); }
+    static F toFloat(I a) { return _mm512_cvtepi32_ps(a); }
+    static I addI(I a, I b) { return _mm512_add_epi32(a, b); }
+    static I subI(I a, I b) { return _mm512_sub_epi32(a, b); }
+    static I mulI(I a, I b) { return _mm512_mullo_epi32(a, b); }
+    static I minI(I a, I b) { return _mm512_min_epi32(a, b); }
+    static I maxI(I a, I b) { return _mm512_max_epi32(a, b); }
+    static I andI(I a, I b) { return _mm512_and_si512(a, b); }
+    static I sllv(I a, I count) { return _mm512_sllv_epi32(a, count); }
+    static I srlv(I a, I count) { return _mm512_srlv_epi32(a, count); }
+    static I srav(I a, I count) { return _mm512_srav_epi32(a, count); }
+    static M less(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static M greaterEqual(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+    static M equalI(I a, I b) { return _mm512_cmpeq_epi32_mask(a, b); }
+    static M maskOr(M a, M b) { return _mm512_kor(a, b); }
+    static F select(M mask, F ifSet, F ifClear) { return _mm512_mask_blend_ps(mask, ifClear, ifSet); }
+    static I selectI(M mask, I ifSet, I ifClear) { return _mm512_mask_blend_epi32(mask, ifClear, ifSet); }
+    static F gatherF(const float* pBase, I index) { return _mm512_i32gather_ps(index, pBase, 4); }
+    static I gatherBytes(const std::byte* pBase, I byteOffset) { return _mm512_i32gather_epi32(byteOffset, pBase, 1); }
+    static void storeF(float* pOut, F a) { _mm512_storeu_ps(pOut, a); }
+};
+
+void sampleNearest(const BatchVoxels& voxels, const float* pPositions, size_t count, float* pOut)
+{
+    kernels::sampleNearest<Simd>(voxels, pPositions, count, pOut);
+}
+
+void sampleLinear(const BatchVoxels& voxels, const float* pPositions, size_t count, float* pOut)
+{
+    kernels::sampleLinear<Simd>(voxels, pPositions, count, pOut);
+}
+
+void sampleLinearFixedPoint(const BatchVoxels& voxels, const float* pPositions, size_t count, float* pOut)
+{
+    kernels::sampleLinearFixedPoint<Simd>(voxels, pPositions, count, pOut);
+}
+
+void sampleGradientsNearest(const float* pGradients, int dimX, int dimY, int dimZ, const float* pPositions, size_t count, float* pOut)
+{
+    kernels::sampleGradientsNearest<Simd>(pGradients, dimX, dimY, dimZ, pPositions, count, pOut);
+}
+
+void sampleGradientsLinear(const float* pGradients, int dimX, int dimY, int dimZ, const float* pPositions, size_t count, float* pOut)
+{
+    kernels::sampleGradientsLinear<Simd>(pGradients, dimX, dimY, dimZ, pPositions, count, pOut);
+}
+}
@@ -0,0 +1,246 @@
+#pragma once
+#include "sample_batch.h"
+#include <cstddef>
+#include <cstring>
+
+// The batched sampling kernels, written once against a small set of vector operations (S) that
+// sample_batch_avx2.cpp and sample_batch_avx512.cpp implement with the intrinsics of their instruction set. Every
+// block samples S::width positions: the coordinates are gathered from the positions, the voxels are gathered from the
+// volume and the interpolation is done on whole vectors. Lanes that lie outside of the volume read voxel 0 and are
+// set to zero afterwards, like the scalar code returns zero for them.
+namespace volume::kernels {
+
+// Call block(pPositions, pOut) for each group of S::width positions; the last group is padded (with the origin).
+template <typename S, size_t outPerSample, typename Block>
+void forEachBlock(const float* pPositions, size_t count, float* pOut, Block&& block)
+{
+    constexpr size_t width = S::width;
+    size_t i = 0;
+    for (; i + width <= count; i += width)
+        block(pPositions + 3 * i, pOut + outPerSample * i);
+    if (i < count) {
+        float positions[3 * width] {};
+        float out[outPerSample * width];
+        std::memcpy(positions, pPositions + 3 * i, (count - i) * 3 * sizeof(float));
+        block(positions, out);
+        std::memcpy(pOut + outPerSample * i, out, (count - i) * outPerSample * sizeof(float));
+    }
+}
+
+template <typename S>
+struct Positions {
+    typename S::F x, y, z;
+};
+
+template <typename S>
+Positions<S> loadPositions(const float* pPositions)
+{
+    const auto index = S::mulI(S::iota(), S::setI(3));
+    return { S::gatherF(pPositions, index), S::gatherF(pPositions + 1, index), S::gatherF(pPositions + 2, index) };
+}
+
+// The 32-bit word that starts at the uint8_t or uint16_t voxel at index, or earlier if it would read beyond the last
+// voxel (then it is shifted such that the voxel ends up in its lowest bits).
+template <typename S>
+typename S::I loadWord(const BatchVoxels& voxels, typename S::I index)
+{
+    const auto offset = S::mulI(index, S::setI(int(voxels.elementSize)));
+    const auto wordOffset = S::minI(offset, S::setI(int(voxels.byteSize) - 4));
+    return S::srlv(S::gatherBytes(voxels.pVoxels, wordOffset), S::mulI(S::subI(offset, wordOffset), S::setI(8)));
+}
+
+// The voxels at index and, if pair is set, index + 1 (which must lie in the same row). uint8_t and uint16_t voxels are
+// gathered as the 32-bit word that contains them (see loadWord).
+template <typename S, bool pair>
+void loadVoxels(const BatchVoxels& voxels, typename S::I index, typename S::F& v0, typename S::F& v1)
+{
+    if (voxels.elementSize == 4) {
+        const auto* pVoxels = reinterpret_cast<const float*>(voxels.pVoxels);
+        v0 = S::gatherF(pVoxels, index);
+        if constexpr (pair)
+            v1 = S::gatherF(pVoxels, S::addI(index, S::setI(1)));
+        return;
+    }
+
+    const int bits = 8 * int(voxels.elementSize);
+    const auto word = loadWord<S>(voxels, index);
+    const auto mask = S::setI((1 << bits) - 1);
+    v0 = S::toFloat(S::andI(word, mask));
+    if constexpr (pair)
+        v1 = S::toFloat(S::andI(S::srlv(word, S::setI(bits)), mask));
+}
+
+template <typename S>
+typename S::F linearInterpolate(typename S::F g0, typename S::F g1, typename S::F factor)
+{
+    return S::add(S::mul(g0, S::sub(S::setF(1.0f), factor)), S::mul(g1, factor));
+}
+
+// See Volume::getSampleNearestNeighbourInterpolation.
+template <typename S>
+void sampleNearest(const BatchVoxels& voxels, const float* pPositions, size_t count, float* pOut)
+{
+    forEachBlock<S, 1>(pPositions, count, pOut, [&](const float* pBlockPositions, float* pBlockOut) {
+        const Positions<S> p = loadPositions<S>(pBlockPositions);
+        const auto half = S::setF(0.5f);
+        const auto x = S::add(p.x, half), y = S::add(p.y, half), z = S::add(p.z, half);
+        const auto zero = S::setF(0.0f);
+        const auto outside = S::maskOr(
+            S::maskOr(S::maskOr(S::less(x, zero), S::less(y, zero)), S::less(z, zero)),
+            S::maskOr(S::maskOr(S::greaterEqual(x, S::setF(float(voxels.dimX))), S::greaterEqual(y, S::setF(float(voxels.dimY)))), S::greaterEqual(z, S::setF(float(voxels.dimZ)))));
+
+        const auto index = S::addI(S::toInt(x), S::mulI(S::setI(voxels.dimX), S::addI(S::toInt(y), S::mulI(S::setI(voxels.dimY), S::toInt(z)))));
+        typename S::F value, unused;
+        loadVoxels<S, false>(voxels, S::selectI(outside, S::setI(0), index), value, unused);
+        S::storeF(pBlockOut, S::select(outside, zero, value));
+    });
+}
+
+// See Volume::getSampleTriLinearInterpolation.
+template <typename S>
+void sampleLinear(const BatchVoxels& voxels, const float* pPositions, size_t count, float* pOut)
+{
+    const int strideY = voxels.dimX;
+    const int strideZ = voxels.dimX * voxels.dimY;
+    forEachBlock<S, 1>(pPositions, count, pOut, [&](const float* pBlockPositions, float* pBlockOut) {
+        const Positions<S> p = loadPositions<S>(pBlockPositions);
+        const auto zero = S::setF(0.0f);
+        const auto outside = S::maskOr(
+            S::maskOr(S::maskOr(S::less(p.x, zero), S::less(p.y, zero)), S::less(p.z, zero)),
+            S::maskOr(S::maskOr(S::greaterEqual(p.x, S::setF(float(voxels.dimX - 1))), S::greaterEqual(p.y, S::setF(float(voxels.dimY - 1)))), S::greaterEqual(p.z, S::setF(float(voxels.dimZ - 1)))));
+
+        const auto x0 = S::toInt(p.x), y0 = S::toInt(p.y), z0 = S::toInt(p.z);
+        const auto dx = S::sub(p.x, S::toFloat(x0)), dy = S::sub(p.y, S::toFloat(y0)), dz = S::sub(p.z, S::toFloat(z0));
+        const auto base = S::selectI(outside, S::setI(0), S::addI(x0, S::addI(S::mulI(y0, S::setI(strideY)), S::mulI(z0, S::setI(strideZ)))));
+
+        typename S::F v000, v100, v010, v110, v001, v101, v011, v111;
+        loadVoxels<S, true>(voxels, base, v000, v100);
+        loadVoxels<S, true>(voxels, S::addI(base, S::setI(strideY)), v010, v110);
+        loadVoxels<S, true>(voxels, S::addI(base, S::setI(strideZ)), v001, v101);
+        loadVoxels<S, true>(voxels, S::addI(base, S::setI(strideY + strideZ)), v011, v111);
+
+        const auto valZ0 = linearInterpolate<S>(linearInterpolate<S>(v000, v100, dx), linearInterpolate<S>(v010, v110, dx), dy);
+        const auto valZ1 = linearInterpolate<S>(linearInterpolate<S>(v001, v101, dx), linearInterpolate<S>(v011, v111, dx), dy);
+        S::storeF(pBlockOut, S::select(outside, zero, linearInterpolate<S>(valZ0, valZ1, dz)));
+    });
+}
+
+// See Volume::getSampleTriLinearFixedPoint, which this computes with the same integer operations. The voxels at x0 and
+// x0 + 1 come from a single gathered word (see loadWord).
+template <typename S>
+void sampleLinearFixedPoint(const BatchVoxels& voxels, const float* pPositions, size_t count, float* pOut)
+{
+    const int strideY = voxels.dimX;
+    const int strideZ = voxels.dimX * voxels.dimY;
+    const int bits = 8 * int(voxels.elementSize);
+    const int fractionBits = voxels.elementSize == 1 ? 8 : 0;
+    const int shiftX = fixedPointFactorBits - fractionBits;
+    forEachBlock<S, 1>(pPositions, count, pOut, [&](const float* pBlockPositions, float* pBlockOut) {
+        const Positions<S> p = loadPositions<S>(pBlockPositions);
+        const auto zero = S::setF(0.0f);
+        const auto outside = S::maskOr(
+            S::maskOr(S::maskOr(S::less(p.x, zero), S::less(p.y, zero)), S::less(p.z, zero)),
+            S::maskOr(S::maskOr(S::greaterEqual(p.x, S::setF(float(voxels.dimX - 1))), S::greaterEqual(p.y, S::setF(float(voxels.dimY - 1)))), S::greaterEqual(p.z, S::setF(float(voxels.dimZ - 1)))));
+
+        const auto x0 = S::toInt(p.x), y0 = S::toInt(p.y), z0 = S::toInt(p.z);
+        auto factor = [](typename S::F t) { return S::toInt(S::add(S::mul(t, S::setF(float(1 << fixedPointFactorBits))), S::setF(0.5f))); };
+        const auto fx = factor(S::sub(p.x, S::toFloat(x0))), fy = factor(S::sub(p.y, S::toFloat(y0))), fz = factor(S::sub(p.z, S::toFloat(z0)));
+        const auto base = S::selectI(outside, S::setI(0), S::addI(x0, S::addI(S::mulI(y0, S::setI(strideY)), S::mulI(z0, S::setI(strideZ)))));
+
+        // a + (b - a) * f, with f and the difference having shift more fractional bits than a.
+        auto interpolate = [](typename S::I a, typename S::I b, typename S::I f, int shift) {
+            return S::addI(a, S::srav(S::addI(S::mulI(S::subI(b, a), f), S::setI(1 << (shift - 1))), S::setI(shift)));
+        };
+        auto interpolateX = [&](typename S::I index) {
+            const auto word = loadWord<S>(voxels, index);
+            const auto mask = S::setI((1 << bits) - 1);
+            const auto v0 = S::andI(word, mask);
+            const auto v1 = S::andI(S::srlv(word, S::setI(bits)), mask);
+            return S::addI(S::sllv(v0, S::setI(fractionBits)), S::srav(S::addI(S::mulI(S::subI(v1, v0), fx), S::setI(1 << (shiftX - 1))), S::setI(shiftX)));
+        };
+        const auto valZ0 = interpolate(interpolateX(base), interpolateX(S::addI(base, S::setI(strideY))), fy, fixedPointFactorBits);
+        const auto valZ1 = interpolate(interpolateX(S::addI(base, S::setI(strideZ))), interpolateX(S::addI(base, S::setI(strideY + strideZ))), fy, fixedPointFactorBits);
+        const auto value = S::toFloat(interpolate(valZ0, valZ1, fz, fixedPointFactorBits));
+        S::storeF(pBlockOut, S::select(outside, zero, S::mul(value, S::setF(1.0f / float(1 << fractionBits)))));
+    });
+}
+
+// Write the 4 channels (direction and magnitude) of a block of gradients as GradientVoxels.
+template <typename S>
+void storeGradients(const typename S::F (&channels)[4], float* pOut)
+{
+    float values[4][S::width];
+    for (size_t c = 0; c < 4; c++)
+        S::storeF(values[c], channels[c]);
+    for (size_t i = 0; i < S::width; i++) {
+        for (size_t c = 0; c < 4; c++)
+            pOut[4 * i + c] = values[c][i];
+    }
+}
+
+// See GradientVolume::getGradientNearestNeighbor.
+template <typename S>
+void sampleGradientsNearest(const float* pGradients, int dimX, int dimY, int dimZ, const float* pPositions, size_t count, float* pOut)
+{
+    forEachBlock<S, 4>(pPositions, count, pOut, [&](const float* pBlockPositions, float* pBlockOut) {
+        const Positions<S> p = loadPositions<S>(pBlockPositions);
+        const auto half = S::setF(0.5f);
+        const auto x = S::add(p.x, half), y = S::add(p.y, half), z = S::add(p.z, half);
+        const auto zero = S::setF(0.0f);
+        const auto outside = S::maskOr(
+            S::maskOr(S::maskOr(S::less(x, zero), S::less(y, zero)), S::less(z, zero)),
+            S::maskOr(S::maskOr(S::greaterEqual(x, S::setF(float(dimX))), S::greaterEqual(y, S::setF(float(dimY)))), S::greaterEqual(z, S::setF(float(dimZ)))));
+
+        const auto index = S::addI(S::toInt(x), S::mulI(S::setI(dimX), S::addI(S::toInt(y), S::mulI(S::setI(dimY), S::toInt(z)))));
+        const auto offset = S::mulI(S::selectI(outside, S::setI(0), index), S::setI(4));
+        typename S::F channels[4];
+        for (int c = 0; c < 4; c++)
+            channels[c] = S::select(outside, zero, S::gatherF(pGradients + c, offset));
+        storeGradients<S>(channels, pBlockOut);
+    });
+}
+
+// See GradientVolume::getGradientLinearInterpolate: the cell is clamped to the volume, and the interpolation factor of
+// an axis along which both corners were clamped to the same voxel is zero.
+template <typename S>
+void sampleGradientsLinear(const float* pGradients, int dimX, int dimY, int dimZ, const float* pPositions, size_t count, float* pOut)
+{
+    struct Axis {
+        typename S::I offset0, offset1;
+        typename S::F factor;
+    };
+    // Clamp the floor in floating point first so that it can be converted to int for any coordinate.
+    auto axis = [](typename S::F coord, int dim, int stride) {
+        const auto lower = S::toInt(S::minF(S::maxF(S::floor(coord), S::setF(-1.0f)), S::setF(float(dim))));
+        const auto maxIndex = S::setI(dim - 1);
+        const auto i0 = S::maxI(S::minI(lower, maxIndex), S::setI(0));
+        const auto i1 = S::maxI(S::minI(S::addI(lower, S::setI(1)), maxIndex), S::setI(0));
+        const auto factor = S::select(S::equalI(i0, i1), S::setF(0.0f), S::sub(coord, S::toFloat(i0)));
+        return Axis { S::mulI(i0, S::setI(4 * stride)), S::mulI(i1, S::setI(4 * stride)), factor };
+    };
+
+    forEachBlock<S, 4>(pPositions, count, pOut, [&](const float* pBlockPositions, float* pBlockOut) {
+        const Positions<S> p = loadPositions<S>(pBlockPositions);
+        const Axis x = axis(p.x, dimX, 1);
+        const Axis y = axis(p.y, dimY, dimX);
+        const Axis z = axis(p.z, dimZ, dimX * dimY);
+        const typename S::I corners[8] {
+            S::addI(x.offset0, S::addI(y.offset0, z.offset0)), S::addI(x.offset1, S::addI(y.offset0, z.offset0)),
+            S::addI(x.offset0, S::addI(y.offset1, z.offset0)), S::addI(x.offset1, S::addI(y.offset1, z.offset0)),
+            S::addI(x.offset0, S::addI(y.offset0, z.offset1)), S::addI(x.offset1, S::addI(y.offset0, z.offset1)),
+            S::addI(x.offset0, S::addI(y.offset1, z.offset1)), S::addI(x.offset1, S::addI(y.offset1, z.offset1))
+        };
+
+        typename S::F channels[4];
+        for (int c = 0; c < 4; c++) {
+            typename S::F v[8];
+            for (size_t i = 0; i < 8; i++)
+                v[i] = S::gatherF(pGradients + c, corners[i]);
+            const auto c0 = linearInterpolate<S>(linearInterpolate<S>(v[0], v[1], x.factor), linearInterpolate<S>(v[2], v[3], x.factor), y.factor);
+            const auto c1 = linearInterpolate<S>(linearInterpolate<S>(v[4], v[5], x.factor), linearInterpolate<S>(v[6], v[7], x.factor), y.factor);
+            channels[c] = linearInterpolate<S>(c0, c1, z.factor);
+        }
+        storeGradients<S>(channels, pBlockOut);
+    });
+}
+}
@@ -1,55 +1,128 @@
 #include "volume.h"
+#include "sample_batch.h"
+#include "volume_cache.h"
 #include <algorithm>
 #include <array>
 #include <cassert>
 #include <cctype> // isspace
 #include <chrono>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
 #include <glm/glm.hpp>
 #include <gsl/span>
 #include <iostream>
 #include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#if defined(VOLUME_SIMD_KERNELS) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 struct Header {
     glm::ivec3 dim;
     size_t elementSize;
 };
+static std::string lowercaseExtension(const std::filesystem::path& file);
 static Header readHeader(std::ifstream& ifs, const volume::FileExtension& fileExtension);
 static Header readVolumeHeader_fld(std::ifstream& ifs);
 static Header readVolumeHeader_dat(std::ifstream& ifs);
 
-static float computeMinimum(gsl::span<const float> data);
-static float computeMaximum(gsl::span<const float> data);
-static std::vector<int> computeHistogram(gsl::span<const float> data);
+template <typename T>
+static T loadUnaligned(const std::byte* pData, size_t index);
+
+struct Statistics {
+    float minimum, maximum;
+    float mean, variance;
+    std::vector<uint64_t> histogram;
+};
+template <typename T>
+static Statistics computeStatistics(gsl::span<const std::byte> data);
+static Statistics mergeStatistics(const Statistics& lhs, size_t lhsCount, const Statistics& rhs, size_t rhsCount);
+static std::vector<int> saturateHistogram(const std::vector<uint64_t>& histogram);
+static bool readChunked(std::ifstream& ifs, gsl::span<std::byte> out);
+template <typename T>
+static bool readSubVolume(std::ifstream& ifs, const glm::ivec3& fileDim, const glm::ivec3& begin, const glm::ivec3& end, int factor, volume::DownsampleFilter filter, gsl::span<std::byte> out);
 
 namespace volume {
 
-Volume::Volume(const std::filesystem::path& file)
+Volume::Volume(const std::filesystem::path& file, const LoadConfig& config)
     : m_fileName(file.string())
 {
     using clock = std::chrono::high_resolution_clock;
     auto start = clock::now();
-    loadFile(file);
+    const bool loadedFromCache = config.useCacheFile && !config.outOfCore && !config.compressed && !config.loadsSubVolume() && loadCacheFile(file, config.layout);
+    if (!loadedFromCache)
+        loadFile(file, config);
     auto end = clock::now();
     std::cout << "Time to load: " << std::chrono::duration<double, std::milli>(end - start).count() << "ms" << std::endl;
 
-    if (m_data.size() > 0) {
-        m_minimum = computeMinimum(m_data);
-        m_maximum = computeMaximum(m_data);
-        m_histogram = computeHistogram(m_data);
+    // The statistics of out-of-core volumes are computed by loadFile while streaming through the file.
+    const bool loadedVoxels = !loadedFromCache && m_voxels.size() > 0;
+    if (loadedVoxels) {
+        computeStatistics();
+        if (config.compressed)
+            compressVoxels();
+        else
+            applyLayout(config.layout);
+    }
+    // Cache files hold the pyramid that was built when the file was loaded before (if any). Other levels are
+    // downsampled through getVoxel, so out-of-core volumes read the file once more (brick by brick).
+    if (loadedFromCache && config.mipPyramid != MipPyramid::Never && m_pCache->mipLevelCount() > 0)
+        loadCachedMipPyramid();
+    else if ((config.mipPyramid == MipPyramid::LoadedVoxels && (loadedVoxels || loadedFromCache) && !config.compressed)
+        || (config.mipPyramid == MipPyramid::Always && (loadedFromCache || m_voxels.size() > 0 || m_pBrickCache || m_pCompressedBricks)))
+        buildMipPyramid();
+}
+
+Volume::Volume(std::vector<float> data, const glm::ivec3& dim, const LoadConfig& config)
+    : m_fileName()
+    , m_elementSize(sizeof(float))
+    , m_voxelType(VoxelType::Float)
+    , m_dim(dim)
+    , m_indexer(VoxelLayout::Linear, dim)
+    , m_ownedFloatVoxels(std::move(data))
+{
+    m_voxels = gsl::as_bytes(gsl::span<const float>(m_ownedFloatVoxels));
+    if (m_voxels.size() > 0) {
+        computeStatistics();
+        if (config.compressed)
+            compressVoxels();
+        else
+            applyLayout(config.layout);
+        if (config.mipPyramid == MipPyramid::Always || (config.mipPyramid == MipPyramid::LoadedVoxels && !config.compressed))
+            buildMipPyramid();
     }
 }
 
-Volume::Volume(std::vector<float> data, const glm::ivec3& dim)
+Volume::Volume(const glm::ivec3& dim, VoxelType voxelType, std::vector<std::byte> voxels)
     : m_fileName()
-    , m_elementSize(2)
+    , m_elementSize(voxels.size() / (size_t(dim.x) * size_t(dim.y) * size_t(dim.z)))
+    , m_voxelType(voxelType)
     , m_dim(dim)
-    , m_data(std::move(data))
-    , m_minimum(computeMinimum(m_data))
-    , m_maximum(computeMaximum(m_data))
-    , m_histogram(computeHistogram(m_data))
+    , m_indexer(VoxelLayout::Linear, dim)
+    , m_ownedVoxels(std::move(voxels))
+{
+    m_voxels = m_ownedVoxels;
+    computeStatistics();
+}
+
+// The level does not keep the cache file mapped (cache() returns nullptr), the volume that owns the level does. The
+// statistics of the level are not stored in the cache file, they are computed from the mapped voxels (an eighth of
+// those of the previous level).
+Volume::Volume(const VolumeCache& cache, int lod)
+    : m_fileName()
+    , m_voxelType(cache.voxelType())
+    , m_dim(cache.mipLevelDims(lod))
+    , m_indexer(VoxelLayout::Linear, m_dim)
+    , m_voxels(cache.mipLevelVoxels(lod))
 {
+    m_elementSize = m_voxels.size() / m_indexer.size();
+    computeStatistics();
 }
 
 float Volume::minimum() const
@@ -62,6 +135,16 @@ float Volume::maximum() const
     return m_maximum;
 }
 
+float Volume::mean() const
+{
+    return m_mean;
+}
+
+float Volume::variance() const
+{
+    return m_variance;
+}
+
 std::vector<int> Volume::histogram() const
 {
     return m_histogram;
@@ -72,26 +155,144 @@ glm::ivec3 Volume::dims() const
     return m_dim;
 }
 
+VoxelType Volume::voxelType() const
+{
+    return m_voxelType;
+}
+
+VoxelLayout Volume::layout() const
+{
+    return m_indexer.layout();
+}
+
 std::string_view Volume::fileName() const
 {
     return m_fileName;
 }
 
+const BrickCache* Volume::brickCache() const
+{
+    return m_pBrickCache.get();
+}
+
+std::shared_ptr<const VolumeCache> Volume::cache() const
+{
+    return m_pCache;
+}
+
+const CompressedBricks* Volume::compressedBricks() const
+{
+    return m_pCompressedBricks.get();
+}
+
+gsl::span<const std::byte> Volume::voxels() const
+{
+    return m_voxels;
+}
+
+int Volume::mipLevelCount() const
+{
+    return int(m_mipLevels.size());
+}
+
+const Volume& Volume::mipLevel(int lod) const
+{
+    if (lod <= 0 || m_mipLevels.empty())
+        return *this;
+    return *m_mipLevels[size_t(std::min(lod, mipLevelCount()) - 1)];
+}
+
+gsl::span<std::byte> Volume::mutableVoxels()
+{
+    if (m_voxels.empty() || m_indexer.layout() != VoxelLayout::Linear || !m_mipLevels.empty())
+        return {};
+    if (m_voxels.data() == m_ownedVoxels.data())
+        return m_ownedVoxels;
+    if (m_voxels.data() == reinterpret_cast<const std::byte*>(m_ownedFloatVoxels.data()))
+        return gsl::as_writable_bytes(gsl::span<float>(m_ownedFloatVoxels));
+    return {};
+}
+
+bool Volume::readVoxels(const std::filesystem::path& file)
+{
+    const gsl::span<std::byte> voxels = mutableVoxels();
+    std::ifstream ifs(file, std::ios::binary);
+    if (voxels.empty() || !ifs.is_open())
+        return false;
+
+    const FileExtension fileExtension = lowercaseExtension(file) == ".dat" ? FileExtension::DAT : FileExtension::FLD;
+    const auto header = readHeader(ifs, fileExtension);
+    if (header.dim != m_dim || header.elementSize != m_elementSize) {
+        std::cerr << "Volume " << file << " does not have the same dimensions and voxel type" << std::endl;
+        return false;
+    }
+    // Data section is separated from header by two /f characters.
+    if (fileExtension == FileExtension::FLD)
+        ifs.seekg(2, std::ios::cur);
+    return readChunked(ifs, voxels);
+}
+
+float Volume::getVoxel(int x, int y, int z) const
+{
+    switch (m_voxelType) {
+    case VoxelType::UInt8: {
+        return getVoxel<uint8_t>(x, y, z);
+    }
+    case VoxelType::UInt16: {
+        return getVoxel<uint16_t>(x, y, z);
+    }
+    case VoxelType::Float: {
+        return getVoxel<float>(x, y, z);
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
+template <typename T>
 float Volume::getVoxel(int x, int y, int z) const
 {
-    const size_t i = size_t(x + m_dim.x * (y + m_dim.y * z));
-    return static_cast<float>(m_data[i]);
+    if (m_pBrickCache) {
+        return static_cast<float>(loadUnaligned<T>(m_pBrickCache->brick(x, y, z), BrickCache::cell(x, y, z).base));
+    }
+    if (m_pCompressedBricks) {
+        const size_t index = m_indexer.index(x, y, z);
+        const std::byte* pBrickVoxels = m_pCompressedBricks->brick(index / VoxelIndexer::storedBrickVoxels);
+        return static_cast<float>(loadUnaligned<T>(pBrickVoxels, index % VoxelIndexer::storedBrickVoxels));
+    }
+    return static_cast<float>(loadUnaligned<T>(m_voxels.data(), m_indexer.index(x, y, z)));
+}
+
+// This function returns a value based on the current interpolation mode.
+// The voxel type is resolved once here so that the interpolation kernels read the voxels in their native width.
+float Volume::getSampleInterpolate(const glm::vec3& coord) const
+{
+    switch (m_voxelType) {
+    case VoxelType::UInt8: {
+        return getSampleInterpolate<uint8_t>(coord);
+    }
+    case VoxelType::UInt16: {
+        return getSampleInterpolate<uint16_t>(coord);
+    }
+    case VoxelType::Float: {
+        return getSampleInterpolate<float>(coord);
+    }
+    default: {
+        throw std::exception();
+    }
+    }
 }
 
-// This function returns a value based on the current interpolation mode
+template <typename T>
 float Volume::getSampleInterpolate(const glm::vec3& coord) const
 {
     switch (interpolationMode) {
     case InterpolationMode::NearestNeighbour: {
-        return getSampleNearestNeighbourInterpolation(coord);
+        return getSampleNearestNeighbourInterpolation<T>(coord);
     }
     case InterpolationMode::Linear: {
-        return getSampleTriLinearInterpolation(coord);
+        return getSampleTriLinearInterpolation<T>(coord);
     }
     case InterpolationMode::Cubic: {
         return getSampleTriCubicInterpolation(coord);
@@ -102,8 +303,149 @@ float Volume::getSampleInterpolate(const glm::vec3& coord) const
     }
 }
 
+float Volume::getSampleInterpolate(const glm::vec3& coord, int lod) const
+{
+    switch (interpolationMode) {
+    case InterpolationMode::NearestNeighbour: {
+        return getSampleInterpolate<InterpolationMode::NearestNeighbour>(coord, lod);
+    }
+    case InterpolationMode::Linear: {
+        return getSampleInterpolate<InterpolationMode::Linear>(coord, lod);
+    }
+    case InterpolationMode::Cubic: {
+        return getSampleInterpolate<InterpolationMode::Cubic>(coord, lod);
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
+// Sample a coarser level of the mip pyramid. Voxel i of level l is the average of the voxels [i * 2^l, (i + 1) * 2^l)
+// of level 0, so its center lies at i * 2^l + (2^l - 1) / 2 in the coordinates of level 0.
+template <InterpolationMode mode>
+float Volume::getSampleInterpolate(const glm::vec3& coord, int lod) const
+{
+    if (lod > 0 && !m_mipLevels.empty()) {
+        const int level = std::min(lod, mipLevelCount());
+        const float scale = float(1 << level);
+        return m_mipLevels[size_t(level - 1)]->getSampleInterpolate<mode>((coord + 0.5f) / scale - 0.5f, 0);
+    }
+
+    if constexpr (mode == InterpolationMode::NearestNeighbour)
+        return getSampleNearestNeighbourInterpolation(coord);
+    else if constexpr (mode == InterpolationMode::Linear)
+        return getSampleTriLinearInterpolation(coord);
+    else
+        return getSampleTriCubicInterpolation(coord);
+}
+
+template float Volume::getSampleInterpolate<InterpolationMode::NearestNeighbour>(const glm::vec3&, int) const;
+template float Volume::getSampleInterpolate<InterpolationMode::Linear>(const glm::vec3&, int) const;
+template float Volume::getSampleInterpolate<InterpolationMode::Cubic>(const glm::vec3&, int) const;
+
+// The kernels are only built (VOLUME_SIMD_KERNELS, see src/CMakeLists.txt) for x86-64. Both the CPU and the operating
+// system (which saves the wider registers) have to support an instruction set.
+SimdLevel bestSimdLevel()
+{
+    static const SimdLevel simdLevel = []() {
+#if defined(VOLUME_SIMD_KERNELS) && defined(_MSC_VER)
+        std::array<int, 4> info;
+        __cpuid(info.data(), 0);
+        const int maxLeaf = info[0];
+        __cpuid(info.data(), 1);
+        const bool osxsave = info[2] & (1 << 27);
+        if (maxLeaf < 7 || !osxsave)
+            return SimdLevel::Scalar;
+        const unsigned long long enabledRegisters = _xgetbv(0);
+        __cpuidex(info.data(), 7, 0);
+        if ((info[1] & (1 << 16)) && (enabledRegisters & 0xe6) == 0xe6)
+            return SimdLevel::AVX512;
+        if ((info[1] & (1 << 5)) && (enabledRegisters & 0x6) == 0x6)
+            return SimdLevel::AVX2;
+#elif defined(VOLUME_SIMD_KERNELS)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return SimdLevel::AVX512;
+        if (__builtin_cpu_supports("avx2"))
+            return SimdLevel::AVX2;
+#endif
+        return SimdLevel::Scalar;
+    }();
+    return simdLevel;
+}
+
+bool Volume::vectorizesSampleBatch(SimdLevel simdLevel) const
+{
+#if defined(VOLUME_SIMD_KERNELS)
+    return std::min(simdLevel, bestSimdLevel()) != SimdLevel::Scalar && interpolationMode != InterpolationMode::Cubic && !m_voxels.empty()
+        && m_indexer.layout() == VoxelLayout::Linear && glm::all(glm::greaterThanEqual(m_dim, glm::ivec3(2)))
+        && m_voxels.size() <= size_t(std::numeric_limits<int>::max());
+#else
+    return false;
+#endif
+}
+
+void Volume::sampleBatch(gsl::span<const glm::vec3> positions, gsl::span<float> out, SimdLevel simdLevel) const
+{
+    assert(out.size() == positions.size());
+#if defined(VOLUME_SIMD_KERNELS)
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float));
+    simdLevel = std::min(simdLevel, bestSimdLevel());
+    if (!positions.empty() && vectorizesSampleBatch(simdLevel)) {
+        const BatchVoxels voxels { m_voxels.data(), m_voxels.size(), m_elementSize, m_dim.x, m_dim.y, m_dim.z };
+        const bool avx512 = simdLevel == SimdLevel::AVX512;
+        if (interpolationMode == InterpolationMode::NearestNeighbour)
+            (avx512 ? avx512::sampleNearest : avx2::sampleNearest)(voxels, &positions[0].x, positions.size(), out.data());
+        else
+            (avx512 ? avx512::sampleLinear : avx2::sampleLinear)(voxels, &positions[0].x, positions.size(), out.data());
+        return;
+    }
+#endif
+    for (size_t i = 0; i < positions.size(); i++)
+        out[i] = getSampleInterpolate(positions[i]);
+}
+
+void Volume::sampleBatchFixedPoint(gsl::span<const glm::vec3> positions, gsl::span<float> out, SimdLevel simdLevel) const
+{
+    assert(out.size() == positions.size());
+    if (interpolationMode != InterpolationMode::Linear || m_voxelType == VoxelType::Float) {
+        sampleBatch(positions, out, simdLevel);
+        return;
+    }
+#if defined(VOLUME_SIMD_KERNELS)
+    simdLevel = std::min(simdLevel, bestSimdLevel());
+    if (!positions.empty() && vectorizesSampleBatch(simdLevel)) {
+        const BatchVoxels voxels { m_voxels.data(), m_voxels.size(), m_elementSize, m_dim.x, m_dim.y, m_dim.z };
+        (simdLevel == SimdLevel::AVX512 ? avx512::sampleLinearFixedPoint : avx2::sampleLinearFixedPoint)(voxels, &positions[0].x, positions.size(), out.data());
+        return;
+    }
+#endif
+    for (size_t i = 0; i < positions.size(); i++)
+        out[i] = getSampleTriLinearFixedPoint(positions[i]);
+}
+
+float Volume::getSampleNearestNeighbourInterpolation(const glm::vec3& coord) const
+{
+    switch (m_voxelType) {
+    case VoxelType::UInt8: {
+        return getSampleNearestNeighbourInterpolation<uint8_t>(coord);
+    }
+    case VoxelType::UInt16: {
+        return getSampleNearestNeighbourInterpolation<uint16_t>(coord);
+    }
+    case VoxelType::Float: {
+        return getSampleNearestNeighbourInterpolation<float>(coord);
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
 // This function returns the nearest neighbour value at the continuous 3D position given by coord.
 // Notice that in this framework we assume that the distance between neighbouring voxels is 1 in all directions
+template <typename T>
 float Volume::getSampleNearestNeighbourInterpolation(const glm::vec3& coord) const
 {
     // check if the coordinate is within volume boundaries, since we only look at direct neighbours we only need to check within 0.5
@@ -116,12 +458,31 @@ float Volume::getSampleNearestNeighbourInterpolation(const glm::vec3& coord) con
         return static_cast<int>(f + 0.5f);
     };
 
-    return getVoxel(roundToPositiveInt(coord.x), roundToPositiveInt(coord.y), roundToPositiveInt(coord.z));
+    return getVoxel<T>(roundToPositiveInt(coord.x), roundToPositiveInt(coord.y), roundToPositiveInt(coord.z));
 }
 
 // ======= TODO : IMPLEMENT the functions below for tri-linear interpolation ========
 // ======= Consider using the linearInterpolate and biLinearInterpolate functions ===
+float Volume::getSampleTriLinearInterpolation(const glm::vec3& coord) const
+{
+    switch (m_voxelType) {
+    case VoxelType::UInt8: {
+        return getSampleTriLinearInterpolation<uint8_t>(coord);
+    }
+    case VoxelType::UInt16: {
+        return getSampleTriLinearInterpolation<uint16_t>(coord);
+    }
+    case VoxelType::Float: {
+        return getSampleTriLinearInterpolation<float>(coord);
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
 // This function returns the trilinear interpolated value at the continuous 3D position given by coord.
+template <typename T>
 float Volume::getSampleTriLinearInterpolation(const glm::vec3& coord) const
 {
     // check if we have space for x0+1, y0+1, and z0+1 // boundary edge case
@@ -129,26 +490,110 @@ float Volume::getSampleTriLinearInterpolation(const glm::vec3& coord) const
         return 0.0f;
     }
 
-    // integer part of z
-    int z0 = floor(coord.z);
-    int z1 = z0 + 1;
-    //            z1
-    ///          /     /
-    // -------- z0-----y
-    ///          \x     \
-    // fractional part, how far we acually are in z corner/section between z0 and z1
-    float dz = coord.z - float(z0);
+    // integer part of the coordinates (truncation equals floor since the coordinates are positive)
+    const int x0 = static_cast<int>(coord.x);
+    const int y0 = static_cast<int>(coord.y);
+    const int z0 = static_cast<int>(coord.z);
+    // fractional part, how far we actually are in the cell between x0 and x0 + 1 (etc.)
+    const float dx = coord.x - float(x0);
+    const float dy = coord.y - float(y0);
+    const float dz = coord.z - float(z0);
+    // interpolate in the XY plane for z0 and z1 (bilinear), then along z using dz
+    return interpolateCell(getCellCorners<T>(x0, y0, z0), glm::vec3(dx, dy, dz));
+}
+
+float Volume::getSampleTriLinearFixedPoint(const glm::vec3& coord) const
+{
+    switch (m_voxelType) {
+    case VoxelType::UInt8: {
+        return getSampleTriLinearFixedPoint<uint8_t>(coord);
+    }
+    case VoxelType::UInt16: {
+        return getSampleTriLinearFixedPoint<uint16_t>(coord);
+    }
+    case VoxelType::Float: {
+        return getSampleTriLinearInterpolation<float>(coord);
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
+// The SIMD kernel (kernels::sampleLinearFixedPoint) performs exactly the same integer operations. The differences of
+// the voxels (with up to 8 fractional bits) times the factors (with fixedPointFactorBits) fit in 31 bits.
+template <typename T>
+float Volume::getSampleTriLinearFixedPoint(const glm::vec3& coord) const
+{
+    static_assert(std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t>);
+    if (coord.x < 0.0f || coord.x >= m_dim.x - 1 || coord.y < 0.0f || coord.y >= m_dim.y - 1 || coord.z < 0.0f || coord.z >= m_dim.z - 1) {
+        return 0.0f;
+    }
 
-    // interpolate in the XY plane for z0
-    float valZ0 = biLinearInterpolate(glm::vec2(coord.x, coord.y), z0);
+    constexpr int fractionBits = sizeof(T) == 1 ? 8 : 0;
+    const int x0 = static_cast<int>(coord.x);
+    const int y0 = static_cast<int>(coord.y);
+    const int z0 = static_cast<int>(coord.z);
+    auto factor = [](float t) { return static_cast<int32_t>(t * float(1 << fixedPointFactorBits) + 0.5f); };
+    const int32_t fx = factor(coord.x - float(x0));
+    const int32_t fy = factor(coord.y - float(y0));
+    const int32_t fz = factor(coord.z - float(z0));
 
-    // interpolate in the XY plane for z1
-    float valZ1 = biLinearInterpolate(glm::vec2(coord.x, coord.y), z1);
+    // a + (b - a) * f, with f and the difference having shift more fractional bits than a.
+    auto interpolate = [](int32_t a, int32_t b, int32_t f, int shift) { return a + (((b - a) * f + (1 << (shift - 1))) >> shift); };
+    const std::array<float, 8> corners = getCellCorners<T>(x0, y0, z0);
+    auto interpolateX = [&](size_t i) {
+        const auto v0 = static_cast<int32_t>(corners[i]);
+        const auto v1 = static_cast<int32_t>(corners[i + 1]);
+        return (v0 << fractionBits) + (((v1 - v0) * fx + (1 << (fixedPointFactorBits - fractionBits - 1))) >> (fixedPointFactorBits - fractionBits));
+    };
+    const int32_t valZ0 = interpolate(interpolateX(0), interpolateX(2), fy, fixedPointFactorBits);
+    const int32_t valZ1 = interpolate(interpolateX(4), interpolateX(6), fy, fixedPointFactorBits);
+    return static_cast<float>(interpolate(valZ0, valZ1, fz, fixedPointFactorBits)) * (1.0f / float(1 << fractionBits));
+}
 
-    // interpolate along z using dz
-    return linearInterpolate(valZ0, valZ1, dz);
+std::array<float, 8> Volume::getCellCorners(int x0, int y0, int z0) const
+{
+    switch (m_voxelType) {
+    case VoxelType::UInt8: {
+        return getCellCorners<uint8_t>(x0, y0, z0);
+    }
+    case VoxelType::UInt16: {
+        return getCellCorners<uint16_t>(x0, y0, z0);
+    }
+    case VoxelType::Float: {
+        return getCellCorners<float>(x0, y0, z0);
+    }
+    default: {
+        throw std::exception();
+    }
+    }
 }
 
+template <typename T>
+std::array<float, 8> Volume::getCellCorners(int x0, int y0, int z0) const
+{
+    // Fetch the 8 corners relative to the lower corner. In the bricked layout (and in the bricks of the brick cache) they
+    // all lie in the same brick, so compressed volumes only have to look up a single brick.
+    VoxelCell cell;
+    const std::byte* pVoxels;
+    if (m_pBrickCache) {
+        cell = BrickCache::cell(x0, y0, z0);
+        pVoxels = m_pBrickCache->brick(x0, y0, z0);
+    } else if (m_pCompressedBricks) {
+        cell = m_indexer.cell(x0, y0, z0);
+        pVoxels = m_pCompressedBricks->brick(cell.base / VoxelIndexer::storedBrickVoxels);
+        cell.base %= VoxelIndexer::storedBrickVoxels;
+    } else {
+        cell = m_indexer.cell(x0, y0, z0);
+        pVoxels = m_voxels.data();
+    }
+    auto voxel = [&](size_t offset) { return static_cast<float>(loadUnaligned<T>(pVoxels, cell.base + offset)); };
+    return {
+        voxel(0), voxel(cell.dx), voxel(cell.dy), voxel(cell.dx + cell.dy),
+        voxel(cell.dz), voxel(cell.dx + cell.dz), voxel(cell.dy + cell.dz), voxel(cell.dx + cell.dy + cell.dz)
+    };
+}
 
 // This function linearly interpolates the value at X using incoming values g0 and g1 given a factor (equal to the positon of x in 1D)
 //
@@ -160,17 +605,32 @@ float Volume::linearInterpolate(float g0, float g1, float factor)
     return g0 * (1.0f - factor) + g1 * factor;
 }
 
+float Volume::biLinearInterpolate(const glm::vec2& xyCoord, int z) const
+{
+    switch (m_voxelType) {
+    case VoxelType::UInt8: {
+        return biLinearInterpolate<uint8_t>(xyCoord, z);
+    }
+    case VoxelType::UInt16: {
+        return biLinearInterpolate<uint16_t>(xyCoord, z);
+    }
+    case VoxelType::Float: {
+        return biLinearInterpolate<float>(xyCoord, z);
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
 // This function bi-linearly interpolates the value at the given continuous 2D XY coordinate for a fixed integer z coordinate.
+// The cell must lie inside of the volume: the callers check the bounds (as getSampleTriLinearInterpolation does).
+template <typename T>
 float Volume::biLinearInterpolate(const glm::vec2& xyCoord, int z) const
 {
     float x = xyCoord.x;
     float y = xyCoord.y;
 
-    // check for volume boundary
-    if (x < 0.0f || x >= m_dim.x - 1 || y < 0.0f || y >= m_dim.y - 1) {
-        return 0.0f;
-    }
-
     // extract integer coordinates for the 4 corners from x & y
     // x0--------z--------x1
     int x0 = floor(x);
@@ -181,10 +641,10 @@ float Volume::biLinearInterpolate(const glm::vec2& xyCoord, int z) const
 
 
     // get 4 surrounding voxels
-    float v00 = getVoxel(x0, y0, z);
-    float v10 = getVoxel(x1, y0, z); 
-    float v01 = getVoxel(x0, y1, z); 
-    float v11 = getVoxel(x1, y1, z); 
+    float v00 = getVoxel<T>(x0, y0, z);
+    float v10 = getVoxel<T>(x1, y0, z);
+    float v01 = getVoxel<T>(x0, y1, z);
+    float v11 = getVoxel<T>(x1, y1, z);
 
    
     // first interpolate in x direction (dx)
@@ -200,43 +660,254 @@ float Volume::biLinearInterpolate(const glm::vec2& xyCoord, int z) const
 
 // ======= OPTIONAL : This functions can be used to implement cubic interpolation ========
 // This function represents the h(x) function, which returns the weight of the cubic interpolation kernel for a given position x
+//
+// The kernel is the uniform cubic B-spline. It is smooth (C2) and positive, so it does not ring at sharp edges, and its
+// weights sum to 1. The interpolated volume is slightly smoothed as a result: the samples at the voxel centers are
+// (v[i - 1] + 4 v[i] + v[i + 1]) / 6 rather than v[i].
 float Volume::weight(float x)
 {
+    x = std::abs(x);
+    if (x < 1.0f)
+        return (4.0f - 6.0f * x * x + 3.0f * x * x * x) / 6.0f;
+    if (x < 2.0f)
+        return (2.0f - x) * (2.0f - x) * (2.0f - x) / 6.0f;
     return 0.0f;
 }
 
 // ======= OPTIONAL : This functions can be used to implement cubic interpolation ========
 // This functions returns the results of a cubic interpolation using 4 values and a factor
+//
+// g0--g1--X--g2--g3
+//         factor
 float Volume::cubicInterpolate(float g0, float g1, float g2, float g3, float factor)
 {
-    return 0.0f;
+    return g0 * weight(factor + 1.0f) + g1 * weight(factor) + g2 * weight(1.0f - factor) + g3 * weight(2.0f - factor);
 }
 
 // ======= OPTIONAL : This functions can be used to implement cubic interpolation ========
 // This function returns the value of a bicubic interpolation
+//
+// The 4x4 voxels around xyCoord in slice z, with the voxels beyond the borders of the volume replaced by the voxels at
+// the border (like getSampleTriCubicInterpolation). This is the straightforward 16 tap version, see
+// getSampleTriCubicInterpolation for the one that is used for rendering.
 float Volume::biCubicInterpolate(const glm::vec2& xyCoord, int z) const
 {
-    return 0.0f;
+    // check for volume boundary
+    if (xyCoord.x < 0.0f || xyCoord.x >= float(m_dim.x - 1) || xyCoord.y < 0.0f || xyCoord.y >= float(m_dim.y - 1))
+        return 0.0f;
+
+    const int x0 = static_cast<int>(xyCoord.x);
+    const int y0 = static_cast<int>(xyCoord.y);
+    const int clampedZ = std::clamp(z, 0, m_dim.z - 1);
+    auto row = [&](int y) {
+        const int clampedY = std::clamp(y, 0, m_dim.y - 1);
+        float values[4];
+        for (int i = 0; i < 4; i++)
+            values[i] = getVoxel(std::clamp(x0 - 1 + i, 0, m_dim.x - 1), clampedY, clampedZ);
+        return cubicInterpolate(values[0], values[1], values[2], values[3], xyCoord.x - float(x0));
+    };
+    return cubicInterpolate(row(y0 - 1), row(y0), row(y0 + 1), row(y0 + 2), xyCoord.y - float(y0));
 }
 
 // ======= OPTIONAL : This functions can be used to implement cubic interpolation ========
 // This function computes the tricubic interpolation at coord
 float Volume::getSampleTriCubicInterpolation(const glm::vec3& coord) const
 {
-    return 0.0f;
+    switch (m_voxelType) {
+    case VoxelType::UInt8: {
+        return getSampleTriCubicInterpolation<uint8_t>(coord);
+    }
+    case VoxelType::UInt16: {
+        return getSampleTriCubicInterpolation<uint16_t>(coord);
+    }
+    case VoxelType::Float: {
+        return getSampleTriCubicInterpolation<float>(coord);
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
+#if defined(__SSE2__)
+// The 4 voxels starting at index as floats.
+template <typename T>
+static __m128 loadRow(const std::byte* pVoxels, size_t index)
+{
+    const std::byte* pRow = pVoxels + index * sizeof(T);
+    if constexpr (std::is_same_v<T, float>) {
+        return _mm_loadu_ps(reinterpret_cast<const float*>(pRow));
+    } else if constexpr (std::is_same_v<T, uint16_t>) {
+        const __m128i row = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pRow));
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(row, _mm_setzero_si128()));
+    } else {
+        int32_t word;
+        std::memcpy(&word, pRow, sizeof(word));
+        const __m128i zero = _mm_setzero_si128();
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(word), zero), zero));
+    }
+}
+#endif
+
+// The weights of the 4 voxels along an axis that the two trilinear samples of getSampleTriCubicInterpolation read, with
+// the factors of the samples in their cells and the weight g1 of the second sample: the weight of the sample times the
+// linear interpolation weight of the voxel.
+static std::array<float, 4> sampleWeights(const float (&factors)[2], float g1)
+{
+    return { (1.0f - g1) * (1.0f - factors[0]), (1.0f - g1) * factors[0], g1 * (1.0f - factors[1]), g1 * factors[1] };
+}
+
+// The weighted sum of the 4x4x4 voxels from index base on (in voxels with the given strides), where voxel (x, y, z) of
+// the block has weight wx[x] * wy[y] * wz[z].
+template <typename T>
+static float sumVoxels(const std::byte* pVoxels, size_t base, size_t strideY, size_t strideZ, const std::array<float, 4>& wx, const std::array<float, 4>& wy, const std::array<float, 4>& wz)
+{
+#if defined(__SSE2__)
+    __m128 sum = _mm_setzero_ps();
+    for (size_t z = 0; z < 4; z++) {
+        __m128 slice = _mm_setzero_ps();
+        for (size_t y = 0; y < 4; y++)
+            slice = _mm_add_ps(slice, _mm_mul_ps(_mm_set1_ps(wy[y]), loadRow<T>(pVoxels, base + y * strideY + z * strideZ)));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(wz[z]), slice));
+    }
+    sum = _mm_mul_ps(sum, _mm_setr_ps(wx[0], wx[1], wx[2], wx[3]));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+#else
+    float sum = 0.0f;
+    for (size_t z = 0; z < 4; z++) {
+        for (size_t y = 0; y < 4; y++) {
+            const size_t row = base + y * strideY + z * strideZ;
+            for (size_t x = 0; x < 4; x++)
+                sum += wz[z] * wy[y] * wx[x] * static_cast<float>(loadUnaligned<T>(pVoxels, row + x));
+        }
+    }
+    return sum;
+#endif
+}
+
+// Tricubic B-spline interpolation from 8 trilinear samples instead of 64 voxels (Sigg and Hadwiger, "Fast Third-Order
+// Texture Filtering", GPU Gems 2). Along every axis the 4 B-spline weights w0..w3 are positive, so the weighted sum of
+// the voxels i - 1 and i equals (w0 + w1) times a linear interpolation between them at w1 / (w0 + w1), and likewise for
+// the voxels i + 1 and i + 2. The 64 tap sum thus becomes 8 trilinear samples (at all combinations of the two positions
+// per axis) weighted by the products of the sums. The result is identical to biCubicInterpolate along every axis, with
+// the voxels beyond the borders of the volume replaced by the voxels at the border. Like trilinear interpolation it
+// returns 0 outside of [0, dim - 1).
+template <typename T>
+float Volume::getSampleTriCubicInterpolation(const glm::vec3& coord) const
+{
+    if (coord.x < 0.0f || coord.x >= float(m_dim.x - 1) || coord.y < 0.0f || coord.y >= float(m_dim.y - 1) || coord.z < 0.0f || coord.z >= float(m_dim.z - 1)) {
+        return 0.0f;
+    }
+
+    // Away from the borders the two samples along an axis lie in the cells i - 1 and i + 1 (w1 / (w0 + w1) and
+    // w3 / (w2 + w3) are factors in [0, 1)), so each voxel of the 4x4x4 block from i - 1 on gets its B-spline weight
+    // and the samples reduce to the 64 tap sum. In the linear layout that sum is taken directly, which skips the
+    // divisions and clamps below.
+    const glm::ivec3 voxel { static_cast<int>(coord.x), static_cast<int>(coord.y), static_cast<int>(coord.z) };
+    if (!m_voxels.empty() && m_indexer.layout() == VoxelLayout::Linear && voxel.x >= 1 && voxel.y >= 1 && voxel.z >= 1
+        && voxel.x < m_dim.x - 2 && voxel.y < m_dim.y - 2 && voxel.z < m_dim.z - 2) {
+        auto splineWeights = [](float f) {
+            const float f2 = f * f;
+            const float f3 = f2 * f;
+            const float w0 = (1.0f - f) * (1.0f - f) * (1.0f - f);
+            const float w3 = f3;
+            const float w1 = 4.0f - 6.0f * f2 + 3.0f * f3;
+            return std::array { w0 / 6.0f, w1 / 6.0f, (6.0f - w0 - w1 - w3) / 6.0f, w3 / 6.0f };
+        };
+        const size_t strideY = size_t(m_dim.x);
+        const size_t strideZ = size_t(m_dim.x) * size_t(m_dim.y);
+        const size_t base = size_t(voxel.x - 1) + strideY * size_t(voxel.y - 1) + strideZ * size_t(voxel.z - 1);
+        return sumVoxels<T>(m_voxels.data(), base, strideY, strideZ,
+            splineWeights(coord.x - float(voxel.x)), splineWeights(coord.y - float(voxel.y)), splineWeights(coord.z - float(voxel.z)));
+    }
+
+    // Per axis: the B-spline weights w0..w3 (times 6) for the fraction f of the coordinate (f = 0 puts the sample on
+    // voxel i), the positions of the two trilinear samples and the weight g1 of the second one, and the cells and
+    // factors of the samples with the positions clamped to the volume. That replaces the voxels beyond the borders by
+    // those at the border (the positions lie at most one voxel outside of the volume).
+    int cells[3][2];
+    float factors[3][2];
+    auto axis = [](float x, int dim, int (&cell)[2], float (&factor)[2]) {
+        // (truncation equals floor since the coordinates are positive)
+        const float i = float(static_cast<int>(x));
+        const float f = x - i;
+        const float w0 = (1.0f - f) * (1.0f - f) * (1.0f - f);
+        const float w1 = 4.0f - 6.0f * f * f + 3.0f * f * f * f;
+        const float w3 = f * f * f;
+        const float g0 = w0 + w1;
+        const float positions[2] { i - 1.0f + w1 / g0, i + 1.0f + w3 / (6.0f - g0) };
+        for (int j = 0; j < 2; j++) {
+            const float clamped = std::clamp(positions[j], 0.0f, float(dim - 1));
+            cell[j] = std::min(static_cast<int>(clamped), dim - 2);
+            factor[j] = clamped - float(cell[j]);
+        }
+        return 1.0f - g0 / 6.0f;
+    };
+    const glm::vec3 g1 { axis(coord.x, m_dim.x, cells[0], factors[0]), axis(coord.y, m_dim.y, cells[1], factors[1]), axis(coord.z, m_dim.z, cells[2], factors[2]) };
+
+    // Combine the samples with linear interpolations by the weight g1 of the second position.
+    auto combine = [&](auto&& sample) {
+        const float v00 = linearInterpolate(sample(0, 0, 0), sample(1, 0, 0), g1.x);
+        const float v10 = linearInterpolate(sample(0, 1, 0), sample(1, 1, 0), g1.x);
+        const float v01 = linearInterpolate(sample(0, 0, 1), sample(1, 0, 1), g1.x);
+        const float v11 = linearInterpolate(sample(0, 1, 1), sample(1, 1, 1), g1.x);
+        return linearInterpolate(linearInterpolate(v00, v10, g1.y), linearInterpolate(v01, v11, g1.y), g1.z);
+    };
+
+    // In the linear layout the two trilinear samples along x read 4 consecutive voxels of each row, unless their cells
+    // were clamped into the same or adjacent cells at the borders. Each of those voxels then gets the weight of its
+    // sample times its linear interpolation weight, so the 8 samples are a weighted sum of 4 rows of 4 voxels in each
+    // of 4 slices, which is done 4 voxels at a time.
+    const bool rows = !m_voxels.empty() && m_indexer.layout() == VoxelLayout::Linear
+        && cells[0][1] == cells[0][0] + 2 && cells[1][1] == cells[1][0] + 2 && cells[2][1] == cells[2][0] + 2;
+    if (!rows) {
+        return combine([&](int x, int y, int z) {
+            return interpolateCell(getCellCorners<T>(cells[0][x], cells[1][y], cells[2][z]), glm::vec3(factors[0][x], factors[1][y], factors[2][z]));
+        });
+    }
+
+    const size_t strideY = size_t(m_dim.x);
+    const size_t strideZ = size_t(m_dim.x) * size_t(m_dim.y);
+    const size_t base = size_t(cells[0][0]) + strideY * size_t(cells[1][0]) + strideZ * size_t(cells[2][0]);
+    return sumVoxels<T>(m_voxels.data(), base, strideY, strideZ, sampleWeights(factors[0], g1.x), sampleWeights(factors[1], g1.y), sampleWeights(factors[2], g1.z));
+}
+
+// Load the volume from the cache file that was written after an earlier load of the file, if there is a valid one for
+// this layout. The voxels are used in place and the statistics are read from the header, so nothing is computed.
+bool Volume::loadCacheFile(const std::filesystem::path& file, VoxelLayout layout)
+{
+    m_pCache = VolumeCache::open(file, layout);
+    if (!m_pCache)
+        return false;
+
+    m_fileExtension = lowercaseExtension(file) == ".dat" ? FileExtension::DAT : FileExtension::FLD;
+    m_dim = m_pCache->dims();
+    m_voxelType = m_pCache->voxelType();
+    m_elementSize = m_voxelType == VoxelType::UInt8 ? 1 : (m_voxelType == VoxelType::UInt16 ? 2 : 4);
+    m_indexer = VoxelIndexer(layout, m_dim);
+    m_voxels = m_pCache->voxels();
+
+    m_minimum = m_pCache->minimum();
+    m_maximum = m_pCache->maximum();
+    m_mean = m_pCache->mean();
+    m_variance = m_pCache->variance();
+    const auto histogram = m_pCache->histogram();
+    m_histogram.assign(std::begin(histogram), std::end(histogram));
+    return true;
 }
 
 // Load an fld volume data file
-// First read and parse the header, then the volume data can be directly converted from bytes to uint16_ts
-void Volume::loadFile(const std::filesystem::path& file)
+// First read and parse the header, then the data section is memory mapped so that it can be sampled in place.
+// Out-of-core volumes instead open a brick cache on the data section.
+void Volume::loadFile(const std::filesystem::path& file, const LoadConfig& config)
 {
-    assert(std::filesystem::exists(file));
     std::ifstream ifs(file, std::ios::binary);
-    assert(ifs.is_open());
+    if (!ifs.is_open())
+        throw std::runtime_error("Cannot open volume file " + file.string());
 
-    // Normalize file extension to lowercase
-    std::string extension = file.extension().string();
-    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    const std::string extension = lowercaseExtension(file);
 
     // Check file type
     if (extension == ".fld") {
@@ -246,37 +917,262 @@ void Volume::loadFile(const std::filesystem::path& file)
         m_fileExtension = FileExtension::DAT;
     }
     else {
-        std::cerr << "Unsupported file extension: " << extension << "\n";
-        return;
+        throw std::runtime_error("Unsupported file extension: " + extension);
     }
 
     const auto header = readHeader(ifs, m_fileExtension);
     m_dim = header.dim;
     m_elementSize = header.elementSize;
+    m_voxelType = m_elementSize == 1 ? VoxelType::UInt8 : VoxelType::UInt16;
+    m_indexer = VoxelIndexer(VoxelLayout::Linear, m_dim);
+
+    // Data section is separated from header by two /f characters.
+    if (m_fileExtension == FileExtension::FLD)
+        ifs.seekg(2, std::ios::cur);
+
+    if (config.loadsSubVolume()) {
+        loadSubVolume(ifs, config);
+        return;
+    }
+
+    const std::streamoff dataOffset = ifs.tellg();
+    if (config.outOfCore && dataOffset >= 0) {
+        m_pBrickCache = std::make_unique<BrickCache>(file, static_cast<size_t>(dataOffset), m_dim, m_elementSize, config.brickCacheBudget);
+        computeStatistics(ifs);
+        return;
+    }
+    if (dataOffset < 0 || !mapVolumeData(file, static_cast<size_t>(dataOffset)))
+        loadVolumeData(ifs);
+}
+
+// Map the data section of the file (starting at dataOffset) into memory. Nothing is read from disk here; the OS pages
+// the voxels in when they are first sampled. Returns false if the file cannot be mapped or if it is too small to
+// contain all voxels, in which case the caller should fall back to loadVolumeData.
+bool Volume::mapVolumeData(const std::filesystem::path& file, size_t dataOffset)
+{
+    const size_t voxelCount = size_t(m_dim.x) * size_t(m_dim.y) * size_t(m_dim.z);
+    const size_t byteCount = voxelCount * m_elementSize;
+    if (byteCount == 0)
+        return false;
 
-    loadVolumeData(ifs);
+    MappedFile mappedFile { file };
+    if (!mappedFile.isOpen() || mappedFile.bytes().size() < dataOffset + byteCount)
+        return false;
+
+    // Moving the mapping does not change its address so the span remains valid.
+    m_voxels = mappedFile.bytes().subspan(dataOffset, byteCount);
+    m_mappedFile.emplace(std::move(mappedFile));
+    return true;
 }
 
+// Fallback for when the file cannot be memory mapped: read the data section into memory. The voxels are kept in
+// their on-disk format so no conversion is needed.
 void Volume::loadVolumeData(std::ifstream& ifs)
 {
-    const size_t voxelCount = static_cast<size_t>(m_dim.x * m_dim.y * m_dim.z);
+    const size_t voxelCount = size_t(m_dim.x) * size_t(m_dim.y) * size_t(m_dim.z);
     const size_t byteCount = voxelCount * m_elementSize;
-    std::vector<char> buffer(byteCount);
-    // Data section is separated from header by two /f characters.
-    if (m_fileExtension == FileExtension::FLD) ifs.seekg(2, std::ios::cur);
-    ifs.read(buffer.data(), std::streamsize(byteCount));
+    m_ownedVoxels.resize(byteCount);
+    if (!readChunked(ifs, m_ownedVoxels))
+        std::cerr << "Volume file " << m_fileName << " ended before all voxels were read" << std::endl;
+    m_voxels = m_ownedVoxels;
+}
 
-    m_data.resize(voxelCount);
-    if (m_elementSize == 1) { // Bytes.
-        for (size_t i = 0; i < byteCount; i++) {
-            m_data[i] = static_cast<float>(buffer[i] & 0xFF);
-        }
-    } else if (m_elementSize == 2) { // uint16_ts.
-        for (size_t i = 0; i < byteCount; i += 2) {
-            m_data[i / 2] = static_cast<float>((buffer[i] & 0xFF) + (buffer[i + 1] & 0xFF) * 256);
+// Load the voxels in the crop box of config, downsampled by config.downsampleFactor, from the data section (starting at
+// the current position of ifs) into m_ownedVoxels. The volume takes the dimensions of the result.
+void Volume::loadSubVolume(std::ifstream& ifs, const LoadConfig& config)
+{
+    const glm::ivec3 fileDim = m_dim;
+    const glm::ivec3 begin = glm::clamp(config.cropMin, glm::ivec3(0), fileDim);
+    const glm::ivec3 end = glm::clamp(config.cropMax, begin, fileDim);
+    const int factor = std::max(config.downsampleFactor, 1);
+    m_dim = (end - begin + factor - 1) / factor;
+    m_indexer = VoxelIndexer(VoxelLayout::Linear, m_dim);
+    m_ownedVoxels.resize(size_t(m_dim.x) * size_t(m_dim.y) * size_t(m_dim.z) * m_elementSize);
+    m_voxels = m_ownedVoxels;
+    if (m_ownedVoxels.empty())
+        return;
+
+    bool success = false;
+    switch (m_voxelType) {
+    case VoxelType::UInt8: {
+        success = readSubVolume<uint8_t>(ifs, fileDim, begin, end, factor, config.downsampleFilter, m_ownedVoxels);
+        break;
+    }
+    case VoxelType::UInt16: {
+        success = readSubVolume<uint16_t>(ifs, fileDim, begin, end, factor, config.downsampleFilter, m_ownedVoxels);
+        break;
+    }
+    case VoxelType::Float: {
+        success = readSubVolume<float>(ifs, fileDim, begin, end, factor, config.downsampleFilter, m_ownedVoxels);
+        break;
+    }
+    }
+    if (!success)
+        std::cerr << "Volume file " << m_fileName << " ended before all voxels were read" << std::endl;
+}
+
+// Reorder the voxels from scanline order into the given layout. Reordering requires a copy, so a volume that was
+// memory mapped will be read completely and the mapping is released afterwards.
+void Volume::applyLayout(VoxelLayout layout)
+{
+    if (layout == VoxelLayout::Linear)
+        return;
+
+    const VoxelIndexer linearIndexer = m_indexer;
+    const VoxelIndexer indexer { layout, m_dim };
+    std::vector<std::byte> reordered(indexer.size() * m_elementSize);
+#pragma omp parallel for
+    for (int64_t i = 0; i < int64_t(indexer.size()); i++) {
+        const glm::ivec3 p = indexer.position(size_t(i));
+        // Padding outside of the volume is left at zero.
+        if (glm::all(glm::lessThan(p, m_dim)))
+            std::memcpy(reordered.data() + size_t(i) * m_elementSize, m_voxels.data() + linearIndexer.index(p.x, p.y, p.z) * m_elementSize, m_elementSize);
+    }
+
+    m_indexer = indexer;
+    m_ownedVoxels = std::move(reordered);
+    m_voxels = m_ownedVoxels;
+    m_ownedFloatVoxels = {};
+    m_mappedFile.reset();
+}
+
+// Compress the voxels (which are still in scanline order) into bricks. The uncompressed voxels are released afterwards.
+void Volume::compressVoxels()
+{
+    m_pCompressedBricks = std::make_unique<CompressedBricks>(m_voxels, m_dim, m_voxelType);
+    m_indexer = VoxelIndexer(VoxelLayout::Bricked, m_dim);
+    m_voxels = {};
+    m_ownedVoxels = {};
+    m_ownedFloatVoxels = {};
+    m_mappedFile.reset();
+}
+
+// Build the levels of the mip pyramid, each from the previous one, until the next level would be less than 2 voxels
+// thick along some axis (trilinear interpolation needs at least 2 voxels along every axis).
+void Volume::buildMipPyramid()
+{
+    const Volume* pLevel = this;
+    while (glm::all(glm::greaterThanEqual((pLevel->m_dim + 1) / 2, glm::ivec3(2)))) {
+        m_mipLevels.push_back(pLevel->createMipLevel());
+        pLevel = m_mipLevels.back().get();
+    }
+}
+
+// Use the levels of the mip pyramid that are stored in the cache file that the volume was loaded from.
+void Volume::loadCachedMipPyramid()
+{
+    for (int lod = 1; lod <= m_pCache->mipLevelCount(); lod++)
+        m_mipLevels.push_back(std::unique_ptr<Volume>(new Volume(*m_pCache, lod)));
+}
+
+std::unique_ptr<Volume> Volume::createMipLevel() const
+{
+    switch (m_voxelType) {
+    case VoxelType::UInt8: {
+        return createMipLevel<uint8_t>();
+    }
+    case VoxelType::UInt16: {
+        return createMipLevel<uint16_t>();
+    }
+    case VoxelType::Float: {
+        return createMipLevel<float>();
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
+// Downsample the volume by averaging blocks of 2x2x2 voxels. The blocks on the border of volumes with odd dimensions
+// are only partially filled; they average the voxels that exist. The level keeps the voxel type of this volume.
+template <typename T>
+std::unique_ptr<Volume> Volume::createMipLevel() const
+{
+    const glm::ivec3 levelDim = (m_dim + 1) / 2;
+    std::vector<std::byte> voxels(size_t(levelDim.x) * size_t(levelDim.y) * size_t(levelDim.z) * sizeof(T));
+#pragma omp parallel for
+    for (int z = 0; z < levelDim.z; z++) {
+        for (int y = 0; y < levelDim.y; y++) {
+            for (int x = 0; x < levelDim.x; x++) {
+                float sum = 0.0f;
+                int count = 0;
+                for (int dz = 0; dz < 2; dz++) {
+                    for (int dy = 0; dy < 2; dy++) {
+                        for (int dx = 0; dx < 2; dx++) {
+                            const glm::ivec3 p { 2 * x + dx, 2 * y + dy, 2 * z + dz };
+                            if (glm::all(glm::lessThan(p, m_dim))) {
+                                sum += getVoxel<T>(p.x, p.y, p.z);
+                                count++;
+                            }
+                        }
+                    }
+                }
+                const float average = sum / float(count);
+                const T value = std::is_integral_v<T> ? T(average + 0.5f) : T(average);
+                const size_t index = size_t(x) + size_t(levelDim.x) * (size_t(y) + size_t(levelDim.y) * size_t(z));
+                std::memcpy(voxels.data() + index * sizeof(T), &value, sizeof(T));
+            }
         }
     }
+    return std::make_unique<Volume>(levelDim, m_voxelType, std::move(voxels));
+}
+
+void Volume::computeStatistics()
+{
+    Statistics statistics {};
+    switch (m_voxelType) {
+    case VoxelType::UInt8: {
+        statistics = ::computeStatistics<uint8_t>(m_voxels);
+        break;
+    }
+    case VoxelType::UInt16: {
+        statistics = ::computeStatistics<uint16_t>(m_voxels);
+        break;
+    }
+    case VoxelType::Float: {
+        statistics = ::computeStatistics<float>(m_voxels);
+        break;
+    }
+    }
+    m_minimum = statistics.minimum;
+    m_maximum = statistics.maximum;
+    m_mean = statistics.mean;
+    m_variance = statistics.variance;
+    m_histogram = saturateHistogram(statistics.histogram);
+}
+
+// Compute the statistics of a volume that does not fit in memory by streaming the data section (starting at the
+// current position of ifs) through a fixed size buffer.
+void Volume::computeStatistics(std::ifstream& ifs)
+{
+    constexpr size_t chunkVoxels = size_t(1) << 24;
+    const size_t voxelCount = size_t(m_dim.x) * size_t(m_dim.y) * size_t(m_dim.z);
+
+    std::vector<std::byte> chunk(std::min(chunkVoxels, voxelCount) * m_elementSize);
+    Statistics statistics {};
+    size_t processed = 0;
+    while (processed < voxelCount) {
+        const size_t count = std::min(chunkVoxels, voxelCount - processed);
+        ifs.read(reinterpret_cast<char*>(chunk.data()), std::streamsize(count * m_elementSize));
+        const gsl::span<const std::byte> chunkData { chunk.data(), count * m_elementSize };
+        const Statistics chunkStatistics = m_voxelType == VoxelType::UInt8 ? ::computeStatistics<uint8_t>(chunkData) : ::computeStatistics<uint16_t>(chunkData);
+        statistics = processed == 0 ? chunkStatistics : mergeStatistics(statistics, processed, chunkStatistics, count);
+        processed += count;
+    }
+    m_minimum = statistics.minimum;
+    m_maximum = statistics.maximum;
+    m_mean = statistics.mean;
+    m_variance = statistics.variance;
+    m_histogram = saturateHistogram(statistics.histogram);
+}
 }
+
+// Normalize file extension to lowercase
+static std::string lowercaseExtension(const std::filesystem::path& file)
+{
+    std::string extension = file.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension;
 }
 
 static Header readHeader(std::ifstream& ifs, const volume::FileExtension& fileExtension)
@@ -298,11 +1194,11 @@ Header readVolumeHeader_dat(std::ifstream& ifs)
     const std::size_t nbytes = 2;
     char buff[nbytes];
     ifs.read(buff, nbytes);
-    std::memcpy(&sizeX, buff, sizeof(int));
+    std::memcpy(&sizeX, buff, nbytes);
     ifs.read(buff, nbytes);
-    std::memcpy(&sizeY, buff, sizeof(int));
+    std::memcpy(&sizeY, buff, nbytes);
     ifs.read(buff, nbytes);
-    std::memcpy(&sizeZ, buff, sizeof(int));
+    std::memcpy(&sizeZ, buff, nbytes);
     out.dim.x = sizeX;
     out.dim.y = sizeY;
     out.dim.z = sizeZ;
@@ -364,20 +1260,211 @@ Header readVolumeHeader_fld(std::ifstream& ifs)
     return out;
 }
 
-static float computeMinimum(gsl::span<const float> data)
+// The data section of a mapped file is not necessarily aligned to the element size (the .fld header has a variable
+// length), so voxels are loaded with memcpy which compiles to a plain (unaligned) load.
+template <typename T>
+static T loadUnaligned(const std::byte* pData, size_t index)
+{
+    T out;
+    std::memcpy(&out, pData + index * sizeof(T), sizeof(T));
+    return out;
+}
+
+// Compute the minimum, maximum, mean, variance and histogram of the voxels in a single parallel pass over the data.
+// The data is processed in blocks: each block is first reduced with a SIMD loop (min/max/sum/sum of squares) and then
+// added to the histogram while it is still in cache. Every thread has its own histogram; they are merged at the end.
+template <typename T>
+static Statistics computeStatistics(gsl::span<const std::byte> data)
+{
+    // Integer voxels have a small range, so the histogram can be filled without knowing the maximum beforehand.
+    // The sums of a block of integer voxels are computed exactly with integers.
+    constexpr bool isIntegral = std::is_integral_v<T>;
+    using Accumulator = std::conditional_t<isIntegral, uint64_t, double>;
+    constexpr size_t blockSize = 1 << 16;
+
+    const std::byte* pData = data.data();
+    const size_t count = data.size() / sizeof(T);
+    const auto blockCount = int64_t((count + blockSize - 1) / blockSize);
+    const size_t binCount = isIntegral ? size_t(std::numeric_limits<T>::max()) + 1 : 0;
+
+    T minimum = std::numeric_limits<T>::max();
+    T maximum = std::numeric_limits<T>::lowest();
+    double sum = 0.0, sumSquares = 0.0;
+    std::vector<uint64_t> histogram(binCount, 0);
+#pragma omp parallel
+    {
+        T localMinimum = std::numeric_limits<T>::max();
+        T localMaximum = std::numeric_limits<T>::lowest();
+        double localSum = 0.0, localSumSquares = 0.0;
+        std::vector<uint64_t> localHistogram(binCount, 0);
+
+#pragma omp for schedule(static) nowait
+        for (int64_t block = 0; block < blockCount; block++) {
+            const size_t begin = size_t(block) * blockSize;
+            const size_t end = std::min(begin + blockSize, count);
+
+            T blockMinimum = localMinimum, blockMaximum = localMaximum;
+            Accumulator blockSum = 0, blockSumSquares = 0;
+#pragma omp simd reduction(min : blockMinimum) reduction(max : blockMaximum) reduction(+ : blockSum, blockSumSquares)
+            for (size_t i = begin; i < end; i++) {
+                const T value = loadUnaligned<T>(pData, i);
+                blockMinimum = std::min(blockMinimum, value);
+                blockMaximum = std::max(blockMaximum, value);
+                blockSum += Accumulator(value);
+                blockSumSquares += Accumulator(value) * Accumulator(value);
+            }
+            localMinimum = blockMinimum;
+            localMaximum = blockMaximum;
+            localSum += double(blockSum);
+            localSumSquares += double(blockSumSquares);
+
+            if constexpr (isIntegral) {
+                for (size_t i = begin; i < end; i++)
+                    localHistogram[loadUnaligned<T>(pData, i)]++;
+            }
+        }
+
+#pragma omp critical
+        {
+            minimum = std::min(minimum, localMinimum);
+            maximum = std::max(maximum, localMaximum);
+            sum += localSum;
+            sumSquares += localSumSquares;
+            for (size_t bin = 0; bin < binCount; bin++)
+                histogram[bin] += localHistogram[bin];
+        }
+    }
+
+    Statistics out {};
+    out.minimum = float(minimum);
+    out.maximum = float(maximum);
+    const double mean = sum / double(count);
+    out.mean = float(mean);
+    out.variance = float(std::max(sumSquares / double(count) - mean * mean, 0.0));
+
+    // Like before, the histogram has a bin for every integer value from 0 up to and including the maximum.
+    if constexpr (isIntegral) {
+        histogram.resize(size_t(maximum) + 1);
+    } else {
+        // The range of float voxels is only known after the first pass, so the histogram requires a second one.
+        histogram.assign(size_t(std::max(maximum, T(0))) + 1, 0);
+        const auto voxelCount = int64_t(count);
+#pragma omp parallel
+        {
+            std::vector<uint64_t> localHistogram(histogram.size(), 0);
+#pragma omp for schedule(static) nowait
+            for (int64_t i = 0; i < voxelCount; i++)
+                localHistogram[size_t(std::max(loadUnaligned<T>(pData, size_t(i)), T(0)))]++;
+#pragma omp critical
+            {
+                for (size_t bin = 0; bin < histogram.size(); bin++)
+                    histogram[bin] += localHistogram[bin];
+            }
+        }
+    }
+    out.histogram = std::move(histogram);
+    return out;
+}
+
+// Combine the statistics of two disjoint sets of voxels, which contain lhsCount and rhsCount voxels respectively.
+static Statistics mergeStatistics(const Statistics& lhs, size_t lhsCount, const Statistics& rhs, size_t rhsCount)
+{
+    const double lhsWeight = double(lhsCount) / double(lhsCount + rhsCount);
+    const double rhsWeight = 1.0 - lhsWeight;
+    const double lhsMean = double(lhs.mean), rhsMean = double(rhs.mean);
+    const double mean = lhsWeight * lhsMean + rhsWeight * rhsMean;
+    // Combine the means of the squares (variance + mean^2) and convert back into a variance.
+    const double meanSquares = lhsWeight * (double(lhs.variance) + lhsMean * lhsMean) + rhsWeight * (double(rhs.variance) + rhsMean * rhsMean);
+
+    Statistics out {};
+    out.minimum = std::min(lhs.minimum, rhs.minimum);
+    out.maximum = std::max(lhs.maximum, rhs.maximum);
+    out.mean = float(mean);
+    out.variance = float(std::max(meanSquares - mean * mean, 0.0));
+    out.histogram = lhs.histogram.size() >= rhs.histogram.size() ? lhs.histogram : rhs.histogram;
+    const std::vector<uint64_t>& smaller = lhs.histogram.size() >= rhs.histogram.size() ? rhs.histogram : lhs.histogram;
+    for (size_t bin = 0; bin < smaller.size(); bin++)
+        out.histogram[bin] += smaller[bin];
+    return out;
+}
+
+static std::vector<int> saturateHistogram(const std::vector<uint64_t>& histogram)
 {
-    return float(*std::min_element(std::begin(data), std::end(data)));
+    std::vector<int> out(histogram.size());
+    std::transform(std::begin(histogram), std::end(histogram), std::begin(out),
+        [](uint64_t count) { return int(std::min(count, uint64_t(std::numeric_limits<int>::max()))); });
+    return out;
 }
 
-static float computeMaximum(gsl::span<const float> data)
+// Read out.size() bytes in chunks. A single read of several gigabytes is not supported by every standard library (and
+// some file systems), and reading in chunks keeps the size of every individual read well within std::streamsize.
+static bool readChunked(std::ifstream& ifs, gsl::span<std::byte> out)
 {
-    return float(*std::max_element(std::begin(data), std::end(data)));
+    constexpr size_t chunkSize = size_t(1) << 26;
+    for (size_t offset = 0; offset < out.size() && ifs; offset += chunkSize) {
+        const size_t size = std::min(chunkSize, out.size() - offset);
+        ifs.read(reinterpret_cast<char*>(out.data() + offset), std::streamsize(size));
+    }
+    return bool(ifs);
 }
 
-static std::vector<int> computeHistogram(gsl::span<const float> data)
+// Read the voxels in the box [begin, end) of the data section (which starts at the current position of ifs) and
+// downsample them by factor into out (in scanline order). The box is read row by row; only the rows that contribute
+// to the result are read (with the stride filter that is every factor-th row of every factor-th slice) and the
+// stream only seeks when the next row does not directly follow the previous one.
+template <typename T>
+static bool readSubVolume(std::ifstream& ifs, const glm::ivec3& fileDim, const glm::ivec3& begin, const glm::ivec3& end, int factor, volume::DownsampleFilter filter, gsl::span<std::byte> out)
 {
-    std::vector<int> histogram(size_t(*std::max_element(std::begin(data), std::end(data)) + 1), 0);
-    for (const auto v : data)
-        histogram[v]++;
-    return histogram;
+    const std::streamoff dataOffset = ifs.tellg();
+    const glm::ivec3 dim = (end - begin + factor - 1) / factor;
+    const bool boxFilter = filter == volume::DownsampleFilter::BoxFilter;
+    // Range of the file voxels along one axis that contribute to voxel i of the result.
+    auto blockEnd = [&](int axisBegin, int axisEnd, int i) { return boxFilter ? std::min(axisBegin + (i + 1) * factor, axisEnd) : axisBegin + i * factor + 1; };
+
+    std::vector<T> row(size_t(end.x - begin.x));
+    // Sums of the voxels of the blocks of one slice of the result.
+    std::vector<double> sums(boxFilter ? size_t(dim.x) * size_t(dim.y) : 0);
+    std::streamoff position = dataOffset;
+    for (int z = 0; z < dim.z; z++) {
+        std::fill(std::begin(sums), std::end(sums), 0.0);
+        for (int fileZ = begin.z + z * factor; fileZ < blockEnd(begin.z, end.z, z); fileZ++) {
+            for (int y = 0; y < dim.y; y++) {
+                for (int fileY = begin.y + y * factor; fileY < blockEnd(begin.y, end.y, y); fileY++) {
+                    const size_t fileIndex = size_t(begin.x) + size_t(fileDim.x) * (size_t(fileY) + size_t(fileDim.y) * size_t(fileZ));
+                    const std::streamoff rowOffset = dataOffset + std::streamoff(fileIndex * sizeof(T));
+                    if (rowOffset != position)
+                        ifs.seekg(rowOffset);
+                    ifs.read(reinterpret_cast<char*>(row.data()), std::streamsize(row.size() * sizeof(T)));
+                    position = rowOffset + std::streamoff(row.size() * sizeof(T));
+
+                    for (int x = 0; x < dim.x; x++) {
+                        if (boxFilter) {
+                            double& sum = sums[size_t(x) + size_t(dim.x) * size_t(y)];
+                            for (int fileX = x * factor; fileX < blockEnd(0, end.x - begin.x, x); fileX++)
+                                sum += double(row[size_t(fileX)]);
+                        } else {
+                            const size_t index = size_t(x) + size_t(dim.x) * (size_t(y) + size_t(dim.y) * size_t(z));
+                            std::memcpy(out.data() + index * sizeof(T), &row[size_t(x * factor)], sizeof(T));
+                        }
+                    }
+                }
+            }
+        }
+
+        if (boxFilter) {
+            // The blocks on the far sides of the crop box are only partially filled; they average the voxels that exist.
+            const int countZ = blockEnd(begin.z, end.z, z) - (begin.z + z * factor);
+            for (int y = 0; y < dim.y; y++) {
+                const int countY = blockEnd(begin.y, end.y, y) - (begin.y + y * factor);
+                for (int x = 0; x < dim.x; x++) {
+                    const int countX = blockEnd(0, end.x - begin.x, x) - x * factor;
+                    const double average = sums[size_t(x) + size_t(dim.x) * size_t(y)] / double(countX * countY * countZ);
+                    const T value = std::is_integral_v<T> ? T(average + 0.5) : T(average);
+                    const size_t index = size_t(x) + size_t(dim.x) * (size_t(y) + size_t(dim.y) * size_t(z));
+                    std::memcpy(out.data() + index * sizeof(T), &value, sizeof(T));
+                }
+            }
+        }
+    }
+    return bool(ifs);
 }
@@ -1,40 +1,132 @@
 #pragma once
+#include "brick_cache.h"
+#include "compressed_bricks.h"
+#include "load_config.h"
+#include "mapped_file.h"
+#include "voxel_layout.h"
+#include <array>
 #include <filesystem>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <gsl/span>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
 namespace volume {
 
+class VolumeCache;
+
 enum class FileExtension {
     FLD = 0,
     DAT = 1
 }; 
 
+// Format in which the voxels are stored in memory. Voxels are kept in the width of the source data.
+enum class VoxelType {
+    UInt8 = 0,
+    UInt16,
+    Float
+};
+
 enum class InterpolationMode {
     NearestNeighbour = 0,
     Linear,
     Cubic
 };
 
+// Instruction sets that Volume::sampleBatch and GradientVolume::sampleBatch can use.
+enum class SimdLevel {
+    Scalar = 0,
+    AVX2, // 8 samples at a time.
+    AVX512 // 16 samples at a time.
+};
+
+// The widest instruction set that the batched sampling kernels can use on this CPU (detected once). The AVX2 and
+// AVX-512 kernels are only built for x86-64.
+SimdLevel bestSimdLevel();
+
+// Trilinear interpolation of the 8 corners of a cell (x changing fastest, then y and z) at the position t within the
+// cell. Inline, so that callers that keep the corners of a cell (see RaySampler) interpolate without a call.
+inline float interpolateCell(const std::array<float, 8>& corners, const glm::vec3& t)
+{
+    auto linearInterpolate = [](float g0, float g1, float factor) { return g0 * (1.0f - factor) + g1 * factor; };
+    const float valZ0 = linearInterpolate(linearInterpolate(corners[0], corners[1], t.x), linearInterpolate(corners[2], corners[3], t.x), t.y);
+    const float valZ1 = linearInterpolate(linearInterpolate(corners[4], corners[5], t.x), linearInterpolate(corners[6], corners[7], t.x), t.y);
+    return linearInterpolate(valZ0, valZ1, t.z);
+}
+
 class Volume {
 public:
     // DO NOT REMOVE
     InterpolationMode interpolationMode { InterpolationMode::NearestNeighbour };
 
 public:
-    Volume(const std::filesystem::path& file);
-    Volume(std::vector<float> data, const glm::ivec3& dim);
+    // Throws std::runtime_error if the file cannot be opened or is not a .fld or .dat file.
+    Volume(const std::filesystem::path& file, const LoadConfig& config = {});
+    Volume(std::vector<float> data, const glm::ivec3& dim, const LoadConfig& config = {});
+    // Volume that owns the given voxels (of voxelType, in scanline order). No mip pyramid is built.
+    Volume(const glm::ivec3& dim, VoxelType voxelType, std::vector<std::byte> voxels);
 
     float minimum() const;
     float maximum() const;
+    float mean() const;
+    float variance() const;
+    // Number of voxels per integer value. Counts are computed with 64-bit integers and saturate at INT_MAX, which only
+    // happens for the dominant values (typically the background) of volumes with more than 2^31 voxels.
     std::vector<int> histogram() const;
     glm::ivec3 dims() const;
+    VoxelType voxelType() const;
+    VoxelLayout layout() const;
     std::string_view fileName() const;
+    // Cache through which the voxels are read for volumes that were loaded out-of-core (nullptr otherwise).
+    const BrickCache* brickCache() const;
+    // Cache file that the volume was loaded from (nullptr if it was not loaded from a cache file).
+    std::shared_ptr<const VolumeCache> cache() const;
+    // Compressed voxels of volumes that are kept compressed in memory (nullptr otherwise).
+    const CompressedBricks* compressedBricks() const;
+    // The voxels in storage order (see m_voxels). Empty for out-of-core and compressed volumes.
+    gsl::span<const std::byte> voxels() const;
+    // Number of downsampled levels in the mip pyramid (0 if the pyramid was not built).
+    int mipLevelCount() const;
+    // The level of the mip pyramid that getSampleInterpolate(coord, lod) samples (the volume itself for lod 0 or if the
+    // pyramid was not built).
+    const Volume& mipLevel(int lod) const;
 
     float getSampleInterpolate(const glm::vec3& coord) const;
+    // Sample level lod of the mip pyramid (level 0 is the volume itself) with the current interpolation mode. The
+    // coordinates are in voxels of level 0. Levels beyond the coarsest one are clamped to the coarsest level.
+    float getSampleInterpolate(const glm::vec3& coord, int lod) const;
+    // getSampleInterpolate(coord, lod) with the interpolation mode fixed at compile time, for callers that select it once
+    // for many samples (see render::Renderer::selectTraceFunction). Instantiated for all interpolation modes.
+    template <InterpolationMode mode>
+    float getSampleInterpolate(const glm::vec3& coord, int lod) const;
+    // Sample many positions at once: out[i] = getSampleInterpolate(positions[i]). If the voxels are in memory in the
+    // linear layout then the nearest neighbour and linear modes sample 8 or 16 positions per instruction (with gathers)
+    // using simdLevel, which is limited to bestSimdLevel(). All other cases sample the positions one by one.
+    void sampleBatch(gsl::span<const glm::vec3> positions, gsl::span<float> out, SimdLevel simdLevel = bestSimdLevel()) const;
+    // Whether sampleBatch samples with the SIMD kernels rather than one by one.
+    bool vectorizesSampleBatch(SimdLevel simdLevel = bestSimdLevel()) const;
+    // Trilinear interpolation of uint8_t and uint16_t voxels in fixed point: the interpolation factors have
+    // fixedPointFactorBits fractional bits and the interpolated values 8 (uint8_t) or 0 (uint16_t), which makes it differ
+    // from getSampleTriLinearInterpolation by less than 1/32 (uint8_t) or 8 (uint16_t), about 1e-4 of the value range.
+    // It is exact at the voxels. Float voxels are interpolated in floating point.
+    float getSampleTriLinearFixedPoint(const glm::vec3& coord) const;
+    // sampleBatch with getSampleTriLinearFixedPoint as the linear mode, which the SIMD kernels compute in 32-bit integer
+    // lanes. Identical to sampleBatch for the other modes and for float voxels.
+    void sampleBatchFixedPoint(gsl::span<const glm::vec3> positions, gsl::span<float> out, SimdLevel simdLevel = bestSimdLevel()) const;
     float getVoxel(int x, int y, int z) const;
+    // The voxels at the corners of the cell with lower corner (x0, y0, z0) in the order of interpolateCell. The cell
+    // must lie inside of the volume.
+    std::array<float, 8> getCellCorners(int x0, int y0, int z0) const;
+
+    // Replace the voxels by those of another file with the same dimensions and voxel type (such as the next timestep of
+    // a VolumeSequence). The voxels are read into the memory that this volume already owns, so this only works for
+    // volumes that own their voxels in the linear layout and have no mip pyramid. The statistics are not updated.
+    bool readVoxels(const std::filesystem::path& file);
+    // The voxels of a volume that owns them in the linear layout, for updating them in place (empty otherwise).
+    gsl::span<std::byte> mutableVoxels();
 
 protected:
     float getSampleNearestNeighbourInterpolation(const glm::vec3& coord) const;
@@ -43,25 +135,79 @@ protected:
     float biLinearInterpolate(const glm::vec2& xyCoord, int z) const;
     static float linearInterpolate(float g0, float g1, float factor);
 
+    // Kernels specialized for the voxel type (T = uint8_t, uint16_t or float). The functions above select the
+    // specialization matching m_voxelType once per sample.
+    template <typename T>
+    float getSampleInterpolate(const glm::vec3& coord) const;
+    template <typename T>
+    float getVoxel(int x, int y, int z) const;
+    template <typename T>
+    float getSampleNearestNeighbourInterpolation(const glm::vec3& coord) const;
+    template <typename T>
+    float getSampleTriLinearInterpolation(const glm::vec3& coord) const;
+    template <typename T>
+    float getSampleTriLinearFixedPoint(const glm::vec3& coord) const;
+    template <typename T>
+    float biLinearInterpolate(const glm::vec2& xyCoord, int z) const;
+    template <typename T>
+    std::array<float, 8> getCellCorners(int x0, int y0, int z0) const;
+    template <typename T>
+    float getSampleTriCubicInterpolation(const glm::vec3& coord) const;
+
+
     float getSampleTriCubicInterpolation(const glm::vec3& coord) const;
     float biCubicInterpolate(const glm::vec2& xyCoord, int z) const;
     static float cubicInterpolate(float g0, float g1, float g2, float g3, float factor);
     static float weight(float x);
 
 private:
-    void loadFile(const std::filesystem::path& file);
+    // Level lod of the mip pyramid that is stored in the cache file (see VolumeCache::mipLevelVoxels), sampled in place.
+    Volume(const VolumeCache& cache, int lod);
+
+    bool loadCacheFile(const std::filesystem::path& file, VoxelLayout layout);
+    void loadFile(const std::filesystem::path& file, const LoadConfig& config);
+    bool mapVolumeData(const std::filesystem::path& file, size_t dataOffset);
     void loadVolumeData(std::ifstream& ifs);
+    void loadSubVolume(std::ifstream& ifs, const LoadConfig& config);
+    void computeStatistics();
+    void computeStatistics(std::ifstream& ifs);
+    void applyLayout(VoxelLayout layout);
+    void compressVoxels();
+    void buildMipPyramid();
+    void loadCachedMipPyramid();
+    std::unique_ptr<Volume> createMipLevel() const;
+    template <typename T>
+    std::unique_ptr<Volume> createMipLevel() const;
 
 protected:
     FileExtension m_fileExtension;
 
     const std::string m_fileName;
     size_t m_elementSize;
+    VoxelType m_voxelType;
     glm::ivec3 m_dim;
 
-    std::vector<float> m_data; // technically most of the data we are dealing with is uint16_t but float is easier to work with
+    // View on the voxels (m_indexer.size() elements of m_voxelType, stored in the order given by m_indexer). Voxels
+    // loaded from a file are sampled in place from the memory mapped data section. If the file could not be mapped,
+    // the volume was constructed from memory or the voxels were reordered into a non-linear layout then m_voxels
+    // points into m_ownedVoxels instead (or into m_ownedFloatVoxels for volumes that are constructed from floats, which
+    // keep the vector that they are given rather than copying it into bytes). Volumes that are loaded out-of-core leave
+    // m_voxels empty and read all voxels through m_pBrickCache. Volumes that are loaded from a cache file point m_voxels
+    // into the mapped cache file. Compressed volumes also leave m_voxels empty; their voxels are decoded from
+    // m_pCompressedBricks.
+    VoxelIndexer m_indexer;
+    gsl::span<const std::byte> m_voxels;
+    std::optional<MappedFile> m_mappedFile;
+    std::vector<std::byte> m_ownedVoxels;
+    std::vector<float> m_ownedFloatVoxels;
+    std::unique_ptr<BrickCache> m_pBrickCache;
+    std::shared_ptr<const VolumeCache> m_pCache;
+    std::unique_ptr<CompressedBricks> m_pCompressedBricks;
+    // Level i + 1 of the mip pyramid is stored in m_mipLevels[i] (in the linear layout, whatever the layout of this volume).
+    std::vector<std::unique_ptr<Volume>> m_mipLevels;
 
     float m_minimum, m_maximum;
+    float m_mean, m_variance;
     std::vector<int> m_histogram;
 };
 }
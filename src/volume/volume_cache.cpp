@@ -0,0 +1,361 @@
+#include "volume_cache.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace volume {
+
+// Sections are aligned to the page size so that they can be used in place after the file is memory mapped.
+static constexpr size_t sectionAlignment = 4096;
+static constexpr std::array<char, 8> magic { 'V', 'O', 'L', 'V', 'I', 'S', 'C', '\0' };
+
+enum class Section {
+    Histogram = 0,
+    Voxels,
+    Gradients,
+    Count
+};
+
+struct SectionRange {
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct MipLevelSections {
+    SectionRange voxels;
+    SectionRange gradients;
+};
+
+// The header is stored at the start of the file and is followed by the (aligned) sections.
+struct VolumeCache::Header {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t mipLevelCount;
+    // Identifies the version of the source file that the cache was created from.
+    uint64_t sourceFileSize;
+    int64_t sourceWriteTime;
+
+    int32_t dim[3];
+    uint32_t voxelType;
+    uint32_t layout;
+    float minimum, maximum;
+    float mean, variance;
+    float minMagnitude, maxMagnitude;
+
+    std::array<SectionRange, size_t(Section::Count)> sections;
+    // Level i + 1 of the mip pyramid, for i below mipLevelCount.
+    std::array<MipLevelSections, VolumeCache::maxMipLevels> mipLevels;
+};
+
+static uint64_t alignSection(uint64_t offset)
+{
+    return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+}
+
+static glm::ivec3 levelDims(const glm::ivec3& dim, int lod)
+{
+    glm::ivec3 out = dim;
+    for (int level = 0; level < lod; level++)
+        out = (out + 1) / 2;
+    return out;
+}
+
+static size_t voxelCount(const glm::ivec3& dim)
+{
+    return size_t(dim.x) * size_t(dim.y) * size_t(dim.z);
+}
+
+static size_t elementSize(VoxelType voxelType)
+{
+    switch (voxelType) {
+    case VoxelType::UInt8: {
+        return sizeof(uint8_t);
+    }
+    case VoxelType::UInt16: {
+        return sizeof(uint16_t);
+    }
+    case VoxelType::Float:
+    default: {
+        return sizeof(float);
+    }
+    }
+}
+
+static int64_t sourceWriteTime(const std::filesystem::path& sourceFile)
+{
+    std::error_code error;
+    return std::filesystem::last_write_time(sourceFile, error).time_since_epoch().count();
+}
+
+std::filesystem::path VolumeCache::cacheFile(const std::filesystem::path& sourceFile)
+{
+    std::filesystem::path out = sourceFile;
+    out += ".vvcache";
+    return out;
+}
+
+// The cache directory of the user ($XDG_CACHE_HOME or ~/.cache on Linux and macOS, %LOCALAPPDATA% on Windows), or the
+// temporary directory if there is none. The name of the cache file includes a hash of the absolute path of the
+// source file, so that source files with the same name in different directories get different cache files.
+std::filesystem::path VolumeCache::userCacheFile(const std::filesystem::path& sourceFile)
+{
+    std::filesystem::path directory;
+#ifdef _WIN32
+    if (const char* pLocalAppData = std::getenv("LOCALAPPDATA"))
+        directory = pLocalAppData;
+#else
+    if (const char* pCacheHome = std::getenv("XDG_CACHE_HOME"); pCacheHome && *pCacheHome)
+        directory = pCacheHome;
+    else if (const char* pHome = std::getenv("HOME"); pHome && *pHome)
+        directory = std::filesystem::path(pHome) / ".cache";
+#endif
+    std::error_code error;
+    if (directory.empty())
+        directory = std::filesystem::temp_directory_path(error);
+
+    const auto absolutePath = std::filesystem::absolute(sourceFile, error);
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(std::hash<std::string> {}(absolutePath.string())));
+    return directory / "volvis" / (sourceFile.filename().string() + "." + hash + ".vvcache");
+}
+
+std::shared_ptr<const VolumeCache> VolumeCache::open(const std::filesystem::path& sourceFile, VoxelLayout layout)
+{
+    if (auto pCache = open(sourceFile, cacheFile(sourceFile), layout))
+        return pCache;
+    return open(sourceFile, userCacheFile(sourceFile), layout);
+}
+
+std::shared_ptr<const VolumeCache> VolumeCache::open(const std::filesystem::path& sourceFile, const std::filesystem::path& file, VoxelLayout layout)
+{
+    std::error_code error;
+    if (!std::filesystem::exists(file, error))
+        return nullptr;
+
+    MappedFile mappedFile { file };
+    const auto bytes = mappedFile.bytes();
+    if (!mappedFile.isOpen() || bytes.size() < sizeof(Header))
+        return nullptr;
+
+    Header header;
+    std::memcpy(&header, bytes.data(), sizeof(Header));
+    if (header.magic != magic || header.version != version || header.layout != uint32_t(layout) || header.voxelType > uint32_t(VoxelType::Float)
+        || header.mipLevelCount > uint32_t(maxMipLevels))
+        return nullptr;
+    // The cache is outdated if the source file was modified after it was written.
+    const auto sourceFileSize = std::filesystem::file_size(sourceFile, error);
+    if (error || header.sourceFileSize != sourceFileSize || header.sourceWriteTime != sourceWriteTime(sourceFile))
+        return nullptr;
+
+    // Verify that the sections have the size that the header implies and lie within the file.
+    const glm::ivec3 dim { header.dim[0], header.dim[1], header.dim[2] };
+    const VoxelIndexer indexer { layout, dim };
+    const size_t voxelSize = elementSize(VoxelType(header.voxelType));
+    const std::array<size_t, size_t(Section::Count)> expectedSizes {
+        header.sections[size_t(Section::Histogram)].size / sizeof(int32_t) * sizeof(int32_t),
+        indexer.size() * voxelSize,
+        indexer.size() * sizeof(GradientVoxel)
+    };
+    auto isValid = [&](const SectionRange& section, size_t expectedSize) {
+        return section.size == expectedSize && section.offset % sectionAlignment == 0 && section.offset + section.size <= bytes.size();
+    };
+    for (size_t i = 0; i < expectedSizes.size(); i++) {
+        if (!isValid(header.sections[i], expectedSizes[i]))
+            return nullptr;
+    }
+    for (int lod = 1; lod <= int(header.mipLevelCount); lod++) {
+        const size_t levelVoxels = voxelCount(levelDims(dim, lod));
+        const MipLevelSections& level = header.mipLevels[size_t(lod - 1)];
+        if (!isValid(level.voxels, levelVoxels * voxelSize) || !isValid(level.gradients, levelVoxels * sizeof(GradientVoxel)))
+            return nullptr;
+    }
+
+    return std::shared_ptr<const VolumeCache>(new VolumeCache(std::move(mappedFile)));
+}
+
+bool VolumeCache::write(const std::filesystem::path& sourceFile, const Volume& volume, const GradientVolume& gradientVolume)
+{
+    // The cache file stores the gradients in the full format.
+    if (gradientVolume.format() != GradientFormat::Full)
+        return false;
+
+    const std::vector<int> histogram = volume.histogram();
+    const std::vector<int32_t> histogram32(std::begin(histogram), std::end(histogram));
+    const auto voxels = volume.voxels();
+    const auto gradients = gradientVolume.data();
+
+    std::error_code error;
+    Header header {};
+    header.magic = magic;
+    header.version = version;
+    header.sourceFileSize = std::filesystem::file_size(sourceFile, error);
+    header.sourceWriteTime = sourceWriteTime(sourceFile);
+    header.dim[0] = volume.dims().x;
+    header.dim[1] = volume.dims().y;
+    header.dim[2] = volume.dims().z;
+    header.voxelType = uint32_t(volume.voxelType());
+    header.layout = uint32_t(volume.layout());
+    header.minimum = volume.minimum();
+    header.maximum = volume.maximum();
+    header.mean = volume.mean();
+    header.variance = volume.variance();
+    header.minMagnitude = gradientVolume.minMagnitude();
+    header.maxMagnitude = gradientVolume.maxMagnitude();
+
+    // The sections are written in the order in which they are added.
+    std::vector<gsl::span<const std::byte>> sectionData;
+    uint64_t offset = sizeof(Header);
+    auto addSection = [&](gsl::span<const std::byte> data) {
+        offset = alignSection(offset);
+        const SectionRange section { offset, data.size() };
+        sectionData.push_back(data);
+        offset += data.size();
+        return section;
+    };
+    header.sections[size_t(Section::Histogram)] = addSection(gsl::as_bytes(gsl::span<const int32_t>(histogram32)));
+    header.sections[size_t(Section::Voxels)] = addSection(voxels);
+    header.sections[size_t(Section::Gradients)] = addSection(gsl::as_bytes(gradients));
+    if (volume.mipLevelCount() == gradientVolume.mipLevelCount() && volume.mipLevelCount() <= maxMipLevels) {
+        header.mipLevelCount = uint32_t(volume.mipLevelCount());
+        for (int lod = 1; lod <= volume.mipLevelCount(); lod++) {
+            header.mipLevels[size_t(lod - 1)] = {
+                addSection(volume.mipLevel(lod).voxels()),
+                addSection(gsl::as_bytes(gradientVolume.mipLevel(lod).data()))
+            };
+        }
+    }
+
+    // Next to the source file if possible, otherwise (such as in read-only data directories) in the user cache.
+    if (writeFile(cacheFile(sourceFile), header, sectionData))
+        return true;
+    const auto file = userCacheFile(sourceFile);
+    std::filesystem::create_directories(file.parent_path(), error);
+    return writeFile(file, header, sectionData);
+}
+
+bool VolumeCache::writeFile(const std::filesystem::path& file, const Header& header, gsl::span<const gsl::span<const std::byte>> sectionData)
+{
+    auto tempFile = file;
+    tempFile += ".tmp";
+    std::error_code error;
+    {
+        std::ofstream ofs(tempFile, std::ios::binary);
+        ofs.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        const std::vector<char> padding(sectionAlignment, 0);
+        uint64_t position = sizeof(Header);
+        for (const auto& data : sectionData) {
+            const uint64_t offset = alignSection(position);
+            ofs.write(padding.data(), std::streamsize(offset - position));
+            ofs.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+            position = offset + data.size();
+        }
+        if (!ofs) {
+            std::cerr << "Could not write cache file " << tempFile << std::endl;
+            ofs.close();
+            std::filesystem::remove(tempFile, error);
+            return false;
+        }
+    }
+    std::filesystem::rename(tempFile, file, error);
+    return !error;
+}
+
+VolumeCache::VolumeCache(MappedFile&& mappedFile)
+    : m_mappedFile(std::move(mappedFile))
+    , m_pHeader(reinterpret_cast<const Header*>(m_mappedFile.bytes().data()))
+{
+}
+
+glm::ivec3 VolumeCache::dims() const
+{
+    return { m_pHeader->dim[0], m_pHeader->dim[1], m_pHeader->dim[2] };
+}
+
+VoxelType VolumeCache::voxelType() const
+{
+    return VoxelType(m_pHeader->voxelType);
+}
+
+VoxelLayout VolumeCache::layout() const
+{
+    return VoxelLayout(m_pHeader->layout);
+}
+
+float VolumeCache::minimum() const
+{
+    return m_pHeader->minimum;
+}
+
+float VolumeCache::maximum() const
+{
+    return m_pHeader->maximum;
+}
+
+float VolumeCache::mean() const
+{
+    return m_pHeader->mean;
+}
+
+float VolumeCache::variance() const
+{
+    return m_pHeader->variance;
+}
+
+float VolumeCache::minMagnitude() const
+{
+    return m_pHeader->minMagnitude;
+}
+
+float VolumeCache::maxMagnitude() const
+{
+    return m_pHeader->maxMagnitude;
+}
+
+gsl::span<const int32_t> VolumeCache::histogram() const
+{
+    const SectionRange& section = m_pHeader->sections[size_t(Section::Histogram)];
+    return { reinterpret_cast<const int32_t*>(m_mappedFile.bytes().data() + section.offset), section.size / sizeof(int32_t) };
+}
+
+gsl::span<const std::byte> VolumeCache::voxels() const
+{
+    const SectionRange& section = m_pHeader->sections[size_t(Section::Voxels)];
+    return m_mappedFile.bytes().subspan(size_t(section.offset), size_t(section.size));
+}
+
+gsl::span<const GradientVoxel> VolumeCache::gradients() const
+{
+    const SectionRange& section = m_pHeader->sections[size_t(Section::Gradients)];
+    return { reinterpret_cast<const GradientVoxel*>(m_mappedFile.bytes().data() + section.offset), section.size / sizeof(GradientVoxel) };
+}
+
+int VolumeCache::mipLevelCount() const
+{
+    return int(m_pHeader->mipLevelCount);
+}
+
+glm::ivec3 VolumeCache::mipLevelDims(int lod) const
+{
+    return levelDims(dims(), lod);
+}
+
+gsl::span<const std::byte> VolumeCache::mipLevelVoxels(int lod) const
+{
+    const SectionRange& section = m_pHeader->mipLevels[size_t(lod - 1)].voxels;
+    return m_mappedFile.bytes().subspan(size_t(section.offset), size_t(section.size));
+}
+
+gsl::span<const GradientVoxel> VolumeCache::mipLevelGradients(int lod) const
+{
+    const SectionRange& section = m_pHeader->mipLevels[size_t(lod - 1)].gradients;
+    return { reinterpret_cast<const GradientVoxel*>(m_mappedFile.bytes().data() + section.offset), section.size / sizeof(GradientVoxel) };
+}
+}
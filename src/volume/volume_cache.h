@@ -0,0 +1,70 @@
+#pragma once
+#include "gradient_volume.h"
+#include "mapped_file.h"
+#include "volume.h"
+#include "voxel_layout.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <glm/vec3.hpp>
+#include <gsl/span>
+#include <memory>
+
+namespace volume {
+
+// Preprocessed copy of a volume file that is written next to it after it was loaded for the first time (or to the cache
+// directory of the user if the directory of the volume file is not writable). It holds the voxels (in their storage
+// layout), the statistics, the gradient volume and the levels of the mip pyramid of both (if they were built). All
+// sections are page aligned, so a cached volume is loaded by memory mapping the cache file and using the sections in
+// place.
+class VolumeCache {
+public:
+    // Cache files with a different version are ignored (and overwritten on the next load).
+    static constexpr uint32_t version = 2;
+    // Levels of the mip pyramid that a cache file can hold (the levels of a volume with dimensions below 2^31 are fewer).
+    static constexpr int maxMipLevels = 31;
+
+public:
+    // The cache file next to sourceFile, and the one in the cache directory of the user that is used instead if the
+    // former cannot be written.
+    static std::filesystem::path cacheFile(const std::filesystem::path& sourceFile);
+    static std::filesystem::path userCacheFile(const std::filesystem::path& sourceFile);
+    // Map the cache file of sourceFile (either of the two). Returns nullptr if there is no cache file or if it does not
+    // match the current version of the source file or the requested layout.
+    static std::shared_ptr<const VolumeCache> open(const std::filesystem::path& sourceFile, VoxelLayout layout);
+    // Write the cache file of sourceFile. The file is written under a temporary name and renamed when it is complete,
+    // such that a partially written cache file is never opened. The mip pyramid is stored if both volumes have one.
+    static bool write(const std::filesystem::path& sourceFile, const Volume& volume, const GradientVolume& gradientVolume);
+
+    glm::ivec3 dims() const;
+    VoxelType voxelType() const;
+    VoxelLayout layout() const;
+    float minimum() const;
+    float maximum() const;
+    float mean() const;
+    float variance() const;
+    float minMagnitude() const;
+    float maxMagnitude() const;
+
+    gsl::span<const int32_t> histogram() const;
+    gsl::span<const std::byte> voxels() const;
+    gsl::span<const GradientVoxel> gradients() const;
+
+    // The levels of the mip pyramid (see Volume::mipLevel), for lod in [1, mipLevelCount()]. The levels are stored in
+    // the linear layout.
+    int mipLevelCount() const;
+    glm::ivec3 mipLevelDims(int lod) const;
+    gsl::span<const std::byte> mipLevelVoxels(int lod) const;
+    gsl::span<const GradientVoxel> mipLevelGradients(int lod) const;
+
+private:
+    struct Header;
+    VolumeCache(MappedFile&& mappedFile);
+    static std::shared_ptr<const VolumeCache> open(const std::filesystem::path& sourceFile, const std::filesystem::path& file, VoxelLayout layout);
+    static bool writeFile(const std::filesystem::path& file, const Header& header, gsl::span<const gsl::span<const std::byte>> sectionData);
+
+private:
+    const MappedFile m_mappedFile;
+    const Header* m_pHeader;
+};
+}
@@ -0,0 +1,119 @@
+#include "volume_loader.h"
+#include "volume_cache.h"
+#include <algorithm>
+#include <exception>
+#include <utility>
+
+namespace volume {
+
+using clock = std::chrono::steady_clock;
+
+// State shared between the main thread and the worker of one load. The result and the end time are written by the
+// worker before it stores a final stage (Done, Cancelled or Failed) and are only read after that stage was observed.
+struct VolumeLoader::Task {
+    std::filesystem::path file;
+    clock::time_point start;
+    clock::time_point end;
+    std::atomic<Stage> stage { Stage::LoadingVolume };
+    std::atomic<bool> cancelled { false };
+    std::optional<Result> optResult;
+
+    bool finished() const { return stage.load() >= Stage::Done; }
+    void finish(Stage finalStage)
+    {
+        end = clock::now();
+        stage.store(finalStage);
+    }
+};
+
+VolumeLoader::~VolumeLoader()
+{
+    cancel();
+    for (auto& [pTask, worker] : m_workers)
+        worker.join();
+}
+
+void VolumeLoader::load(const std::filesystem::path& file, const LoadConfig& config)
+{
+    cancel();
+    joinFinishedWorkers();
+
+    m_pTask = std::make_shared<Task>();
+    m_pTask->file = file;
+    m_pTask->start = clock::now();
+    // The thread only gets a reference to the task; m_workers keeps it alive until the thread has been joined.
+    m_workers.emplace_back(m_pTask, std::thread(&VolumeLoader::run, std::ref(*m_pTask), config));
+}
+
+void VolumeLoader::cancel()
+{
+    if (m_pTask)
+        m_pTask->cancelled.store(true);
+}
+
+bool VolumeLoader::isLoading() const
+{
+    return m_pTask && !m_pTask->cancelled.load() && !m_pTask->finished();
+}
+
+std::optional<VolumeLoader::Progress> VolumeLoader::progress() const
+{
+    if (!m_pTask)
+        return {};
+
+    const Stage stage = m_pTask->stage.load();
+    const auto end = stage >= Stage::Done ? m_pTask->end : clock::now();
+    return Progress { m_pTask->file, m_pTask->cancelled.load() ? Stage::Cancelled : stage, end - m_pTask->start };
+}
+
+std::optional<VolumeLoader::Result> VolumeLoader::takeResult()
+{
+    joinFinishedWorkers();
+    if (!m_pTask || m_pTask->cancelled.load() || m_pTask->stage.load() != Stage::Done)
+        return {};
+    return std::exchange(m_pTask->optResult, std::nullopt);
+}
+
+// Runs on the worker thread. The gradients are computed as soon as the scalar volume is complete; the cancellation
+// flag is checked after each step.
+void VolumeLoader::run(Task& task, const LoadConfig& config)
+{
+    try {
+        auto pVolume = std::make_unique<Volume>(task.file, config);
+        if (task.cancelled.load()) {
+            task.finish(Stage::Cancelled);
+            return;
+        }
+
+        std::unique_ptr<GradientVolume> pGradientVolume;
+        if (config.precomputeGradients && !config.outOfCore) {
+            task.stage.store(Stage::ComputingGradients);
+            pGradientVolume = std::make_unique<GradientVolume>(*pVolume, config.gradientFormat);
+            if (task.cancelled.load()) {
+                task.finish(Stage::Cancelled);
+                return;
+            }
+        }
+
+        // Write the cache file such that the next load of this file can skip the steps above.
+        if (config.useCacheFile && !config.outOfCore && !config.compressed && !config.loadsSubVolume() && pGradientVolume && config.gradientFormat == GradientFormat::Full && !pVolume->cache()) {
+            task.stage.store(Stage::WritingCache);
+            VolumeCache::write(task.file, *pVolume, *pGradientVolume);
+        }
+
+        task.optResult = Result { std::move(pVolume), std::move(pGradientVolume) };
+        task.finish(Stage::Done);
+    } catch (const std::exception&) {
+        task.finish(Stage::Failed);
+    }
+}
+
+void VolumeLoader::joinFinishedWorkers()
+{
+    const auto firstRunning = std::partition(std::begin(m_workers), std::end(m_workers),
+        [](const auto& worker) { return !worker.first->finished(); });
+    for (auto iter = firstRunning; iter != std::end(m_workers); iter++)
+        iter->second.join();
+    m_workers.erase(firstRunning, std::end(m_workers));
+}
+}
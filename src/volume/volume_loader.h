@@ -0,0 +1,70 @@
+#pragma once
+#include "gradient_volume.h"
+#include "load_config.h"
+#include "volume.h"
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace volume {
+
+// Loads a volume and computes its gradients on a worker thread such that the viewer stays responsive while large
+// volumes are loaded. The main thread polls for the result and swaps it in once both volumes are complete, so the
+// previously loaded volume can be rendered until then.
+class VolumeLoader {
+public:
+    enum class Stage {
+        LoadingVolume = 0,
+        ComputingGradients,
+        WritingCache,
+        Done,
+        Cancelled,
+        // The file could not be loaded, such as a missing file or one with an unsupported extension.
+        Failed
+    };
+
+    struct Progress {
+        std::filesystem::path file;
+        Stage stage;
+        std::chrono::duration<double> elapsed;
+    };
+
+    struct Result {
+        std::unique_ptr<Volume> pVolume;
+        // nullptr if LoadConfig::precomputeGradients is disabled (or ignored for out-of-core volumes).
+        std::unique_ptr<GradientVolume> pGradientVolume;
+    };
+
+public:
+    VolumeLoader() = default;
+    VolumeLoader(const VolumeLoader&) = delete;
+    VolumeLoader& operator=(const VolumeLoader&) = delete;
+    ~VolumeLoader();
+
+    // Start loading the file on a worker thread. A load that is still in progress is cancelled.
+    void load(const std::filesystem::path& file, const LoadConfig& config);
+    // Cancel the current load. The volume and gradient constructors cannot be interrupted, so the worker finishes the
+    // step it is working on in the background and then discards its result.
+    void cancel();
+
+    bool isLoading() const;
+    // Progress of the current (or most recent) load; std::nullopt if no load was started yet.
+    std::optional<Progress> progress() const;
+    // Returns the loaded volume (exactly once) after the current load has finished successfully.
+    std::optional<Result> takeResult();
+
+private:
+    struct Task;
+    static void run(Task& task, const LoadConfig& config);
+    void joinFinishedWorkers();
+
+private:
+    std::shared_ptr<Task> m_pTask;
+    // Worker threads of the current load and of cancelled loads that have not finished yet.
+    std::vector<std::pair<std::shared_ptr<Task>, std::thread>> m_workers;
+};
+}
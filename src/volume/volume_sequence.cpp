@@ -0,0 +1,350 @@
+#include "volume_sequence.h"
+#include <algorithm>
+#include <cctype> // isdigit
+#include <cstring>
+#include <exception>
+#include <glm/common.hpp>
+#include <iostream>
+#include <map>
+#include <string>
+
+namespace volume {
+
+// Size of the bricks in which the changes between timesteps are tracked.
+static constexpr int deltaBrickSize = VoxelIndexer::brickSize;
+
+// Split the stem of a file name into the part before the number at its end and that number (empty if there is none).
+static std::pair<std::string, std::string> splitTrailingNumber(const std::string& stem)
+{
+    size_t numberStart = stem.size();
+    while (numberStart > 0 && std::isdigit(static_cast<unsigned char>(stem[numberStart - 1])))
+        numberStart--;
+    return { stem.substr(0, numberStart), stem.substr(numberStart) };
+}
+
+std::vector<std::filesystem::path> VolumeSequence::findSeries(const std::filesystem::path& file)
+{
+    const auto [prefix, number] = splitTrailingNumber(file.stem().string());
+    if (number.empty())
+        return { file };
+
+    std::error_code error;
+    std::map<unsigned long long, std::filesystem::path> series;
+    for (const auto& entry : std::filesystem::directory_iterator(file.parent_path(), error)) {
+        const std::filesystem::path& path = entry.path();
+        if (path.extension() != file.extension())
+            continue;
+        const auto [otherPrefix, otherNumber] = splitTrailingNumber(path.stem().string());
+        if (otherPrefix == prefix && !otherNumber.empty())
+            series.emplace(std::stoull(otherNumber), path);
+    }
+    if (series.empty())
+        return { file };
+
+    std::vector<std::filesystem::path> out;
+    for (const auto& [seriesNumber, path] : series)
+        out.push_back(path);
+    return out;
+}
+
+VolumeSequence::VolumeSequence(std::vector<std::filesystem::path> files, const SequenceConfig& config)
+    : m_files(std::move(files))
+    , m_config(config)
+    , m_framesPerSecond(config.framesPerSecond)
+{
+    // The first timestep determines the dimensions, the voxel type and the statistics of the whole sequence.
+    LoadConfig loadConfig {};
+    loadConfig.mipPyramid = MipPyramid::Never;
+    loadConfig.useCacheFile = false;
+    if (m_files.empty())
+        throw std::exception();
+    const Volume firstTimestep { m_files[0], loadConfig };
+    const auto voxels = firstTimestep.voxels();
+    if (voxels.empty())
+        throw std::exception();
+
+    m_dim = firstTimestep.dims();
+    m_elementSize = voxels.size() / (size_t(m_dim.x) * size_t(m_dim.y) * size_t(m_dim.z));
+    m_brickCount = (m_dim + deltaBrickSize - 1) / deltaBrickSize;
+    if (m_config.deltaBricks)
+        encodeDeltaBricks(firstTimestep);
+
+    // Allocate all buffers of the ring up front; every slot starts out with the first timestep.
+    m_slots.resize(size_t(std::max(m_config.prefetchCount, 0)) + 1);
+    for (Slot& slot : m_slots) {
+        slot.pVolume = std::make_unique<Volume>(m_dim, firstTimestep.voxelType(), std::vector<std::byte>(std::begin(voxels), std::end(voxels)));
+        slot.pGradientVolume = std::make_unique<GradientVolume>(*slot.pVolume);
+    }
+    m_slots[0].state = SlotState::Current;
+
+    schedule();
+    for (int i = 0; i < std::max(m_config.decodeThreads, 1); i++)
+        m_decodeThreads.emplace_back(&VolumeSequence::runDecodeThread, this);
+}
+
+VolumeSequence::~VolumeSequence()
+{
+    {
+        std::lock_guard lock { m_mutex };
+        m_stop = true;
+    }
+    m_slotQueued.notify_all();
+    for (auto& decodeThread : m_decodeThreads)
+        decodeThread.join();
+}
+
+const Volume& VolumeSequence::volume() const
+{
+    return *m_slots[m_currentSlot].pVolume;
+}
+
+const GradientVolume& VolumeSequence::gradientVolume() const
+{
+    return *m_slots[m_currentSlot].pGradientVolume;
+}
+
+// The decode threads never read the interpolation modes, so they can be changed while a slot is being decoded.
+void VolumeSequence::setInterpolationMode(InterpolationMode interpolationMode)
+{
+    for (Slot& slot : m_slots) {
+        slot.pVolume->interpolationMode = interpolationMode;
+        slot.pGradientVolume->interpolationMode = interpolationMode;
+    }
+}
+
+size_t VolumeSequence::timestepCount() const
+{
+    return m_files.size();
+}
+
+size_t VolumeSequence::currentTimestep() const
+{
+    return m_currentTimestep;
+}
+
+const std::filesystem::path& VolumeSequence::file(size_t timestep) const
+{
+    return m_files[timestep];
+}
+
+void VolumeSequence::play()
+{
+    m_playing = true;
+    m_playbackTime = 0.0;
+}
+
+void VolumeSequence::pause()
+{
+    m_playing = false;
+}
+
+bool VolumeSequence::isPlaying() const
+{
+    return m_playing;
+}
+
+void VolumeSequence::setFramesPerSecond(float framesPerSecond)
+{
+    m_framesPerSecond = std::max(framesPerSecond, 0.01f);
+}
+
+float VolumeSequence::framesPerSecond() const
+{
+    return m_framesPerSecond;
+}
+
+size_t VolumeSequence::stalls() const
+{
+    return m_stalls;
+}
+
+size_t VolumeSequence::deltaBytes() const
+{
+    size_t out = 0;
+    for (const DeltaTimestep& delta : m_deltaTimesteps)
+        out += delta.keyframe.size() + delta.bricks.size() * sizeof(uint32_t) + delta.brickVoxels.size();
+    return out;
+}
+
+bool VolumeSequence::update(std::chrono::duration<double> elapsed)
+{
+    if (!m_playing)
+        return false;
+
+    const double frameDuration = 1.0 / double(m_framesPerSecond);
+    m_playbackTime += elapsed.count();
+    bool changed = false;
+    std::unique_lock lock { m_mutex };
+    while (m_playbackTime >= frameDuration) {
+        if (!m_config.loop && m_currentTimestep + 1 == m_files.size()) {
+            m_playing = false;
+            break;
+        }
+        const size_t nextTimestep = (m_currentTimestep + 1) % m_files.size();
+        const auto nextSlot = std::find_if(std::begin(m_slots), std::end(m_slots),
+            [&](const Slot& slot) { return slot.state == SlotState::Ready && slot.timestep == nextTimestep; });
+        if (nextSlot == std::end(m_slots)) {
+            // Hold the current timestep, but do not build up a backlog of frames that would be skipped later.
+            m_stalls += m_stalled ? 0 : 1;
+            m_stalled = true;
+            m_playbackTime = frameDuration;
+            break;
+        }
+
+        m_slots[m_currentSlot].state = SlotState::Free;
+        nextSlot->state = SlotState::Current;
+        m_currentSlot = size_t(nextSlot - std::begin(m_slots));
+        m_currentTimestep = nextTimestep;
+        m_playbackTime -= frameDuration;
+        m_stalled = false;
+        changed = true;
+    }
+    if (changed) {
+        schedule();
+        lock.unlock();
+        m_slotQueued.notify_all();
+    }
+    return changed;
+}
+
+// Queue the prefetchCount timesteps after the current one in free slots (if they are not decoded or queued already).
+// Must be called with m_mutex locked.
+void VolumeSequence::schedule()
+{
+    for (size_t i = 1; i <= size_t(std::max(m_config.prefetchCount, 0)); i++) {
+        size_t timestep = m_currentTimestep + i;
+        if (timestep >= m_files.size()) {
+            if (!m_config.loop)
+                break;
+            timestep %= m_files.size();
+        }
+        const bool present = std::any_of(std::begin(m_slots), std::end(m_slots),
+            [&](const Slot& slot) { return slot.state != SlotState::Free && slot.timestep == timestep; });
+        if (present)
+            continue;
+        const auto freeSlot = std::find_if(std::begin(m_slots), std::end(m_slots), [](const Slot& slot) { return slot.state == SlotState::Free; });
+        if (freeSlot == std::end(m_slots))
+            break;
+        freeSlot->timestep = timestep;
+        freeSlot->state = SlotState::Queued;
+    }
+}
+
+// Decode threads take the queued timestep that is needed first.
+void VolumeSequence::runDecodeThread()
+{
+    std::unique_lock lock { m_mutex };
+    while (true) {
+        auto isQueued = [](const Slot& slot) { return slot.state == SlotState::Queued; };
+        m_slotQueued.wait(lock, [&]() { return m_stop || std::any_of(std::begin(m_slots), std::end(m_slots), isQueued); });
+        if (m_stop)
+            return;
+
+        Slot* pSlot = nullptr;
+        size_t minDistance = m_files.size();
+        for (Slot& slot : m_slots) {
+            const size_t distance = (slot.timestep + m_files.size() - m_currentTimestep) % m_files.size();
+            if (isQueued(slot) && distance < minDistance) {
+                pSlot = &slot;
+                minDistance = distance;
+            }
+        }
+        // The wait only returns when a slot is queued (and the distances are below m_files.size()), so this is a guard.
+        if (!pSlot)
+            continue;
+        pSlot->state = SlotState::Decoding;
+        const size_t timestep = pSlot->timestep;
+
+        lock.unlock();
+        decode(timestep, *pSlot);
+        lock.lock();
+        pSlot->state = SlotState::Ready;
+    }
+}
+
+// Calls f(offset, size) for every row of voxels of a brick, with the offset and size in bytes (relative to the voxels in
+// scanline order). The bricks on the far sides of the volume are only partially filled.
+template <typename F>
+void VolumeSequence::forEachBrickRow(size_t brick, F&& f) const
+{
+    const glm::ivec3 brickPos {
+        int(brick % size_t(m_brickCount.x)),
+        int(brick / size_t(m_brickCount.x) % size_t(m_brickCount.y)),
+        int(brick / (size_t(m_brickCount.x) * size_t(m_brickCount.y)))
+    };
+    const glm::ivec3 begin = brickPos * deltaBrickSize;
+    const glm::ivec3 end = glm::min(begin + deltaBrickSize, m_dim);
+    const size_t rowSize = size_t(end.x - begin.x) * m_elementSize;
+    for (int z = begin.z; z < end.z; z++) {
+        for (int y = begin.y; y < end.y; y++)
+            f((size_t(begin.x) + size_t(m_dim.x) * (size_t(y) + size_t(m_dim.y) * size_t(z))) * m_elementSize, rowSize);
+    }
+}
+
+// Read every timestep once and store the bricks that differ from the previous timestep. Every keyframeInterval
+// timesteps a keyframe with all voxels is stored instead, so that decoding a timestep applies at most
+// keyframeInterval - 1 deltas.
+void VolumeSequence::encodeDeltaBricks(const Volume& firstTimestep)
+{
+    const size_t brickTotal = size_t(m_brickCount.x) * size_t(m_brickCount.y) * size_t(m_brickCount.z);
+    const auto firstVoxels = firstTimestep.voxels();
+    std::vector<std::byte> previous(std::begin(firstVoxels), std::end(firstVoxels));
+    Volume staging { m_dim, firstTimestep.voxelType(), previous };
+    const gsl::span<const std::byte> voxels = staging.voxels();
+    std::vector<char> changed(brickTotal, 0);
+
+    m_deltaTimesteps.resize(m_files.size());
+    for (size_t timestep = 0; timestep < m_files.size(); timestep++) {
+        if (timestep > 0 && !staging.readVoxels(m_files[timestep]))
+            std::cerr << "Could not read timestep " << m_files[timestep] << std::endl;
+
+        DeltaTimestep& delta = m_deltaTimesteps[timestep];
+        if (timestep % keyframeInterval == 0) {
+            delta.keyframe.assign(std::begin(voxels), std::end(voxels));
+        } else {
+#pragma omp parallel for schedule(dynamic)
+            for (int64_t brick = 0; brick < int64_t(brickTotal); brick++) {
+                bool differs = false;
+                forEachBrickRow(size_t(brick), [&](size_t offset, size_t size) {
+                    differs = differs || std::memcmp(voxels.data() + offset, previous.data() + offset, size) != 0;
+                });
+                changed[size_t(brick)] = differs;
+            }
+            for (size_t brick = 0; brick < brickTotal; brick++) {
+                if (!changed[brick])
+                    continue;
+                delta.bricks.push_back(uint32_t(brick));
+                forEachBrickRow(brick, [&](size_t offset, size_t size) {
+                    delta.brickVoxels.insert(std::end(delta.brickVoxels), voxels.data() + offset, voxels.data() + offset + size);
+                });
+            }
+        }
+        std::copy(std::begin(voxels), std::end(voxels), std::begin(previous));
+    }
+}
+
+// Runs on a decode thread: fill the (preallocated) voxels of the slot with the timestep and update its gradients.
+void VolumeSequence::decode(size_t timestep, Slot& slot) const
+{
+    Volume& volume = *slot.pVolume;
+    if (m_deltaTimesteps.empty()) {
+        if (!volume.readVoxels(m_files[timestep]))
+            std::cerr << "Could not read timestep " << m_files[timestep] << std::endl;
+    } else {
+        const gsl::span<std::byte> voxels = volume.mutableVoxels();
+        const size_t keyframe = timestep - timestep % keyframeInterval;
+        std::memcpy(voxels.data(), m_deltaTimesteps[keyframe].keyframe.data(), voxels.size());
+        for (size_t deltaTimestep = keyframe + 1; deltaTimestep <= timestep; deltaTimestep++) {
+            const DeltaTimestep& delta = m_deltaTimesteps[deltaTimestep];
+            const std::byte* pBrickVoxels = delta.brickVoxels.data();
+            for (const uint32_t brick : delta.bricks) {
+                forEachBrickRow(brick, [&](size_t offset, size_t size) {
+                    std::memcpy(voxels.data() + offset, pBrickVoxels, size);
+                    pBrickVoxels += size;
+                });
+            }
+        }
+    }
+    slot.pGradientVolume->update(volume);
+}
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include "gradient_volume.h"
+#include "volume.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <glm/vec3.hpp>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace volume {
+
+struct SequenceConfig {
+    // Number of timesteps after the current one that are decoded ahead of time.
+    int prefetchCount { 4 };
+    // Number of background threads that decode timesteps.
+    int decodeThreads { 2 };
+    float framesPerSecond { 10.0f };
+    bool loop { true };
+
+    // Keep all timesteps in memory, stored as the bricks that changed since the previous timestep (with a complete
+    // keyframe every keyframeInterval timesteps), instead of reading every timestep from disk during playback. All
+    // files are read once when the sequence is created.
+    bool deltaBricks { false };
+};
+
+// A time-varying volume: a numbered series of volume files with the same dimensions and voxel type that is played back
+// at a fixed rate. The timesteps are decoded on background threads into a ring of prefetchCount + 1 volumes (and
+// gradient volumes) that are allocated once, so playback itself does not allocate. The statistics (and therefore the
+// transfer function ranges) of all timesteps are those of the first timestep.
+class VolumeSequence {
+public:
+    static constexpr size_t keyframeInterval = 16;
+
+public:
+    // The numbered series that file belongs to: the files in the same directory whose names only differ from the name of
+    // file in the number at the end of the stem (e.g. heart_007.fld), sorted by that number.
+    static std::vector<std::filesystem::path> findSeries(const std::filesystem::path& file);
+
+    VolumeSequence(std::vector<std::filesystem::path> files, const SequenceConfig& config = {});
+    VolumeSequence(const VolumeSequence&) = delete;
+    VolumeSequence& operator=(const VolumeSequence&) = delete;
+    ~VolumeSequence();
+
+    // The current timestep. The references stay valid until update() moves on to the next timestep.
+    const Volume& volume() const;
+    const GradientVolume& gradientVolume() const;
+    // Set the interpolation mode of the volumes and gradient volumes of all timesteps.
+    void setInterpolationMode(InterpolationMode interpolationMode);
+
+    size_t timestepCount() const;
+    size_t currentTimestep() const;
+    const std::filesystem::path& file(size_t timestep) const;
+
+    void play();
+    void pause();
+    bool isPlaying() const;
+    void setFramesPerSecond(float framesPerSecond);
+    float framesPerSecond() const;
+
+    // Advance the playback clock by the time that passed since the previous call. Returns true if another timestep became
+    // current. If the next timestep has not been decoded yet then the current one is held (a stall) and playback
+    // continues as soon as it is ready; update never waits for the decode threads.
+    bool update(std::chrono::duration<double> elapsed);
+    // Number of times that playback had to hold a timestep because the next one was not decoded in time.
+    size_t stalls() const;
+    // Memory used by the delta bricks (0 if SequenceConfig::deltaBricks is disabled).
+    size_t deltaBytes() const;
+
+private:
+    enum class SlotState {
+        Free,
+        Queued,
+        Decoding,
+        Ready,
+        Current
+    };
+    struct Slot {
+        std::unique_ptr<Volume> pVolume;
+        std::unique_ptr<GradientVolume> pGradientVolume;
+        size_t timestep { 0 };
+        SlotState state { SlotState::Free };
+    };
+    struct DeltaTimestep {
+        // Only keyframes store all voxels.
+        std::vector<std::byte> keyframe;
+        // Indices of the bricks that differ from the previous timestep and their voxels (brick after brick).
+        std::vector<uint32_t> bricks;
+        std::vector<std::byte> brickVoxels;
+    };
+
+    void encodeDeltaBricks(const Volume& firstTimestep);
+    void decode(size_t timestep, Slot& slot) const;
+    void schedule();
+    void runDecodeThread();
+
+    template <typename F>
+    void forEachBrickRow(size_t brick, F&& f) const;
+
+private:
+    const std::vector<std::filesystem::path> m_files;
+    const SequenceConfig m_config;
+    glm::ivec3 m_dim;
+    size_t m_elementSize;
+    glm::ivec3 m_brickCount;
+    std::vector<DeltaTimestep> m_deltaTimesteps;
+
+    // The slots are only resized in the constructor. The decode threads only touch the volumes of the slot that they
+    // are decoding; the main thread only touches the volumes of the current slot.
+    std::vector<Slot> m_slots;
+    size_t m_currentSlot { 0 };
+    size_t m_currentTimestep { 0 };
+    mutable std::mutex m_mutex;
+    std::condition_variable m_slotQueued;
+    bool m_stop { false };
+    std::vector<std::thread> m_decodeThreads;
+
+    // Playback state, only used by the main thread.
+    bool m_playing { false };
+    float m_framesPerSecond;
+    double m_playbackTime { 0.0 };
+    bool m_stalled { false };
+    size_t m_stalls { 0 };
+};
+}
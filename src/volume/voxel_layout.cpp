@@ -0,0 +1,144 @@
+#include "voxel_layout.h"
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+namespace volume {
+
+// Bit masks selecting the bits of the x, y and z coordinate in a Morton code.
+static constexpr uint32_t mortonMaskX = 0x09249249;
+static constexpr uint32_t mortonMaskY = 0x12492492;
+static constexpr uint32_t mortonMaskZ = 0x24924924;
+
+#if !defined(__BMI2__)
+// Spread the lower 10 bits of v such that there are two zero bits between each of them.
+static uint32_t spreadBits(uint32_t v)
+{
+    v &= 0x000003ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+// Inverse of spreadBits.
+static uint32_t compactBits(uint32_t v)
+{
+    v &= 0x09249249;
+    v = (v | (v >> 2)) & 0x030c30c3;
+    v = (v | (v >> 4)) & 0x0300f00f;
+    v = (v | (v >> 8)) & 0x030000ff;
+    v = (v | (v >> 16)) & 0x000003ff;
+    return v;
+}
+#endif
+
+// Uses the BMI2 bit deposit/extract instructions if the compiler targets them, and the classic shift-and-mask
+// sequence otherwise.
+uint32_t mortonEncode(const glm::uvec3& p)
+{
+#if defined(__BMI2__)
+    return _pdep_u32(p.x, mortonMaskX) | _pdep_u32(p.y, mortonMaskY) | _pdep_u32(p.z, mortonMaskZ);
+#else
+    return spreadBits(p.x) | (spreadBits(p.y) << 1) | (spreadBits(p.z) << 2);
+#endif
+}
+
+glm::uvec3 mortonDecode(uint32_t code)
+{
+#if defined(__BMI2__)
+    return { _pext_u32(code, mortonMaskX), _pext_u32(code, mortonMaskY), _pext_u32(code, mortonMaskZ) };
+#else
+    return { compactBits(code & mortonMaskX), compactBits((code & mortonMaskY) >> 1), compactBits((code & mortonMaskZ) >> 2) };
+#endif
+}
+
+// Fill the Morton lookup table for one axis. tileStride is the distance between two consecutive tiles along the axis.
+static std::vector<size_t> computeMortonTable(int dim, size_t tileStride, const glm::uvec3& axis, int tileSize)
+{
+    std::vector<size_t> table(size_t(dim) + 1);
+    for (size_t i = 0; i < table.size(); i++) {
+        const auto local = unsigned(i % size_t(tileSize));
+        table[i] = (i / size_t(tileSize)) * tileStride + mortonEncode(axis * local);
+    }
+    return table;
+}
+
+VoxelIndexer::VoxelIndexer(VoxelLayout layout, const glm::ivec3& dim)
+    : m_layout(layout)
+    , m_dim(dim)
+{
+    switch (m_layout) {
+    case VoxelLayout::Linear: {
+        m_size = size_t(dim.x) * size_t(dim.y) * size_t(dim.z);
+        break;
+    }
+    case VoxelLayout::Bricked: {
+        // Round up such that the bricks cover the whole volume.
+        m_brickCount = (dim + (brickSize - 1)) / brickSize;
+        m_size = size_t(m_brickCount.x) * size_t(m_brickCount.y) * size_t(m_brickCount.z) * storedBrickVoxels;
+        break;
+    }
+    case VoxelLayout::Morton: {
+        const glm::ivec3 tileCount = (dim + (mortonTileSize - 1)) / mortonTileSize;
+        const size_t strideY = size_t(tileCount.x) * mortonTileVoxels;
+        const size_t strideZ = size_t(tileCount.y) * strideY;
+        m_mortonX = computeMortonTable(dim.x, mortonTileVoxels, glm::uvec3(1, 0, 0), mortonTileSize);
+        m_mortonY = computeMortonTable(dim.y, strideY, glm::uvec3(0, 1, 0), mortonTileSize);
+        m_mortonZ = computeMortonTable(dim.z, strideZ, glm::uvec3(0, 0, 1), mortonTileSize);
+        m_size = size_t(tileCount.z) * strideZ;
+        break;
+    }
+    }
+}
+
+VoxelLayout VoxelIndexer::layout() const
+{
+    return m_layout;
+}
+
+size_t VoxelIndexer::size() const
+{
+    return m_size;
+}
+
+glm::ivec3 VoxelIndexer::position(size_t index) const
+{
+    switch (m_layout) {
+    case VoxelLayout::Bricked: {
+        const size_t brick = index / storedBrickVoxels;
+        const size_t local = index % storedBrickVoxels;
+        const glm::ivec3 brickPos {
+            int(brick % size_t(m_brickCount.x)),
+            int(brick / size_t(m_brickCount.x) % size_t(m_brickCount.y)),
+            int(brick / (size_t(m_brickCount.x) * size_t(m_brickCount.y)))
+        };
+        const glm::ivec3 localPos {
+            int(local % storedBrickSize),
+            int(local / storedBrickSize % storedBrickSize),
+            int(local / (storedBrickSize * storedBrickSize))
+        };
+        return brickPos * brickSize + localPos;
+    }
+    case VoxelLayout::Morton: {
+        const size_t tile = index / mortonTileVoxels;
+        const glm::ivec3 tileCount = (m_dim + (mortonTileSize - 1)) / mortonTileSize;
+        const glm::ivec3 tilePos {
+            int(tile % size_t(tileCount.x)),
+            int(tile / size_t(tileCount.x) % size_t(tileCount.y)),
+            int(tile / (size_t(tileCount.x) * size_t(tileCount.y)))
+        };
+        return tilePos * mortonTileSize + glm::ivec3(mortonDecode(uint32_t(index % mortonTileVoxels)));
+    }
+    case VoxelLayout::Linear:
+    default: {
+        return {
+            int(index % size_t(m_dim.x)),
+            int(index / size_t(m_dim.x) % size_t(m_dim.y)),
+            int(index / (size_t(m_dim.x) * size_t(m_dim.y)))
+        };
+    }
+    }
+}
+}
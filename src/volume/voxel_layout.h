@@ -0,0 +1,113 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <glm/vec3.hpp>
+#include <vector>
+
+namespace volume {
+
+// Order in which the voxels of a volume (and of its gradient volume) are stored in memory.
+enum class VoxelLayout {
+    // Scanline order: x is the fastest changing coordinate, then y, then z.
+    Linear = 0,
+    // The volume is split into bricks of brickSize^3 voxels that are each stored contiguously (in scanline order). Each
+    // brick has a 1 voxel apron on its +x, +y and +z sides which duplicates the first voxels of the neighbouring bricks,
+    // such that the 8 corners of any cell can be read from a single brick.
+    Bricked,
+    // The volume is split into tiles of mortonTileSize^3 voxels (stored one after the other in scanline order) and the
+    // voxels inside a tile are stored in Morton (Z-curve) order. Tiling keeps the padding small for volumes whose
+    // dimensions are not a (equal) power of two, such as anisotropic scans.
+    Morton
+};
+
+// Interleave the bits of three 10-bit coordinates (x in the lowest bit) and the inverse.
+uint32_t mortonEncode(const glm::uvec3& p);
+glm::uvec3 mortonDecode(uint32_t code);
+
+// Storage indices of the 8 corners of a cell. The corner (x + i, y + j, z + k) is stored at
+// base + i * dx + j * dy + k * dz (for i, j, k in {0, 1}).
+struct VoxelCell {
+    size_t base;
+    size_t dx, dy, dz;
+};
+
+// Maps voxel coordinates to the index at which the voxel is stored for a given layout (and back).
+class VoxelIndexer {
+public:
+    static constexpr int brickSize = 16;
+    static constexpr int mortonTileSize = 32;
+    // Brick dimensions including the apron.
+    static constexpr size_t storedBrickSize = brickSize + 1;
+    static constexpr size_t storedBrickVoxels = storedBrickSize * storedBrickSize * storedBrickSize;
+
+public:
+    VoxelIndexer() = default;
+    VoxelIndexer(VoxelLayout layout, const glm::ivec3& dim);
+
+    VoxelLayout layout() const;
+    // Number of stored elements (including the brick aprons and the padding of partially filled bricks).
+    size_t size() const;
+    // Coordinates of the voxel stored at index. For apron/padding elements this may lie outside of the volume.
+    glm::ivec3 position(size_t index) const;
+
+    size_t index(int x, int y, int z) const;
+    // Only valid for cells that lie inside the volume (x < dim.x - 1, y < dim.y - 1, z < dim.z - 1).
+    VoxelCell cell(int x, int y, int z) const;
+
+private:
+    static constexpr size_t mortonTileVoxels = size_t(mortonTileSize) * mortonTileSize * mortonTileSize;
+
+    VoxelLayout m_layout { VoxelLayout::Linear };
+    glm::ivec3 m_dim { 0 };
+    glm::ivec3 m_brickCount { 0 };
+    size_t m_size { 0 };
+
+    // Morton layout: the index of voxel (x, y, z) is m_mortonX[x] + m_mortonY[y] + m_mortonZ[z]. Each table holds the
+    // offset of the tile plus the interleaved bits of the coordinate within the tile. Because the bits of the three
+    // axes do not overlap, the offset to the x + 1 neighbour only depends on x (and likewise for y and z).
+    std::vector<size_t> m_mortonX, m_mortonY, m_mortonZ;
+};
+
+// The functions below are called for every voxel access so they are defined in the header to allow inlining.
+inline size_t VoxelIndexer::index(int x, int y, int z) const
+{
+    switch (m_layout) {
+    case VoxelLayout::Bricked: {
+        const auto ux = unsigned(x), uy = unsigned(y), uz = unsigned(z);
+        const size_t brick = ux / brickSize + size_t(m_brickCount.x) * (uy / brickSize + size_t(m_brickCount.y) * (uz / brickSize));
+        const size_t local = ux % brickSize + storedBrickSize * (uy % brickSize + storedBrickSize * (uz % brickSize));
+        return brick * storedBrickVoxels + local;
+    }
+    case VoxelLayout::Morton: {
+        return m_mortonX[size_t(x)] + m_mortonY[size_t(y)] + m_mortonZ[size_t(z)];
+    }
+    case VoxelLayout::Linear:
+    default: {
+        return size_t(x) + size_t(m_dim.x) * (size_t(y) + size_t(m_dim.y) * size_t(z));
+    }
+    }
+}
+
+inline VoxelCell VoxelIndexer::cell(int x, int y, int z) const
+{
+    switch (m_layout) {
+    case VoxelLayout::Bricked: {
+        return { index(x, y, z), 1, storedBrickSize, storedBrickSize * storedBrickSize };
+    }
+    case VoxelLayout::Morton: {
+        // The tables have an extra entry at the end so x + 1 is always a valid lookup.
+        const size_t ix = size_t(x), iy = size_t(y), iz = size_t(z);
+        return {
+            m_mortonX[ix] + m_mortonY[iy] + m_mortonZ[iz],
+            m_mortonX[ix + 1] - m_mortonX[ix],
+            m_mortonY[iy + 1] - m_mortonY[iy],
+            m_mortonZ[iz + 1] - m_mortonZ[iz]
+        };
+    }
+    case VoxelLayout::Linear:
+    default: {
+        return { index(x, y, z), 1, size_t(m_dim.x), size_t(m_dim.x) * size_t(m_dim.y) };
+    }
+    }
+}
+}